@@ -0,0 +1,16 @@
+@echo off
+
+rem Builds the offline level cooker (tmx -> binary level), run it from run_tree after editing levels.
+
+call vcvarsall.bat x64
+
+IF NOT EXIST build mkdir build
+pushd build
+
+set compiler_flags=-O2 -DBUILD_DEBUG=1 -FC -nologo -fp:fast -Gm- -GR- -EHa- -WX -W4
+set compiler_flags=-wd4996 -wd4201 -wd4100 -wd4189 -wd4505 -wd4127 -GS- %compiler_flags%
+
+cl %compiler_flags% ../code/cooker.cpp -link kernel32.lib
+copy /y cooker.exe ..\run_tree\cooker.exe
+
+popd
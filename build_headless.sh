@@ -0,0 +1,21 @@
+#!/bin/bash
+
+# Builds the headless simulation runner, links only the simulation core (no raylib).
+
+mkdir -p build
+pushd build > /dev/null
+
+# Common flags
+compiler_flags="-Wall -Wno-missing-braces -Wno-switch -Wno-sign-compare -Wno-unused-but-set-variable -Wno-unused-function"
+linker_flags="-lm -pthread"
+
+if [ "$1" == "release" ]; then
+    compiler_flags="-O2 -DBUILD_DEBUG=0 $compiler_flags"
+else
+    compiler_flags="-O0 -g -DBUILD_DEBUG=1 $compiler_flags"
+fi
+
+g++ $compiler_flags ../code/headless.cpp -o headless $linker_flags || exit 1
+cp headless ../run_tree/headless
+
+popd > /dev/null
@@ -0,0 +1,220 @@
+// NOTE(Alexander): packs all sprite images into one texture at load time so the entity
+// draw loop doesn't switch textures (and flush raylib's batch) for every sprite.
+// Uses a skyline bottom-left packer, images are placed tallest first.
+
+#define MAX_ATLAS_IMAGES 32
+#define MAX_ATLAS_SKYLINE_NODES 64
+#define ATLAS_PADDING 1 // NOTE(Alexander): keeps neighbouring sprites from bleeding into each other
+
+struct Atlas_Entry {
+    cstring filename; // NOTE(Alexander): decoded by build_atlas, null if the image was passed in
+    Image image;
+    Sprite* sprite;
+};
+
+struct Atlas_Skyline_Node {
+    int x;
+    int y;
+    int width;
+};
+
+struct Atlas_Builder {
+    Atlas_Entry entries[MAX_ATLAS_IMAGES];
+    int entry_count;
+    
+    Atlas_Skyline_Node nodes[MAX_ATLAS_SKYLINE_NODES];
+    int node_count;
+    
+    int width;
+    int height; // NOTE(Alexander): highest point of the skyline so far
+};
+
+// NOTE(Alexander): the atlas takes ownership of the image, the sprite is filled in by build_atlas
+void
+add_atlas_image(Atlas_Builder* builder, Image image, Sprite* sprite, bool wrap=false) {
+    assert(builder->entry_count < MAX_ATLAS_IMAGES);
+    
+    Atlas_Entry* entry = &builder->entries[builder->entry_count++];
+    entry->filename = 0;
+    entry->image = image;
+    entry->sprite = sprite;
+    sprite->wrap = wrap;
+}
+
+// NOTE(Alexander): the file isn't loaded until build_atlas, which decodes all of them in parallel
+inline void
+add_atlas_image(Atlas_Builder* builder, cstring filename, Sprite* sprite, bool wrap=false) {
+    Image image = {};
+    add_atlas_image(builder, image, sprite, wrap);
+    builder->entries[builder->entry_count - 1].filename = filename;
+}
+
+// NOTE(Alexander): LoadImage and ImageFormat only touch CPU memory so they are safe on workers
+void
+decode_atlas_images(void* data, s32 begin, s32 end) {
+    Atlas_Builder* builder = (Atlas_Builder*) data;
+    for (s32 i = begin; i < end; i++) {
+        Atlas_Entry* entry = &builder->entries[i];
+        if (entry->filename) {
+            entry->image = LoadImage(entry->filename);
+        }
+        ImageFormat(&entry->image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    }
+}
+
+// NOTE(Alexander): returns the lowest y the rect can be placed at when its left edge starts
+// at node_index, or -1 if it goes past the right edge of the atlas.
+int
+atlas_skyline_fit(Atlas_Builder* builder, int node_index, int width) {
+    int x = builder->nodes[node_index].x;
+    if (x + width > builder->width) {
+        return -1;
+    }
+    
+    int y = 0;
+    int remaining = width;
+    for (int i = node_index; remaining > 0; i++) {
+        assert(i < builder->node_count);
+        y = max(y, builder->nodes[i].y);
+        remaining -= builder->nodes[i].width;
+    }
+    return y;
+}
+
+void
+atlas_skyline_insert(Atlas_Builder* builder, int node_index, int x, int y, int width) {
+    assert(builder->node_count < MAX_ATLAS_SKYLINE_NODES);
+    
+    Atlas_Skyline_Node* nodes = builder->nodes;
+    for (int i = builder->node_count; i > node_index; i--) {
+        nodes[i] = nodes[i - 1];
+    }
+    builder->node_count++;
+    nodes[node_index].x = x;
+    nodes[node_index].y = y;
+    nodes[node_index].width = width;
+    
+    // Shrink or remove the nodes now covered by the new one
+    for (int i = node_index + 1; i < builder->node_count; i++) {
+        Atlas_Skyline_Node* prev = &nodes[i - 1];
+        Atlas_Skyline_Node* node = &nodes[i];
+        if (node->x >= prev->x + prev->width) {
+            break;
+        }
+        
+        int shrink = prev->x + prev->width - node->x;
+        node->x += shrink;
+        node->width -= shrink;
+        if (node->width > 0) {
+            break;
+        }
+        
+        for (int j = i; j < builder->node_count - 1; j++) {
+            nodes[j] = nodes[j + 1];
+        }
+        builder->node_count--;
+        i--;
+    }
+    
+    // Merge neighbours at the same height
+    for (int i = 0; i < builder->node_count - 1; i++) {
+        if (nodes[i].y == nodes[i + 1].y) {
+            nodes[i].width += nodes[i + 1].width;
+            for (int j = i + 1; j < builder->node_count - 1; j++) {
+                nodes[j] = nodes[j + 1];
+            }
+            builder->node_count--;
+            i--;
+        }
+    }
+}
+
+bool
+atlas_pack_rect(Atlas_Builder* builder, int width, int height, int* out_x, int* out_y) {
+    int best_index = -1;
+    int best_x = 0;
+    int best_y = 0;
+    for (int i = 0; i < builder->node_count; i++) {
+        int y = atlas_skyline_fit(builder, i, width);
+        if (y >= 0 && (best_index == -1 || y < best_y)) {
+            best_index = i;
+            best_x = builder->nodes[i].x;
+            best_y = y;
+        }
+    }
+    
+    if (best_index == -1) {
+        return false;
+    }
+    
+    atlas_skyline_insert(builder, best_index, best_x, best_y + height, width);
+    builder->height = max(builder->height, best_y + height);
+    *out_x = best_x;
+    *out_y = best_y;
+    return true;
+}
+
+Texture2D
+build_atlas(Atlas_Builder* builder, int width, Job_System* jobs) {
+    parallel_for(jobs, builder->entry_count, 1, decode_atlas_images, builder);
+    
+    builder->width = width;
+    builder->height = 0;
+    builder->node_count = 1;
+    builder->nodes[0].x = 0;
+    builder->nodes[0].y = 0;
+    builder->nodes[0].width = width;
+    
+    // Tallest first, insertion sort is fine for a handful of images
+    Atlas_Entry* entries = builder->entries;
+    for (int i = 1; i < builder->entry_count; i++) {
+        Atlas_Entry entry = entries[i];
+        int j = i - 1;
+        for (; j >= 0 && entries[j].image.height < entry.image.height; j--) {
+            entries[j + 1] = entries[j];
+        }
+        entries[j + 1] = entry;
+    }
+    
+    for (int i = 0; i < builder->entry_count; i++) {
+        Atlas_Entry* entry = &entries[i];
+        int x = 0;
+        int y = 0;
+        if (!atlas_pack_rect(builder,
+                             entry->image.width + ATLAS_PADDING,
+                             entry->image.height + ATLAS_PADDING, &x, &y)) {
+            assert(0 && "atlas is too small");
+            continue;
+        }
+        
+        entry->sprite->rect.x = (f32) x;
+        entry->sprite->rect.y = (f32) y;
+        entry->sprite->rect.width = (f32) entry->image.width;
+        entry->sprite->rect.height = (f32) entry->image.height;
+    }
+    
+    // NOTE(Alexander): power of two height, WebGL 1 is picky about anything else
+    int height = 1;
+    while (height < builder->height) {
+        height *= 2;
+    }
+    
+    Image atlas_image = GenImageColor(width, height, BLANK);
+    for (int i = 0; i < builder->entry_count; i++) {
+        Atlas_Entry* entry = &entries[i];
+        Rectangle src = { 0.0f, 0.0f, (f32) entry->image.width, (f32) entry->image.height };
+        ImageDraw(&atlas_image, entry->image, src, entry->sprite->rect, WHITE);
+    }
+    
+    Texture2D result = LoadTextureFromImage(atlas_image);
+    UnloadImage(atlas_image);
+    SetTextureFilter(result, TEXTURE_FILTER_POINT);
+    
+    for (int i = 0; i < builder->entry_count; i++) {
+        entries[i].sprite->texture = result;
+        UnloadImage(entries[i].image);
+    }
+    builder->entry_count = 0;
+    
+    return result;
+}
@@ -0,0 +1,52 @@
+// NOTE(Alexander): offline level cooker, converts Tiled maps into the binary level format
+// from format_level.cpp that the game maps at load time. Run it from run_tree/ whenever a
+// level has been edited, the game falls back to parsing the tmx if the cooked file is
+// missing or was written by an older version. With -stream the tile layers are written as
+// a chunk stream (level_stream.cpp) instead, for open world levels that don't fit in memory.
+//
+// usage: cooker [-stream] [input.tmx] [output.lvl or output.lvs]
+
+#include "game.h"
+#include "format_tmx.cpp"
+#include "format_level.cpp"
+#include "level_stream.cpp"
+
+int
+main(int argc, char** argv) {
+    bool stream = argc > 1 && strcmp(argv[1], "-stream") == 0;
+    if (stream) {
+        argc--;
+        argv++;
+    }
+    
+    cstring input_filename = argc > 1 ? argv[1] : "assets/interior.tmx";
+    cstring output_filename = argc > 2 ? argv[2] : (stream ? "assets/interior.lvs" : "assets/interior.lvl");
+    
+    // NOTE(Alexander): the tmx loader pushes whole tile layers at once, open world maps need a lot
+    Memory_Arena arena = {};
+    if (!init_virtual_arena(&arena, gigabytes(4))) {
+        set_minimum_arena_block_size(&arena, megabytes(16));
+    }
+    
+    Loaded_Tmx tmx = read_tmx_map_data(string_lit(input_filename), &arena);
+    if (!tmx.is_loaded) {
+        printf("Failed to read %s\n", input_filename);
+        return 1;
+    }
+    
+    bool written = stream ? write_level_stream(output_filename, &tmx) : write_cooked_level(output_filename, &tmx);
+    if (!written) {
+        printf("Failed to write %s\n", output_filename);
+        return 1;
+    }
+    
+    printf("Cooked %s -> %s (%dx%d tiles, %d layers, %d entities, %d colliders)\n",
+           input_filename, output_filename, tmx.tile_map_width, tmx.tile_map_height,
+           tmx.layer_count, tmx.entity_count, tmx.collider_count);
+    
+#if ARENA_STATS
+    Arena_Stats stats = get_arena_stats(&arena);
+    print_arena_stats("arena", &stats);
+#endif
+    return 0;
+}
@@ -0,0 +1,288 @@
+// NOTE(Alexander): cooked level format, written offline by the cooker (cooker.cpp) so loading
+// a level doesn't parse any xml. The file is a header followed by aligned sections that are
+// used in place: the loader maps the file and points Loaded_Tmx straight into the mapping.
+// Bump LEVEL_FILE_VERSION whenever the layout or one of the section structs changes, files
+// with another version are rejected and the game falls back to parsing the tmx.
+
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+extern "C" {
+    __declspec(dllimport) void* __stdcall CreateFileA(const char* filename, unsigned long access, unsigned long share_mode, void* attributes, unsigned long creation, unsigned long flags, void* template_file);
+    __declspec(dllimport) int __stdcall GetFileSizeEx(void* file, long long* size);
+    __declspec(dllimport) void* __stdcall CreateFileMappingA(void* file, void* attributes, unsigned long protect, unsigned long size_high, unsigned long size_low, const char* name);
+    __declspec(dllimport) void* __stdcall MapViewOfFile(void* mapping, unsigned long access, unsigned long offset_high, unsigned long offset_low, size_t size);
+    __declspec(dllimport) int __stdcall UnmapViewOfFile(const void* address);
+}
+
+#define WIN32_GENERIC_READ 0x80000000
+#define WIN32_FILE_SHARE_READ 0x1
+#define WIN32_OPEN_EXISTING 3
+#define WIN32_FILE_ATTRIBUTE_NORMAL 0x80
+#define WIN32_PAGE_WRITECOPY 0x08
+#define WIN32_FILE_MAP_COPY 0x1
+#define WIN32_INVALID_HANDLE_VALUE ((void*) -1)
+
+#elif !defined(PLATFORM_WEB)
+#define FILE_MAPPING_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#define LEVEL_FILE_MAGIC 0x4C56454C // NOTE(Alexander): "LEVL" when read as bytes
+#define LEVEL_FILE_VERSION 2
+#define LEVEL_FILE_ALIGNMENT 64
+
+struct Level_File_Header {
+    u32 magic;
+    u32 version;
+    u32 file_size;
+    
+    // NOTE(Alexander): sizes of the section structs, catches layout changes without a version bump
+    u32 entity_size;
+    u32 collider_size;
+    
+    u32 tile_layers_offset; // NOTE(Alexander): Level_File_Tile_Layer[tile_layer_count]
+    u32 entities_offset; // NOTE(Alexander): Entity_Spawn[entity_count]
+    u32 colliders_offset; // NOTE(Alexander): Collider[collider_count]
+    
+    s32 tile_map_width;
+    s32 tile_map_height;
+    s32 tile_width;
+    s32 tile_height;
+    s32 tile_layer_count;
+    s32 entity_count;
+    s32 collider_count;
+};
+
+// NOTE(Alexander): a packed Tile_Layer, the offsets are from the start of the file
+struct Level_File_Tile_Layer {
+    u32 tiles_offset; // NOTE(Alexander): element_size*tile_map_width*tile_map_height bytes
+    u32 flips_offset; // NOTE(Alexander): u8[tile_map_width*tile_map_height], 0 if nothing is flipped
+    u32 element_size;
+    u32 max_gid;
+};
+
+// NOTE(Alexander): maps the whole file copy-on-write, so the level can be edited in memory
+// (e.g. set_tile) without touching the file. The web build has no real mapping and
+// reads the file into memory instead.
+bool
+map_file(Mapped_File* file, cstring filename) {
+    file->data = 0;
+    file->size = 0;
+    
+#if defined(_WIN32)
+    void* handle = CreateFileA(filename, WIN32_GENERIC_READ, WIN32_FILE_SHARE_READ, 0,
+                               WIN32_OPEN_EXISTING, WIN32_FILE_ATTRIBUTE_NORMAL, 0);
+    if (handle == WIN32_INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    
+    long long size = 0;
+    if (GetFileSizeEx(handle, &size) && size > 0) {
+        // NOTE(Alexander): the view keeps the mapping alive, both handles can be closed right away
+        void* mapping = CreateFileMappingA(handle, 0, WIN32_PAGE_WRITECOPY, 0, 0, 0);
+        if (mapping) {
+            file->data = (u8*) MapViewOfFile(mapping, WIN32_FILE_MAP_COPY, 0, 0, 0);
+            file->size = file->data ? (umm) size : 0;
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(handle);
+    
+#elif FILE_MAPPING_POSIX
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* data = mmap(0, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            file->data = (u8*) data;
+            file->size = (umm) info.st_size;
+        }
+    }
+    close(fd);
+    
+#else
+    FILE* handle = fopen(filename, "rb");
+    if (!handle) {
+        return false;
+    }
+    
+    fseek(handle, 0, SEEK_END);
+    long size = ftell(handle);
+    fseek(handle, 0, SEEK_SET);
+    if (size > 0) {
+        file->data = (u8*) malloc(size);
+        file->size = fread(file->data, 1, size, handle);
+    }
+    fclose(handle);
+#endif
+    
+    return file->data != 0;
+}
+
+void
+unmap_file(Mapped_File* file) {
+    if (!file->data) return;
+    
+#if defined(_WIN32)
+    UnmapViewOfFile(file->data);
+#elif FILE_MAPPING_POSIX
+    munmap(file->data, file->size);
+#else
+    free(file->data);
+#endif
+    file->data = 0;
+    file->size = 0;
+}
+
+inline bool
+is_level_section_valid(Level_File_Header* header, u32 offset, s64 count, umm element_size) {
+    return (offset % LEVEL_FILE_ALIGNMENT == 0 && count >= 0 &&
+            offset + count*element_size <= header->file_size);
+}
+
+// NOTE(Alexander): the returned tmx points into the mapping, so it is only valid until
+// the file is unmapped. is_loaded is false if the file is missing, corrupt or outdated.
+Loaded_Tmx
+load_cooked_level(Mapped_File* file, cstring filename) {
+    Loaded_Tmx result = {};
+    if (!map_file(file, filename)) {
+        return result;
+    }
+    
+    Level_File_Header* header = (Level_File_Header*) file->data;
+    bool valid = (file->size >= sizeof(Level_File_Header) &&
+                  header->magic == LEVEL_FILE_MAGIC &&
+                  header->version == LEVEL_FILE_VERSION &&
+                  header->file_size == file->size &&
+                  header->entity_size == sizeof(Entity_Spawn) &&
+                  header->collider_size == sizeof(Collider) &&
+                  header->tile_map_width > 0 && header->tile_map_height > 0 &&
+                  header->tile_layer_count >= 0 && header->tile_layer_count <= MAX_TILE_LAYERS);
+    
+    s64 tile_count = (s64) header->tile_map_width*header->tile_map_height;
+    valid = valid && is_level_section_valid(header, header->tile_layers_offset,
+                                            header->tile_layer_count, sizeof(Level_File_Tile_Layer));
+    for (s32 i = 0; valid && i < header->tile_layer_count; i++) {
+        Level_File_Tile_Layer* layer = (Level_File_Tile_Layer*) (file->data + header->tile_layers_offset) + i;
+        valid = ((layer->element_size == 1 || layer->element_size == 2 || layer->element_size == 4) &&
+                 is_level_section_valid(header, layer->tiles_offset, tile_count, layer->element_size) &&
+                 (layer->flips_offset == 0 ||
+                  is_level_section_valid(header, layer->flips_offset, tile_count, sizeof(u8))));
+    }
+    valid = valid && is_level_section_valid(header, header->entities_offset,
+                                            header->entity_count, sizeof(Entity_Spawn));
+    valid = valid && is_level_section_valid(header, header->colliders_offset,
+                                            header->collider_count, sizeof(Collider));
+    if (!valid) {
+        pln("Cooked level is corrupt or outdated, re-run the cooker: %s", filename);
+        unmap_file(file);
+        return result;
+    }
+    
+    Level_File_Tile_Layer* layers = (Level_File_Tile_Layer*) (file->data + header->tile_layers_offset);
+    for (s32 i = 0; i < header->tile_layer_count; i++) {
+        Tile_Layer* layer = &result.layers[i];
+        layer->tiles = file->data + layers[i].tiles_offset;
+        layer->flips = layers[i].flips_offset ? file->data + layers[i].flips_offset : 0;
+        layer->element_size = layers[i].element_size;
+        layer->max_gid = layers[i].max_gid;
+    }
+    result.layer_count = header->tile_layer_count;
+    result.tile_map_width = header->tile_map_width;
+    result.tile_map_height = header->tile_map_height;
+    result.tile_map_count = header->tile_map_width*header->tile_map_height;
+    result.tile_width = header->tile_width;
+    result.tile_height = header->tile_height;
+    result.entities = (Entity_Spawn*) (file->data + header->entities_offset);
+    result.entity_count = header->entity_count;
+    result.colliders = (Collider*) (file->data + header->colliders_offset);
+    result.collider_count = header->collider_count;
+    result.is_loaded = true;
+    return result;
+}
+
+// NOTE(Alexander): catches forgetting to re-run the cooker after editing the level in Tiled
+bool
+is_cooked_level_stale(cstring cooked_filename, cstring source_filename) {
+    struct stat cooked_info;
+    struct stat source_info;
+    if (stat(cooked_filename, &cooked_info) != 0 || stat(source_filename, &source_info) != 0) {
+        return false;
+    }
+    return source_info.st_mtime > cooked_info.st_mtime;
+}
+
+bool
+write_cooked_level(cstring filename, Loaded_Tmx* tmx) {
+    Level_File_Header header = {};
+    header.magic = LEVEL_FILE_MAGIC;
+    header.version = LEVEL_FILE_VERSION;
+    header.entity_size = sizeof(Entity_Spawn);
+    header.collider_size = sizeof(Collider);
+    header.tile_map_width = tmx->tile_map_width;
+    header.tile_map_height = tmx->tile_map_height;
+    header.tile_width = tmx->tile_width;
+    header.tile_height = tmx->tile_height;
+    header.tile_layer_count = tmx->layer_count;
+    header.entity_count = tmx->entity_count;
+    header.collider_count = tmx->collider_count;
+    
+    umm tile_count = (umm) tmx->tile_map_width*tmx->tile_map_height;
+    umm entities_size = tmx->entity_count*sizeof(Entity_Spawn);
+    umm colliders_size = tmx->collider_count*sizeof(Collider);
+    
+    umm offset = align_forward(sizeof(Level_File_Header), LEVEL_FILE_ALIGNMENT);
+    header.tile_layers_offset = (u32) offset;
+    offset = align_forward(offset + tmx->layer_count*sizeof(Level_File_Tile_Layer), LEVEL_FILE_ALIGNMENT);
+    
+    Level_File_Tile_Layer layers[MAX_TILE_LAYERS] = {};
+    for (s32 i = 0; i < tmx->layer_count; i++) {
+        Tile_Layer* layer = &tmx->layers[i];
+        layers[i].element_size = layer->element_size;
+        layers[i].max_gid = layer->max_gid;
+        layers[i].tiles_offset = (u32) offset;
+        offset = align_forward(offset + tile_count*layer->element_size, LEVEL_FILE_ALIGNMENT);
+        if (layer->flips) {
+            layers[i].flips_offset = (u32) offset;
+            offset = align_forward(offset + tile_count, LEVEL_FILE_ALIGNMENT);
+        }
+    }
+    
+    header.entities_offset = (u32) offset;
+    offset = align_forward(offset + entities_size, LEVEL_FILE_ALIGNMENT);
+    header.colliders_offset = (u32) offset;
+    header.file_size = (u32) (offset + colliders_size);
+    
+    // NOTE(Alexander): calloc so the padding between sections is zeroed
+    u8* contents = (u8*) calloc(1, header.file_size);
+    memcpy(contents, &header, sizeof(header));
+    memcpy(contents + header.tile_layers_offset, layers, tmx->layer_count*sizeof(Level_File_Tile_Layer));
+    for (s32 i = 0; i < tmx->layer_count; i++) {
+        Tile_Layer* layer = &tmx->layers[i];
+        memcpy(contents + layers[i].tiles_offset, layer->tiles, tile_count*layer->element_size);
+        if (layer->flips) {
+            memcpy(contents + layers[i].flips_offset, layer->flips, tile_count);
+        }
+    }
+    memcpy(contents + header.entities_offset, tmx->entities, entities_size);
+    memcpy(contents + header.colliders_offset, tmx->colliders, colliders_size);
+    
+    bool result = false;
+    FILE* file = fopen(filename, "wb");
+    if (file) {
+        result = fwrite(contents, 1, header.file_size, file) == header.file_size;
+        fclose(file);
+    }
+    free(contents);
+    
+    if (!result) {
+        pln("Failed to write cooked level: %s", filename);
+    }
+    return result;
+}
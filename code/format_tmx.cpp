@@ -2,29 +2,67 @@
 // NOTE(Alexander): hardcoded and may be invalidated whenever tilesets is changed
 const s32 player_gid = 36;
 
-struct Box {
+struct Collider {
     v2 min_p;
     v2 max_p;
 };
 
+// NOTE(Alexander): tolerance for bodies resting exactly on a tile edge
+#define TILE_EPSILON 0.001f
+
+// NOTE(Alexander): the tiles the collider covers (max is exclusive), edges within TILE_EPSILON
+// of a tile boundary don't reach into the next tile.
+inline void
+get_collider_tiles(Collider* collider, s32* min_x, s32* min_y, s32* max_x, s32* max_y) {
+    *min_x = (s32) floorf(collider->min_p.x + TILE_EPSILON);
+    *min_y = (s32) floorf(collider->min_p.y + TILE_EPSILON);
+    *max_x = (s32) ceilf(collider->max_p.x - TILE_EPSILON);
+    *max_y = (s32) ceilf(collider->max_p.y - TILE_EPSILON);
+}
+
+// NOTE(Alexander): entity placed in the level, turned into a real entity by init_level
+struct Entity_Spawn {
+    Entity_Type type;
+    v2 p;
+    v2 size;
+};
+
 struct Loaded_Tmx {
-    Entity* entities;
-    //Collider* colliders;
+    Entity_Spawn* entities;
+    Collider* colliders;
     
-    u8* tile_map;
-    s32 tile_map_count;
+    Tile_Layer layers[MAX_TILE_LAYERS];
+    s32 layer_count;
+    s32 tile_map_count; // NOTE(Alexander): tiles per layer
     s32 tile_map_width;
     s32 tile_map_height;
     s32 tile_width;
     s32 tile_height;
     
-    s32 entity_count;
+    // NOTE(Alexander): tile of the Tiled map that ended up at (0, 0), only infinite maps have
+    // chunks at negative coordinates. Objects are moved along with the tiles.
+    s32 tile_origin_x;
+    s32 tile_origin_y;
     
-    //s32 collider_count;
+    s32 entity_count;
+    s32 collider_count;
     
     s32 is_loaded;
 };
 
+enum Tmx_Encoding {
+    Tmx_Encoding_Csv,
+    Tmx_Encoding_Base64,
+    Tmx_Encoding_Xml, // NOTE(Alexander): deprecated <tile gid=""/> per tile, not supported
+};
+
+enum Tmx_Compression {
+    Tmx_Compression_None,
+    Tmx_Compression_Zlib,
+    Tmx_Compression_Gzip,
+    Tmx_Compression_Zstd, // NOTE(Alexander): not supported, there is no zstd decoder
+};
+
 struct Read_File_Result {
     void* contents;
     u32 contents_size;
@@ -46,27 +84,144 @@ string_equals(string a, string b) {
 }
 
 
+// NOTE(Alexander): plain stdio so the headless build doesn't need raylib,
+// contents are null terminated since the tmx parser scans until zero.
 Read_File_Result
 read_entire_file(cstring filename) {
-    Read_File_Result result;
-    result.contents = LoadFileData(filename, &result.contents_size);
+    Read_File_Result result = {};
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        pln("Failed to open file: %s", filename);
+        return result;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    u8* contents = (u8*) malloc(size + 1);
+    result.contents_size = (u32) fread(contents, 1, size, file);
+    contents[result.contents_size] = 0;
+    result.contents = contents;
+    fclose(file);
     return result;
 }
 
+inline void
+free_file_memory(void* contents) {
+    free(contents);
+}
+
 //Loaded_Tmx read_tmx_map_data(u8* scan, Memory_Arena* arena);
-void read_tmx_tile_map(u8** scanner, Loaded_Tmx* result);
+bool read_tmx_tile_map(u8** scanner, Loaded_Tmx* result, u32* gids, Tmx_Encoding encoding, Tmx_Compression compression);
 void read_tmx_colliders(u8** scanner, Memory_Arena* arena, Loaded_Tmx* result);
 void read_tmx_entities(u8** scanner, Memory_Arena* arena, Loaded_Tmx* result);
 
+// NOTE(Alexander): moves the gids into the arena with the smallest element that fits them and
+// splits off the flips, so a layer from a small tileset costs one byte per tile.
+void
+pack_tile_layer(Tile_Layer* layer, u32* gids, s32 count, Memory_Arena* arena) {
+    u32 max_gid = 0;
+    u32 all_flips = 0;
+    for (s32 i = 0; i < count; i++) {
+        u32 gid = gids[i] & TILE_GID_MASK;
+        max_gid = gid > max_gid ? gid : max_gid;
+        all_flips |= gids[i];
+    }
+    all_flips &= ~TILE_GID_MASK;
+    
+    layer->max_gid = max_gid;
+    layer->element_size = max_gid <= 0xFF ? 1 : (max_gid <= 0xFFFF ? 2 : 4);
+    layer->tiles = push_size(arena, count*layer->element_size, layer->element_size, Arena_Tag_Tile_Layer);
+    
+    // NOTE(Alexander): the flips are above 16 bits so the narrow casts already drop them
+    if (layer->element_size == 1) {
+        u8* tiles = (u8*) layer->tiles;
+        for (s32 i = 0; i < count; i++) {
+            tiles[i] = (u8) gids[i];
+        }
+    } else if (layer->element_size == 2) {
+        u16* tiles = (u16*) layer->tiles;
+        for (s32 i = 0; i < count; i++) {
+            tiles[i] = (u16) gids[i];
+        }
+    } else {
+        u32* tiles = (u32*) layer->tiles;
+        for (s32 i = 0; i < count; i++) {
+            tiles[i] = gids[i] & TILE_GID_MASK;
+        }
+    }
+    
+    layer->flips = 0;
+    if (all_flips) {
+        layer->flips = push_array_of_structs(arena, count, u8, Arena_Tag_Tile_Layer);
+        for (s32 i = 0; i < count; i++) {
+            layer->flips[i] = (u8) (gids[i] >> 28);
+        }
+    }
+}
+
+
+// NOTE(Alexander): the size of an infinite map is only the part the editor showed, the real
+// bounds come from the chunks of all its layers.
+void
+read_tmx_chunk_bounds(u8* scan, Loaded_Tmx* result) {
+    s32 min_x = 0;
+    s32 min_y = 0;
+    s32 max_x = 0;
+    s32 max_y = 0;
+    bool found = false;
+    for (; *scan; scan++) {
+        if (!eat_string(&scan, "<chunk")) {
+            continue;
+        }
+        
+        s32 x = 0;
+        s32 y = 0;
+        s32 width = 0;
+        s32 height = 0;
+        for (; *scan; scan++) {
+            if (eat_string(&scan, ">")) {
+                break;
+            }
+            if (eat_string(&scan, " x=\"")) {
+                x = eat_integer(&scan);
+            } else if (eat_string(&scan, " y=\"")) {
+                y = eat_integer(&scan);
+            } else if (eat_string(&scan, " width=\"")) {
+                width = eat_integer(&scan);
+            } else if (eat_string(&scan, " height=\"")) {
+                height = eat_integer(&scan);
+            }
+        }
+        
+        if (!found || x < min_x) min_x = x;
+        if (!found || y < min_y) min_y = y;
+        if (!found || x + width > max_x) max_x = x + width;
+        if (!found || y + height > max_y) max_y = y + height;
+        found = true;
+    }
+    
+    if (found) {
+        result->tile_origin_x = min_x;
+        result->tile_origin_y = min_y;
+        result->tile_map_width = max_x - min_x;
+        result->tile_map_height = max_y - min_y;
+    }
+}
 
 // TODO(Alexander): we are currently storing resulting entities and colliders
 // in contiguous array, what if the arena runs out of memory, how do we handle this?
 // Either we set a hard constraint that a level can only be 10kB or if we decide to
 // stream chunks instead we have to store the entites in a more sophisticated manner.
+// Open world tiles are streamed (level_stream.cpp), but the whole map still goes
+// through here once in the cooker.
 
+// NOTE(Alexander): streamed levels skip the tile layers, they are loaded chunk by chunk instead
 Loaded_Tmx
-read_tmx_map_data(u8* scan, Memory_Arena* arena) {
+read_tmx_map_data(u8* scan, Memory_Arena* arena, bool skip_tile_layers=false) {
     Loaded_Tmx result = {};
+    bool infinite = false;
     
     // NOTE(Alexander): first loads general information about the map
     for (; *scan; scan++) {
@@ -83,6 +238,8 @@ read_tmx_map_data(u8* scan, Memory_Arena* arena) {
                     result.tile_width = eat_integer(&scan);
                 } else if (eat_string(&scan, " tileheight=\"")) {
                     result.tile_height = eat_integer(&scan);
+                } else if (eat_string(&scan, " infinite=\"")) {
+                    infinite = eat_integer(&scan) != 0;
                 }
             }
             
@@ -90,6 +247,10 @@ read_tmx_map_data(u8* scan, Memory_Arena* arena) {
         }
     }
     
+    if (infinite) {
+        read_tmx_chunk_bounds(scan, &result);
+    }
+    
     if (result.tile_map_width == 0 || result.tile_map_height == 0 || 
         result.tile_width == 0 || result.tile_height == 0) {
         pln("Tiled map is corrupt");// TODO(Alexander): logging system
@@ -97,21 +258,68 @@ read_tmx_map_data(u8* scan, Memory_Arena* arena) {
     }
     
     int tile_count = result.tile_map_width * result.tile_map_height;
-    result.tile_map = push_array_of_structs(arena, tile_count, u8);
     result.tile_map_count = tile_count;
-    //result.tile_map_count = tile_count;
     
-    //result.tile_map.data = (Tile*) push_size(arena, tile_count*sizeof(Tile));
+    // NOTE(Alexander): each layer is parsed into full u32 gids first and packed into the arena
+    // once we know its largest gid, the gid buffer is reused for every layer.
+    Temporary_Memory temp = begin_temp(get_scratch_arena());
+    u32* gids = 0;
+    if (!skip_tile_layers) {
+        gids = push_array_of_structs(temp.arena, tile_count, u32, Arena_Tag_Tile_Layer);
+    }
     
     // NOTE(Alexander): Load all the layers
     for (; *scan; scan++) {
         if (eat_string(&scan, "<layer")) {
+            if (skip_tile_layers) {
+                continue;
+            }
+            if (result.layer_count == MAX_TILE_LAYERS) {
+                pln("Tiled map has more than %d tile layers, the rest are skipped", MAX_TILE_LAYERS);
+                continue;
+            }
+            
             for (; *scan; scan++) {
                 if (eat_string(&scan, "</layer>")) {
                     break;
                 }
-                if (eat_string(&scan, "<data encoding=\"csv\">")) {
-                    read_tmx_tile_map(&scan, &result);
+                if (eat_string(&scan, "<data")) {
+                    Tmx_Encoding encoding = Tmx_Encoding_Xml;
+                    Tmx_Compression compression = Tmx_Compression_None;
+                    for (; *scan; scan++) {
+                        if (eat_string(&scan, ">")) {
+                            break;
+                        }
+                        // NOTE(Alexander): eat_until eats the closing quote and the loop
+                        // steps past it again, so step back to the quote after reading a value
+                        if (eat_string(&scan, "encoding=\"")) {
+                            string value = eat_until(&scan, '"');
+                            scan--;
+                            if (string_equals(value, string_lit("csv"))) {
+                                encoding = Tmx_Encoding_Csv;
+                            } else if (string_equals(value, string_lit("base64"))) {
+                                encoding = Tmx_Encoding_Base64;
+                            }
+                        } else if (eat_string(&scan, "compression=\"")) {
+                            string value = eat_until(&scan, '"');
+                            scan--;
+                            if (string_equals(value, string_lit("zlib"))) {
+                                compression = Tmx_Compression_Zlib;
+                            } else if (string_equals(value, string_lit("gzip"))) {
+                                compression = Tmx_Compression_Gzip;
+                            } else if (string_equals(value, string_lit("zstd"))) {
+                                compression = Tmx_Compression_Zstd;
+                            }
+                        }
+                    }
+                    
+                    memset(gids, 0, tile_count*sizeof(u32));
+                    if (!read_tmx_tile_map(&scan, &result, gids, encoding, compression)) {
+                        pln("Tiled map has a tile layer we can't read");
+                        end_temp(temp);
+                        return result;
+                    }
+                    pack_tile_layer(&result.layers[result.layer_count++], gids, tile_count, arena);
                 }
             }
         }
@@ -135,54 +343,275 @@ read_tmx_map_data(u8* scan, Memory_Arena* arena) {
         }
     }
     
+    end_temp(temp);
+    
+    v2 origin = vec2((f32) result.tile_origin_x, (f32) result.tile_origin_y);
+    for (int i = 0; i < result.collider_count; i++) {
+        result.colliders[i].min_p -= origin;
+        result.colliders[i].max_p -= origin;
+    }
+    for (int i = 0; i < result.entity_count; i++) {
+        result.entities[i].p -= origin;
+    }
+    
     result.is_loaded = true;
     return result;
 }
 
 Loaded_Tmx
 read_tmx_map_data(string filename,
-                  Memory_Arena* arena) {
+                  Memory_Arena* arena,
+                  bool skip_tile_layers=false) {
     
     
-    cstring cfilename = string_to_cstring(filename);
-    Read_File_Result file = read_entire_file(cfilename);
-    cstring_free(cfilename);
+    Temporary_Memory temp = begin_temp(get_scratch_arena());
+    Read_File_Result file = read_entire_file(string_to_cstring(filename));
+    end_temp(temp);
     
     
-    Loaded_Tmx result = read_tmx_map_data((u8*) file.contents, arena);
-    //free_file_memory(file.contents);
+    Loaded_Tmx result = {};
+    if (file.contents) {
+        result = read_tmx_map_data((u8*) file.contents, arena, skip_tile_layers);
+        free_file_memory(file.contents);
+    }
     return result;
 }
 
+// NOTE(Alexander): where the next tile goes, chunks of infinite maps are written row by row
+// into their own rectangle of the tile map.
+struct Tmx_Tile_Cursor {
+    u32* gids;
+    s32 index;
+    s32 column;
+    s32 chunk_width; // NOTE(Alexander): 0 outside of chunks
+    s32 chunk_height;
+    
+    u32 value; // NOTE(Alexander): the number being parsed, may continue in the next block
+    bool has_value;
+};
+
+inline void
+put_tmx_tile(Loaded_Tmx* result, Tmx_Tile_Cursor* cursor) {
+    assert(cursor->index < result->tile_map_count && "number of tiles exceeds its limit");
+    cursor->gids[cursor->index++] = cursor->value;
+    cursor->value = 0;
+    cursor->has_value = false;
+    
+    if (cursor->chunk_width > 0 && ++cursor->column == cursor->chunk_width) {
+        cursor->index += result->tile_map_width - cursor->chunk_width;
+        cursor->column = 0;
+    }
+}
+
+#define TMX_CSV_BLOCK_PADDING 4
+
+const u32 tmx_powers_of_ten[] = { 1, 10, 100, 1000, 10000 };
+
+// NOTE(Alexander): digit_values are the digits of the block minus '0' after TMX_CSV_BLOCK_PADDING
+// zero bytes, so up to four digits ending anywhere in the block can be loaded as one u32 and
+// combined with a couple of multiplies. Longer runs (only from huge gids) go digit by digit.
+inline void
+read_tmx_csv_digits(Tmx_Tile_Cursor* cursor, u8* digit_values, u32 digit_mask) {
+    if (!digit_mask) return;
+    
+    u32 first = find_first_set_bit(digit_mask);
+    u32 last = find_last_set_bit(digit_mask);
+    u32 count = last - first + 1;
+    bool contiguous = (digit_mask >> first) == (1u << count) - 1;
+    
+    if (count <= 4 && contiguous) {
+        u32 digits;
+        memcpy(&digits, digit_values + TMX_CSV_BLOCK_PADDING + last + 1 - 4, sizeof(u32));
+        
+        // NOTE(Alexander): little endian so the first digit is the lowest byte, the bytes
+        // before it are dropped then pairs of digits and finally the two halves are folded
+        digits &= 0xFFFFFFFF << (8*(4 - count));
+        digits = (digits & 0x00FF00FF)*10 + ((digits >> 8) & 0x00FF00FF);
+        u32 number = (digits & 0xFFFF)*100 + (digits >> 16);
+        cursor->value = cursor->value*tmx_powers_of_ten[count] + number;
+    } else {
+        while (digit_mask) {
+            u32 index = find_first_set_bit(digit_mask);
+            digit_mask &= digit_mask - 1;
+            cursor->value = cursor->value*10 + digit_values[TMX_CSV_BLOCK_PADDING + index];
+        }
+    }
+    cursor->has_value = true;
+}
+
+// NOTE(Alexander): parses 16 bytes of csv at once, the compares find all digits and commas
+// in the block and the digits are converted together, so only those bytes are visited
+// and whitespace is skipped for free.
+inline void
+read_tmx_csv_block(Loaded_Tmx* result, Tmx_Tile_Cursor* cursor, u8* block) {
+    u8x16 bytes = u8x16_load(block);
+    u8x16 digits = bytes - '0';
+    u32 digit_mask = u8x16_less_mask(digits, 10);
+    u32 comma_mask = u8x16_equal_mask(bytes, ',');
+    
+    u8 digit_values[TMX_CSV_BLOCK_PADDING + 16] = {};
+    u8x16_store(digit_values + TMX_CSV_BLOCK_PADDING, digits);
+    
+    // NOTE(Alexander): every comma ends the digits before it, the rest carry over
+    while (comma_mask) {
+        u32 comma = find_first_set_bit(comma_mask);
+        comma_mask &= comma_mask - 1;
+        
+        u32 before = (1u << comma) - 1;
+        read_tmx_csv_digits(cursor, digit_values, digit_mask & before);
+        digit_mask &= ~before;
+        put_tmx_tile(result, cursor);
+    }
+    read_tmx_csv_digits(cursor, digit_values, digit_mask);
+}
+
+// NOTE(Alexander): 0xFF for bytes that aren't part of the alphabet, built on first use
+static u8 base64_values[256];
+
 void
-read_tmx_tile_map(u8** scanner, Loaded_Tmx* result) {
-    s32 tile_index = 0;
-    s32 chunk_width = 0;
+init_base64_values() {
+    memset(base64_values, 0xFF, sizeof(base64_values));
+    cstring alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (u8 i = 0; i < 64; i++) {
+        base64_values[(u8) alphabet[i]] = i;
+    }
+}
+
+// NOTE(Alexander): skips whitespace and stops at the padding, dest may be src since the
+// output never catches up with the input. Returns the number of bytes written.
+umm
+decode_base64(u8* dest, u8* src, u8* end) {
+    if (base64_values[0] == 0) {
+        init_base64_values();
+    }
     
-    u8* scan = *scanner;
-    for (; *scan; scan++) {
-        if (eat_string(&scan, "</data>")) {
+    u8* out = dest;
+    while (src < end) {
+        // NOTE(Alexander): whole groups of four without whitespace are the common case
+        if (end - src >= 4) {
+            u32 a = base64_values[src[0]];
+            u32 b = base64_values[src[1]];
+            u32 c = base64_values[src[2]];
+            u32 d = base64_values[src[3]];
+            if (((a | b | c | d) & 0xC0) == 0) {
+                u32 bits = (a << 18) | (b << 12) | (c << 6) | d;
+                out[0] = (u8) (bits >> 16);
+                out[1] = (u8) (bits >> 8);
+                out[2] = (u8) bits;
+                out += 3;
+                src += 4;
+                continue;
+            }
+        }
+        
+        // NOTE(Alexander): otherwise skip whitespace and decode what is left of the group
+        u32 bits = 0;
+        s32 count = 0;
+        for (; src < end && count < 4 && *src != '='; src++) {
+            u8 value = base64_values[*src];
+            if (value != 0xFF) {
+                bits = (bits << 6) | value;
+                count++;
+            }
+        }
+        
+        bits <<= 6*(4 - count);
+        for (s32 i = 0; i < count - 1; i++) {
+            *out++ = (u8) (bits >> (16 - 8*i));
+        }
+        if (count < 4) {
             break;
         }
+    }
+    return out - dest;
+}
+
+// NOTE(Alexander): base64 data is little endian u32 gids, optionally compressed. The text is
+// decoded in place so uncompressed gids are read straight out of the file contents, compressed
+// ones are inflated into scratch memory.
+bool
+read_tmx_base64_tiles(Loaded_Tmx* result, Tmx_Tile_Cursor* cursor, u8* data, u8* end,
+                      Tmx_Compression compression) {
+    umm size = decode_base64(data, data, end);
+    if (size == 0) {
+        // NOTE(Alexander): whitespace between chunks
+        return true;
+    }
+    
+    s32 tile_count = result->tile_map_count;
+    if (cursor->chunk_width > 0) {
+        tile_count = cursor->chunk_width*cursor->chunk_height;
+    }
+    umm gids_size = tile_count*sizeof(u32);
+    
+    Temporary_Memory temp = begin_temp(get_scratch_arena());
+    u8* gids = data;
+    if (compression != Tmx_Compression_None) {
+        gids = (u8*) push_size(temp.arena, gids_size, DEFAULT_ALIGNMENT, Arena_Tag_Tile_Layer);
+        smm decompressed_size = -1;
+        if (compression == Tmx_Compression_Zlib) {
+            decompressed_size = decompress_zlib(gids, gids_size, data, size);
+        } else if (compression == Tmx_Compression_Gzip) {
+            decompressed_size = decompress_gzip(gids, gids_size, data, size);
+        } else {
+            pln("zstd compressed tile layers aren't supported, save the map with zlib instead");
+        }
+        size = decompressed_size >= 0 ? (umm) decompressed_size : 0;
+    }
+    
+    bool ok = size == gids_size;
+    if (ok) {
+        for (s32 i = 0; i < tile_count; i++) {
+            memcpy(&cursor->value, gids + i*sizeof(u32), sizeof(u32));
+            put_tmx_tile(result, cursor);
+        }
+    }
+    
+    end_temp(temp);
+    return ok;
+}
+
+bool
+read_tmx_tile_map(u8** scanner, Loaded_Tmx* result, u32* gids, Tmx_Encoding encoding, Tmx_Compression compression) {
+    if (encoding == Tmx_Encoding_Xml) {
+        return false;
+    }
+    
+    Tmx_Tile_Cursor cursor = {};
+    cursor.gids = gids;
+    bool ok = true;
+    
+    u8* scan = *scanner;
+    for (;;) {
+        // NOTE(Alexander): data runs until the next tag, strchr is already vectorized
+        u8* end = (u8*) strchr((char*) scan, '<');
+        if (!end) {
+            end = scan + strlen((char*) scan);
+        }
         
-        if (*scan == ',') {
-            scan++;
-            tile_index++;
-            
-            assert(tile_index < result->tile_map_count && "number of tiles exceeds its limit");
-            
-            if (chunk_width > 0) {
-                if ((tile_index % chunk_width) == 0) {
-                    tile_index += result->tile_map_width - chunk_width;
-                }
+        if (encoding == Tmx_Encoding_Base64) {
+            ok = ok && read_tmx_base64_tiles(result, &cursor, scan, end, compression);
+            scan = end;
+        } else {
+            for (; end - scan >= 16; scan += 16) {
+                read_tmx_csv_block(result, &cursor, scan);
+            }
+            if (scan < end) {
+                // NOTE(Alexander): zero padding is neither a digit nor a comma
+                u8 tail[16] = {};
+                memcpy(tail, scan, end - scan);
+                read_tmx_csv_block(result, &cursor, tail);
+                scan = end;
             }
             
-            result->tile_map[tile_index] = 0;
+            // NOTE(Alexander): the last tile of a layer or chunk has no comma after it
+            if (cursor.has_value) {
+                put_tmx_tile(result, &cursor);
+            }
         }
         
-        if (*scan == ' ' || *scan == '\n' || *scan == '\t' || *scan == '\r' || 
-            eat_string(&scan, "</chunk>")) {
-            continue;
+        if (!*scan || eat_string(&scan, "</data>")) {
+            break;
         }
         
         if (eat_string(&scan, "<chunk")) {
@@ -190,8 +619,16 @@ read_tmx_tile_map(u8** scanner, Loaded_Tmx* result) {
             int chunk_y = 0;
             for (; *scan; scan++) {
                 if (eat_string(&scan, ">")) {
-                    assert(chunk_x >= 0 && chunk_y >= 0 && "chunks needs to first be normalized");
-                    tile_index = chunk_y*result->tile_map_width + chunk_x;
+                    chunk_x -= result->tile_origin_x;
+                    chunk_y -= result->tile_origin_y;
+                    if (chunk_x < 0 || chunk_y < 0 ||
+                        chunk_x + cursor.chunk_width > result->tile_map_width ||
+                        chunk_y + cursor.chunk_height > result->tile_map_height) {
+                        pln("Tiled map has a chunk outside of the map, is the map infinite?");
+                        return false;
+                    }
+                    cursor.index = chunk_y*result->tile_map_width + chunk_x;
+                    cursor.column = 0;
                     break;
                 }
                 if (eat_string(&scan, " x=\"")) {
@@ -199,22 +636,20 @@ read_tmx_tile_map(u8** scanner, Loaded_Tmx* result) {
                 } else if (eat_string(&scan, " y=\"")) {
                     chunk_y = eat_integer(&scan);
                 } else if (eat_string(&scan, " width=\"")) {
-                    chunk_width = eat_integer(&scan);
+                    cursor.chunk_width = eat_integer(&scan);
+                } else if (eat_string(&scan, " height=\"")) {
+                    cursor.chunk_height = eat_integer(&scan);
                 }
             }
-            
-            result->tile_map[tile_index] = 0;
-            //pln("parsed chunk: x=%, y=%, width=%, tile_index = %", chunk_x, chunk_y, chunk_width, tile_index);
-            continue;
-        }
-        
-        int number = (int) (*scan - '0');
-        if (number >= 0 && number <= 9) {
-            u8 data = result->tile_map[tile_index];
-            result->tile_map[tile_index] = (u8) (data*10 + number);
-            //pln("number: %, tile: % = %", number, tile_index, (int) result->tile_map[tile_index]);
+            //pln("parsed chunk: x=%, y=%, width=%, tile_index = %", chunk_x, chunk_y, cursor.chunk_width, cursor.index);
+        } else if (!eat_string(&scan, "</chunk>")) {
+            scan++;
         }
     }
+    
+    // NOTE(Alexander): points at the last byte we read, the caller steps past it
+    *scanner = scan - 1;
+    return ok;
 }
 
 
@@ -226,31 +661,35 @@ read_tmx_colliders(u8** scanner, Memory_Arena* arena, Loaded_Tmx* result) {
         }
         
         if (eat_string(&scan, "<object")) {
-            Entity* collider = push_struct(arena, Entity);
-            collider->type = Box_Collider;
-            result->entity_count++;
+            // NOTE(Alexander): colliders are only rectangles in tile units, they get
+            // rasterized into the solid tile map when the level is initialized.
+            Collider* collider = push_struct(arena, Collider, Arena_Tag_Collider);
+            *collider = {};
+            result->collider_count++;
             
-            if (!result->entities) {
-                result->entities = collider;
+            if (!result->colliders) {
+                result->colliders = collider;
             }
             
+            v2 size = {};
             for (; *scan; scan++) {
                 if (eat_string(&scan, "/>") || eat_string(&scan, "</object>")) {
+                    collider->max_p = collider->min_p + size;
                     break;
                 }
                 
                 if (eat_string(&scan, " x=\"")) {
                     f32 x = (f32) eat_integer(&scan);
-                    collider->p.x = x/(f32) result->tile_width;
+                    collider->min_p.x = x/(f32) result->tile_width;
                 } else if (eat_string(&scan, " y=\"")) {
                     f32 y = (f32) eat_integer(&scan);
-                    collider->p.y = y/(f32) result->tile_height;
+                    collider->min_p.y = y/(f32) result->tile_height;
                 } else if (eat_string(&scan, " width=\"")) {
                     f32 width  = (f32) eat_integer(&scan);
-                    collider->size.width = width/(f32) result->tile_width;
+                    size.width = width/(f32) result->tile_width;
                 } else if (eat_string(&scan, " height=\"")) {
                     f32 height = (f32) eat_integer(&scan);
-                    collider->size.height = height/(f32) result->tile_height;
+                    size.height = height/(f32) result->tile_height;
                 }
                 
 #if 0 
@@ -278,7 +717,7 @@ read_tmx_colliders(u8** scanner, Memory_Arena* arena, Loaded_Tmx* result) {
                         collider->line.r = p1 - p0;
                         p0 = p1;
                         
-                        collider = push_struct(arena, Collider);
+                        collider = push_struct(arena, Collider, Arena_Tag_Collider);
                         result->collider_count++;
                         
                         if (*scan == '"') {
@@ -305,8 +744,9 @@ read_tmx_entities(u8** scanner, Memory_Arena* arena, Loaded_Tmx* result) {
         }
         
         if (eat_string(&scan, "<object")) {
-            Entity* entity = push_struct(arena, Entity);
+            Entity_Spawn* entity = push_struct(arena, Entity_Spawn, Arena_Tag_Entity_Spawn);
             result->entity_count++;
+            *entity = {};
             
             if (!result->entities) {
                 result->entities = entity;
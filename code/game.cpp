@@ -1,389 +1,739 @@
-#define TILE_SIZE 16
-
 #include "game.h"
 #include "format_tmx.cpp"
+#include "format_level.cpp"
+#include "level_stream.cpp"
+#include "simulate.cpp"
+#include "atlas.cpp"
+#include "render.cpp"
+
+// NOTE(Alexander): rlgl.h isn't shipped with our raylib build, these are the few
+// functions (raylib 4.0 rlgl API) we need to push vertices straight into the render batch.
+#define RL_QUADS 0x0007
+
+extern "C" {
+    RLAPI void rlBegin(int mode);
+    RLAPI void rlEnd(void);
+    RLAPI void rlVertex2f(float x, float y);
+    RLAPI void rlTexCoord2f(float x, float y);
+    RLAPI void rlColor4ub(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+    RLAPI void rlSetTexture(unsigned int id);
+    RLAPI bool rlCheckRenderBatchLimit(int vCount);
+}
 
-#define BACKGROUND_COLOR rgb(52, 28, 39)
+// NOTE(Alexander): quads submitted between batch limit checks, must stay below the
+// default rlgl batch size (8192 quads) or rlgl drops vertices instead of flushing.
+#define PARTICLE_BATCH_QUAD_COUNT 2048
 
-#define min(a, b) ((a) < (b) ? (a) : (b))
-#define max(a, b) ((a) > (b) ? (a) : (b))
-#define sign(value) ((value) < 0 ? -1 : ((value) > 0 ? 1 : 0 ))
+inline s32
+round_f32_to_s32(f32 value) {
+    return (s32) round(value);
+}
+
+inline v2
+world_to_screen_space(v2 world_p, v2s camera_p, f32 scale) {
+    v2 result;
+    result.x = (f32) (round_f32_to_s32(world_p.x * scale) - camera_p.x);
+    result.y = (f32) (round_f32_to_s32(world_p.y * scale) - camera_p.y);
+    return result;
+}
 
-bool
-box_collision(Entity* rigidbody, Entity* other, v2* step_velocity, bool resolve) {
-    bool found = false;
+// NOTE(Alexander): src is relative to the sprite, for wrapping sprites it may reach outside
+// of the sprite (e.g. animation frames past the end or doors taller than the texture)
+// and the sprite is repeated, vertical repeats are drawn as separate pieces.
+void
+draw_sprite(Sprite* sprite, Rectangle src, Rectangle dest, f32 rotation, Color tint) {
+    Vector2 origin = {};
+    Rectangle rect = sprite->rect;
+    
+    if (!sprite->wrap) {
+        src.x += rect.x;
+        src.y += rect.y;
+        DrawTexturePro(sprite->texture, src, dest, origin, rotation, tint);
+        return;
+    }
+    
+    // NOTE(Alexander): negative sizes flip the sprite, the covered region is the same
+    f32 src_x = fmodf(src.x, rect.width);
+    if (src_x < 0.0f) src_x += rect.width;
+    f32 src_y = fmodf(src.y, rect.height);
+    if (src_y < 0.0f) src_y += rect.height;
     
-    v2 step_position = rigidbody->p + *step_velocity;
-    if (step_position.y + rigidbody->size.y > other->p.y && 
-        step_position.y < other->p.y + other->size.y) {
+    f32 remaining = fabsf(src.height);
+    f32 scale_y = remaining > 0.0f ? dest.height/remaining : 0.0f;
+    while (remaining > 0.0f) {
+        f32 piece = min(remaining, rect.height - src_y);
         
-        if (step_velocity->x < 0.0f && rigidbody->p.x >= other->p.x + other->size.x) {
-            f32 x_overlap = other->p.x + other->size.x - step_position.x;
-            if (x_overlap > 0.0f) {
-                if (resolve) {
-                    step_velocity->x = other->p.x + other->size.x - rigidbody->p.x;
-                    rigidbody->velocity.x = 0.0f;
-                }
-                found = true;
-            }
-        } else if (step_velocity->x > 0.0f && rigidbody->p.x + rigidbody->size.x <= other->p.x) {
-            f32 x_overlap = step_position.x - other->p.x + rigidbody->size.x;
-            if (x_overlap > 0.0f) {
-                if (resolve) {
-                    step_velocity->x = other->p.x - rigidbody->size.x - rigidbody->p.x;
-                    rigidbody->velocity.x = 0.0f;
-                }
-                found = true;
-            }
-        }
+        Rectangle piece_src = { rect.x + src_x, rect.y + src_y, src.width, src.height < 0.0f ? -piece : piece };
+        Rectangle piece_dest = { dest.x, dest.y, dest.width, piece*scale_y };
+        DrawTexturePro(sprite->texture, piece_src, piece_dest, origin, rotation, tint);
+        
+        dest.y += piece*scale_y;
+        remaining -= piece;
+        src_y = 0.0f;
     }
-    
-    if (rigidbody->p.x + rigidbody->size.x > other->p.x && 
-        rigidbody->p.x < other->p.x + other->size.x) {
-        if (step_velocity->y < 0.0f && rigidbody->p.y < other->p.y + other->size.y &&
-            rigidbody->p.y + rigidbody->size.y > other->p.y) {
-            f32 y_overlap = step_position.y - other->p.y + other->size.y;
-            if (y_overlap > 0.0f) {
-                if (resolve) {
-                    step_velocity->y = other->p.y + other->size.y - rigidbody->p.y;
-                    rigidbody->velocity.y = 0.0f;
-                }
-                found = true;
-            }
-        } else if (step_velocity->y > 0.0f && rigidbody->p.y + rigidbody->size.y <= other->p.y) {
-            f32 y_overlap = step_position.y - other->p.y + rigidbody->size.y;
-            if (y_overlap > 0.0f) {
-                if (resolve) {
-                    step_velocity->y = other->p.y - rigidbody->size.y - rigidbody->p.y;
-                    rigidbody->velocity.y = 0.0f;
-                    rigidbody->is_grounded = true;
+}
+
+struct Tile_Bake_Job {
+    Game_State* state;
+    Tile_Layer* layer;
+    int layer_width;
+    int layer_height;
+    int texture_tiles; // NOTE(Alexander): tiles along each side of the target texture
+    Tile_Chunk_Quads* chunks;
+};
+
+void
+build_tile_chunk_quads(void* data, s32 begin, s32 end) {
+    Tile_Bake_Job* job = (Tile_Bake_Job*) data;
+    Game_State* state = job->state;
+    Tile_Layer* layer = job->layer;
+    
+    Sprite* tiles = &state->sprite_tiles;
+    f32 tile_size = state->meters_to_pixels;
+    int tile_xcount = (int) (tiles->rect.width/tile_size);
+    
+    for (s32 chunk_index = begin; chunk_index < end; chunk_index++) {
+        Tile_Chunk_Quads* quads = &job->chunks[chunk_index];
+        quads->count = 0;
+        
+        int min_x = quads->chunk_x*TILE_CHUNK_SIZE;
+        int min_y = quads->chunk_y*TILE_CHUNK_SIZE;
+        int max_x = min(min_x + TILE_CHUNK_SIZE, job->layer_width);
+        int max_y = min(min_y + TILE_CHUNK_SIZE, job->layer_height);
+        for (int y = min_y; y < max_y; y++) {
+            for (int x = min_x; x < max_x; x++) {
+                s32 index = y*job->layer_width + x;
+                u32 tile = get_tile(layer, index);
+                if (tile == 0) continue;
+                tile--;
+                
+                Rectangle src = { 0, 0, tile_size, tile_size };
+                src.x = tiles->rect.x + (tile % tile_xcount) * tile_size;
+                src.y = tiles->rect.y + (tile / tile_xcount) * tile_size;
+                
+                // NOTE(Alexander): the destination is the center of the tile so it can be rotated
+                Rectangle dest = { 0, 0, tile_size, tile_size };
+                dest.x = (x % job->texture_tiles + 0.5f) * tile_size;
+                dest.y = (y % job->texture_tiles + 0.5f) * tile_size;
+                
+                // NOTE(Alexander): Tiled flips diagonally first, then horizontally and vertically.
+                // Flipping the source vertically and rotating it 90 degrees clockwise is the
+                // diagonal flip, the other two flips swap axes when they come after it.
+                u32 flips = get_tile_flips(layer, index);
+                bool flip_x = (flips & TILE_FLIPPED_HORIZONTALLY) != 0;
+                bool flip_y = (flips & TILE_FLIPPED_VERTICALLY) != 0;
+                f32 rotation = 0.0f;
+                if (flips & TILE_FLIPPED_DIAGONALLY) {
+                    bool diagonal_flip_x = flip_y;
+                    flip_y = !flip_x;
+                    flip_x = diagonal_flip_x;
+                    rotation = 90.0f;
                 }
-                found = true;
+                if (flip_x) src.width = -src.width;
+                if (flip_y) src.height = -src.height;
+                
+                quads->src[quads->count] = src;
+                quads->dest[quads->count] = dest;
+                quads->rotation[quads->count] = rotation;
+                quads->count++;
             }
         }
     }
-    
-    return found;
 }
 
-
-bool
-ray_box_collision(Ray ray, f32 min_dist, f32 max_dist, BoundingBox box) {
-    RayCollision result = GetRayCollisionBox(ray, box);
-    if (result.hit) {
-        //pln("dist = %", result.distance);
-        return result.distance >= min_dist && result.distance <= max_dist;
+// NOTE(Alexander): layers are baked one after the other on top of each other, only the first
+// one clears the chunk.
+void
+bake_tile_chunk(Game_State* state, RenderTexture2D target, Tile_Chunk_Quads* quads, bool clear) {
+    BeginTextureMode(target);
+    if (clear) {
+        ClearBackground(BLANK);
     }
     
-    return false;
+    Texture2D texture = state->sprite_tiles.texture;
+    f32 half_tile_size = 0.5f*state->meters_to_pixels;
+    Vector2 origin = { half_tile_size, half_tile_size };
+    for (int i = 0; i < quads->count; i++) {
+        DrawTexturePro(texture, quads->src[i], quads->dest[i], origin, quads->rotation[i], WHITE);
+    }
+    
+    EndTextureMode();
 }
 
+#define STREAMED_CHUNK_QUADS_COUNT ((LEVEL_STREAM_CHUNK_SIZE/TILE_CHUNK_SIZE)*(LEVEL_STREAM_CHUNK_SIZE/TILE_CHUNK_SIZE))
 
-Entity*
-spawn_entity(Game_State* state, Memory_Arena* arena, Entity_Type type) {
-    Entity* entity = push_struct(arena, Entity);
-    state->entity_count++;
-    *entity = {};
-    entity->type = type;
+// NOTE(Alexander): has to run outside of any other BeginTextureMode, recreates the chunk
+// textures when a level with a different size is loaded and re-bakes the dirty chunks.
+// Streamed chunks are baked from the uploads in the snapshot instead.
+void
+update_tile_layer_cache(Game_State* state, Render_Snapshot* snapshot) {
+    Tile_Layer_Cache* cache = &state->tile_cache;
+    if (cache->width != snapshot->tile_chunk_width || cache->height != snapshot->tile_chunk_height) {
+        for (int i = 0; i < cache->width*cache->height; i++) {
+            UnloadRenderTexture(cache->chunks[i]);
+        }
+        free(cache->chunks);
+        free(cache->bake_quads);
+        
+        cache->width = snapshot->tile_chunk_width;
+        cache->height = snapshot->tile_chunk_height;
+        
+        int chunk_pixels = (int) (TILE_CHUNK_SIZE*state->meters_to_pixels);
+        cache->chunks = (RenderTexture2D*) malloc(cache->width*cache->height*sizeof(RenderTexture2D));
+        cache->bake_quads = (Tile_Chunk_Quads*) malloc(cache->width*cache->height*sizeof(Tile_Chunk_Quads));
+        for (int i = 0; i < cache->width*cache->height; i++) {
+            cache->chunks[i] = LoadRenderTexture(chunk_pixels, chunk_pixels);
+            SetTextureFilter(cache->chunks[i].texture, TEXTURE_FILTER_POINT);
+            snapshot->tile_chunk_dirty[i] = 1;
+        }
+    }
     
-    if (!state->entities) {
-        state->entities =  entity;
+    int dirty_count = 0;
+    for (int chunk_y = 0; chunk_y < cache->height; chunk_y++) {
+        for (int chunk_x = 0; chunk_x < cache->width; chunk_x++) {
+            int chunk_index = chunk_y*cache->width + chunk_x;
+            if (snapshot->tile_chunk_dirty[chunk_index]) {
+                Tile_Chunk_Quads* quads = &cache->bake_quads[dirty_count++];
+                quads->chunk_x = chunk_x;
+                quads->chunk_y = chunk_y;
+                snapshot->tile_chunk_dirty[chunk_index] = 0;
+            }
+        }
+    }
+    
+    // NOTE(Alexander): the quads only have room for one layer per chunk, so the layers are
+    // built and baked one at a time. Chunks without any layer still have to be cleared.
+    int layer_count = max(snapshot->tile_layer_count, 1);
+    for (int layer_index = 0; layer_index < layer_count; layer_index++) {
+        Tile_Bake_Job job;
+        job.state = state;
+        job.layer = &snapshot->tile_layers[layer_index];
+        job.layer_width = snapshot->tile_map_width;
+        job.layer_height = snapshot->tile_map_height;
+        job.texture_tiles = TILE_CHUNK_SIZE;
+        job.chunks = cache->bake_quads;
+        if (layer_index < snapshot->tile_layer_count) {
+            parallel_for(state->jobs, dirty_count, 1, build_tile_chunk_quads, &job);
+        } else {
+            for (int i = 0; i < dirty_count; i++) {
+                cache->bake_quads[i].count = 0;
+            }
+        }
+        
+        for (int i = 0; i < dirty_count; i++) {
+            Tile_Chunk_Quads* quads = &cache->bake_quads[i];
+            RenderTexture2D target = cache->chunks[quads->chunk_y*cache->width + quads->chunk_x];
+            bake_tile_chunk(state, target, quads, layer_index == 0);
+        }
+    }
+    
+    if (snapshot->streamed_upload_count > 0 && !cache->streamed_chunks) {
+        cache->streamed_chunks = (RenderTexture2D*) calloc(LEVEL_STREAM_CACHE_SIZE, sizeof(RenderTexture2D));
+        cache->streamed_bake_quads = (Tile_Chunk_Quads*) malloc(STREAMED_CHUNK_QUADS_COUNT*sizeof(Tile_Chunk_Quads));
+    }
+    
+    // NOTE(Alexander): a streamed chunk is baked as TILE_CHUNK_SIZE pieces into its slot's texture,
+    // the same texture is reused by whatever chunk gets loaded into the slot next.
+    int pieces = LEVEL_STREAM_CHUNK_SIZE/TILE_CHUNK_SIZE;
+    for (int upload_index = 0; upload_index < snapshot->streamed_upload_count; upload_index++) {
+        Streamed_Chunk_Upload* upload = &snapshot->streamed_uploads[upload_index];
+        RenderTexture2D* target = &cache->streamed_chunks[upload->slot];
+        if (!target->id) {
+            int chunk_pixels = (int) (LEVEL_STREAM_CHUNK_SIZE*state->meters_to_pixels);
+            *target = LoadRenderTexture(chunk_pixels, chunk_pixels);
+            SetTextureFilter(target->texture, TEXTURE_FILTER_POINT);
+        }
+        
+        for (int i = 0; i < STREAMED_CHUNK_QUADS_COUNT; i++) {
+            cache->streamed_bake_quads[i].chunk_x = i % pieces;
+            cache->streamed_bake_quads[i].chunk_y = i / pieces;
+        }
+        
+        int upload_layer_count = max(upload->layer_count, 1);
+        for (int layer_index = 0; layer_index < upload_layer_count; layer_index++) {
+            Tile_Bake_Job job;
+            job.state = state;
+            job.layer = &upload->layers[layer_index];
+            job.layer_width = LEVEL_STREAM_CHUNK_SIZE;
+            job.layer_height = LEVEL_STREAM_CHUNK_SIZE;
+            job.texture_tiles = LEVEL_STREAM_CHUNK_SIZE;
+            job.chunks = cache->streamed_bake_quads;
+            if (layer_index < upload->layer_count) {
+                parallel_for(state->jobs, STREAMED_CHUNK_QUADS_COUNT, 1, build_tile_chunk_quads, &job);
+            } else {
+                for (int i = 0; i < STREAMED_CHUNK_QUADS_COUNT; i++) {
+                    cache->streamed_bake_quads[i].count = 0;
+                }
+            }
+            
+            for (int i = 0; i < STREAMED_CHUNK_QUADS_COUNT; i++) {
+                bake_tile_chunk(state, *target, &cache->streamed_bake_quads[i], layer_index == 0 && i == 0);
+            }
+        }
     }
-    return entity;
 }
 
+inline void
+push_particle_quad(v2 p0, v2 p1, v2 p2, v2 p3, v2 uv_min, v2 uv_max, Color color) {
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    rlTexCoord2f(uv_min.x, uv_min.y);
+    rlVertex2f(p0.x, p0.y);
+    rlTexCoord2f(uv_min.x, uv_max.y);
+    rlVertex2f(p1.x, p1.y);
+    rlTexCoord2f(uv_max.x, uv_max.y);
+    rlVertex2f(p2.x, p2.y);
+    rlTexCoord2f(uv_max.x, uv_min.y);
+    rlVertex2f(p3.x, p3.y);
+}
 
+inline void
+get_sprite_uv(Sprite* sprite, v2* uv_min, v2* uv_max) {
+    v2 texture_size = vec2((f32) sprite->texture.width, (f32) sprite->texture.height);
+    uv_min->x = sprite->rect.x/texture_size.x;
+    uv_min->y = sprite->rect.y/texture_size.y;
+    uv_max->x = (sprite->rect.x + sprite->rect.width)/texture_size.x;
+    uv_max->y = (sprite->rect.y + sprite->rect.height)/texture_size.y;
+}
 
-Entity*
-init_level(Game_State* state, Memory_Arena* arena) {
-    clear(arena);
+// NOTE(Alexander): all particles of a system go into the same rlgl batch with one texture
+// and one blend mode, so they are flushed as a single draw call (one per
+// PARTICLE_BATCH_QUAD_COUNT particles) instead of one DrawCircle/DrawLine each.
+void
+draw_fire_particles(Game_State* state, Render_Command_Buffer* buffer, Render_Particles* particles) {
+    Sprite* sprite = &state->sprite_particle;
+    rlSetTexture(sprite->texture.id);
     
-    state->entity_count = 0;
+    v2 uv_min, uv_max;
+    get_sprite_uv(sprite, &uv_min, &uv_max);
     
+    f32* p_x = buffer->particle_data + particles->data_offset;
+    f32* p_y = p_x + particles->count;
+    f32* lifetime = p_y + particles->count;
     
-#if BUILD_DEBUG
-    PlayMusicStream(state->music);
-    state->mode = Control_Boss_Enemy;
-#else
-    state->mode = Intro_Cutscene;
-    state->cutscene_time = 0.0f;
-#endif
-    
-    Loaded_Tmx tmx = read_tmx_map_data(string_lit("assets/interior.tmx"), arena);
-    state->entities = tmx.entities;
-    state->entity_count = tmx.entity_count;
-    state->tile_map = tmx.tile_map;
-    state->tile_map_width = tmx.tile_map_width;
-    state->tile_map_height = tmx.tile_map_height;
-    
-    for (int i = 0; i < array_count(state->bullets); i++) {
-        Entity* bullet = spawn_entity(state, arena, Bullet);
-        state->bullets[i] = bullet;
-        bullet->texture = &state->texture_bullet;
-        bullet->max_speed.x = 3.0f;
-        bullet->size = { 0.5f, 0.5f };
-        bullet->is_rigidbody = true;
+    for (int begin = 0; begin < particles->count; begin += PARTICLE_BATCH_QUAD_COUNT) {
+        int end = min(begin + PARTICLE_BATCH_QUAD_COUNT, particles->count);
+        rlCheckRenderBatchLimit((end - begin)*4);
+        
+        rlBegin(RL_QUADS);
+        for (int j = begin; j < end; j++) {
+            f32 t = lifetime[j];
+            v2 p = vec2(p_x[j], p_y[j]);
+            f32 radius = (1.0f - t*t)*10.0f;
+            
+            Color color = ORANGE;
+            color.r = (u8) (color.r*t);
+            color.g = (u8) (color.g*t);
+            color.b = (u8) (50*t);
+            color.a = (u8) (t*t*t*255.0f);
+            
+            v2 min_p = p - vec2(radius, radius);
+            v2 max_p = p + vec2(radius, radius);
+            push_particle_quad(min_p, vec2(min_p.x, max_p.y), max_p, vec2(max_p.x, min_p.y),
+                               uv_min, uv_max, color);
+        }
+        rlEnd();
     }
     
-    Entity* bullet = spawn_entity(state, arena, Charged_Bullet);
-    state->charged_bullet = bullet;
-    bullet->texture = &state->texture_charged_bullet;
-    bullet->max_speed.x = 3.0f;
-    bullet->size = { 0.75f, 0.75f };
-    bullet->is_rigidbody = true;
-    
-    
-    Entity* left_door = spawn_entity(state, arena, Door);
-    state->left_door = left_door;
-    left_door->texture = &state->texture_door;
-    left_door->health = 1;
-    left_door->p = { 0.0f, 10.0f };
-    left_door->size = { 1.0f, 0.0f };
-    left_door->is_rigidbody = false;
+    rlSetTexture(0);
+}
+
+// NOTE(Alexander): charging particles are streaks from the emitter, drawn as one pixel
+// wide quads sampling the solid center of the particle sprite.
+void
+draw_charging_particles(Game_State* state, Render_Command_Buffer* buffer, Render_Particles* particles) {
+    Sprite* sprite = &state->sprite_particle;
+    rlSetTexture(sprite->texture.id);
     
-    Entity* right_door = spawn_entity(state, arena, Door);
-    state->right_door = right_door;
-    right_door->texture = &state->texture_door;
-    right_door->health = 1;
-    right_door->p = { 21.0f, 10.0f };
-    right_door->size = { 1.0f, 0.0f };
-    right_door->is_rigidbody = false;
+    v2 uv_min, uv_max;
+    get_sprite_uv(sprite, &uv_min, &uv_max);
     
+    f32* p_x = buffer->particle_data + particles->data_offset;
+    f32* p_y = p_x + particles->count;
+    f32* lifetime = p_y + particles->count;
     
-    Entity* player = spawn_entity(state, arena, Player);
-    state->player = player;
-    player->texture = &state->texture_player;
-#if BUILD_DEBUG
-    player->p = {16.0f, 12.0f};
-#else 
-    player->p = {24.0f, 12.0f};
-#endif
-    player->size = {1.0f, 2.0f};
-    player->max_speed.x = 3.0f;
-    player->is_rigidbody = true;
-    player->facing_dir = 1.0f;
-    player->color = SKYBLUE;
-    player->max_health = 1000;
-    player->health = player->max_health;
+    v2 cp = particles->start_p;
+    v2 uv = (uv_min + uv_max)*0.5f;
+    Color color = YELLOW;
+    color.a = 25;
     
-    Entity* boss_enemy = spawn_entity(state, arena, Boss_Dragon);
-    state->boss_enemy = boss_enemy;
-    boss_enemy->flip_texture = true;
-    boss_enemy->texture = &state->texture_dragon;
-    boss_enemy->num_frames = 8;
-    boss_enemy->idle_frame = 8;
-    boss_enemy->frame_advance_rate = 2.5f;
-#if BUILD_DEBUG
-    boss_enemy->p = {3.0f, 10.0f};
-#else 
-    boss_enemy->p = {-7.0f, 10.0f};
-#endif
-    boss_enemy->size = {4.0f, 4.0f};
-    boss_enemy->max_speed.x = 2.5f;
-    boss_enemy->is_rigidbody = true;
-    boss_enemy->color = RED;
-    boss_enemy->max_health = 1000;
-    boss_enemy->health = boss_enemy->max_health;
+    for (int begin = 0; begin < particles->count; begin += PARTICLE_BATCH_QUAD_COUNT) {
+        int end = min(begin + PARTICLE_BATCH_QUAD_COUNT, particles->count);
+        rlCheckRenderBatchLimit((end - begin)*4);
+        
+        rlBegin(RL_QUADS);
+        for (int j = begin; j < end; j++) {
+            f32 t = lifetime[j];
+            v2 p1 = vec2(p_x[j], p_y[j]);
+            v2 p0 = cp + (p1 - cp)*(1.0f - t);
+            
+            v2 dir = p1 - p0;
+            f32 length = sqrtf(dir.x*dir.x + dir.y*dir.y);
+            if (length < 0.001f) continue;
+            v2 n = vec2(-dir.y, dir.x)*(0.5f/length);
+            
+            push_particle_quad(p0 + n, p0 - n, p1 - n, p1 + n, uv, uv, color);
+        }
+        rlEnd();
+    }
     
-    return player;
+    rlSetTexture(0);
 }
 
-inline s32
-round_f32_to_s32(f32 value) {
-    return (s32) round(value);
+#if ARENA_STATS
+// NOTE(Alexander): debug overlay (F3) with the same numbers as print_arena_stats, returns the y below it
+int
+draw_arena_stats(cstring name, Arena_Stats* stats, int x, int y) {
+    int font_size = 10;
+    int line_height = font_size + 2;
+    DrawText(TextFormat("%s: %.1f KB used (peak %.1f KB), %.1f KB in blocks (peak %.1f KB, %d blocks)", name,
+                        stats->used/1024.0, stats->peak_used/1024.0, stats->size/1024.0,
+                        stats->peak_size/1024.0, stats->peak_block_count), x, y, font_size, WHITE);
+    y += line_height;
+    DrawText(TextFormat("  %d overflows wasting %.1f KB, %.1f KB of alignment padding", stats->overflow_count,
+                        stats->overflow_waste/1024.0, stats->alignment_waste/1024.0), x, y, font_size, WHITE);
+    y += line_height;
+    for (int i = 0; i < Arena_Tag_Count; i++) {
+        if (stats->tag_push_count[i] > 0) {
+            DrawText(TextFormat("  %s %.1f KB in %d pushes", arena_tag_names[i],
+                                stats->tag_used[i]/1024.0, stats->tag_push_count[i]), x, y, font_size, WHITE);
+            y += line_height;
+        }
+    }
+    return y;
 }
+#endif
 
-v2
-to_pixel(Game_State* state, v2 world_p) {
-    v2 result;
-    result.x = roundf((world_p.x - state->camera_p.x) * state->meters_to_pixels);
-    result.y = roundf((world_p.y - state->camera_p.y) * state->meters_to_pixels);
-    return result;
+// NOTE(Alexander): draws the sorted commands, the blend mode is only changed when it differs
+// from the previous command and raylib keeps batching as long as the texture stays the same.
+void
+submit_render_commands(Game_State* state, Render_Command_Buffer* buffer) {
+    BlendMode blend = BLEND_ALPHA;
+    BeginBlendMode(blend);
+    
+    for (int i = 0; i < buffer->count; i++) {
+        Render_Sort_Entry* entry = &buffer->sorted[i];
+        Render_Command* command = &buffer->commands[entry->index];
+        
+        BlendMode command_blend = (BlendMode) ((entry->key >> 8) & 0xFF);
+        if (command_blend != blend) {
+            blend = command_blend;
+            BeginBlendMode(blend);
+        }
+        
+        switch (command->type) {
+            case Render_Command_Sprite: {
+                Render_Sprite* sprite = &command->sprite;
+                draw_sprite(sprite->sprite, sprite->src, sprite->dest, sprite->rotation, sprite->tint);
+            } break;
+            
+            case Render_Command_Tile_Chunk: {
+                Tile_Layer_Cache* cache = &state->tile_cache;
+                Render_Tile_Chunk* tile_chunk = &command->tile_chunk;
+                Vector2 p = { tile_chunk->p.x, tile_chunk->p.y };
+                if (tile_chunk->is_streamed) {
+                    // NOTE(Alexander): the chunk was uploaded in this snapshot or an earlier one
+                    f32 chunk_pixels = LEVEL_STREAM_CHUNK_SIZE*state->meters_to_pixels;
+                    Rectangle src = { 0.0f, 0.0f, chunk_pixels, -chunk_pixels };
+                    DrawTextureRec(cache->streamed_chunks[tile_chunk->chunk_index].texture, src, p, WHITE);
+                } else if (tile_chunk->chunk_index < cache->width*cache->height) {
+                    // NOTE(Alexander): render textures are stored upside down
+                    f32 chunk_pixels = TILE_CHUNK_SIZE*state->meters_to_pixels;
+                    Rectangle src = { 0.0f, 0.0f, chunk_pixels, -chunk_pixels };
+                    DrawTextureRec(cache->chunks[tile_chunk->chunk_index].texture, src, p, WHITE);
+                }
+            } break;
+            
+            case Render_Command_Rect: {
+                DrawRectangleRec(command->rect.rect, command->rect.color);
+            } break;
+            
+            case Render_Command_Circle: {
+                Render_Circle* circle = &command->circle;
+                DrawCircle((int) circle->center.x, (int) circle->center.y, circle->radius, circle->color);
+            } break;
+            
+            case Render_Command_Line: {
+                Render_Line* line = &command->line;
+                DrawLine((int) line->p0.x, (int) line->p0.y, (int) line->p1.x, (int) line->p1.y, line->color);
+            } break;
+            
+            case Render_Command_Text: {
+                Render_Text* text = &command->text;
+                Vector2 p = { text->p.x, text->p.y };
+                if (text->centered) {
+                    Vector2 size = MeasureTextEx(state->font, text->text, text->font_size, 0.0f);
+                    p.x -= size.x/2.0f;
+                    p.y -= size.y/2.0f;
+                }
+                DrawTextEx(state->font, text->text, p, text->font_size, 0.0f, text->color);
+            } break;
+            
+            case Render_Command_Particles: {
+                Render_Particles* particles = &command->particles;
+                if (particles->style == Particle_Style_Fire) {
+                    draw_fire_particles(state, buffer, particles);
+                } else {
+                    draw_charging_particles(state, buffer, particles);
+                }
+            } break;
+        }
+    }
+    
+    if (blend != BLEND_ALPHA) {
+        BeginBlendMode(BLEND_ALPHA);
+    }
 }
 
-inline v2
-world_to_screen_space(v2 world_p, v2s camera_p, f32 scale) {
-    v2 result;
-    result.x = (f32) (round_f32_to_s32(world_p.x * scale) - camera_p.x);
-    result.y = (f32) (round_f32_to_s32(world_p.y * scale) - camera_p.y);
-    return result;
-}
+// NOTE(Alexander): what the main thread hands over to the simulation every frame
+struct Frame_Input {
+    Input_Snapshot input;
+    f32 delta_time;
+    bool restart_level;
+    bool toggle_mode;
+};
 
-Color
-rgb(u8 r, u8 g, u8 b, u8 a=255) {
-    Color result;
-    result.r = r;
-    result.g = g;
-    result.b = b;
-    result.a = a;
-    return result;
-}
+// NOTE(Alexander): two stage pipeline, while the main thread draws snapshots[render_index]
+// the simulation thread advances the game and fills the other snapshot, so what is on
+// screen is one frame behind the input. Game_State belongs to the simulation thread, the
+// main thread only touches the parts that never change after startup (sprites, font,
+// sounds) and the tile cache. Without threads (web build) the frame is simulated inline.
+struct Frame_Pipeline {
+    Game_State* state;
+    
+    Frame_Input pending; // NOTE(Alexander): filled by the main thread
+    Frame_Input frame; // NOTE(Alexander): copy the simulation is working on
+    Input_Snapshot input; // NOTE(Alexander): keeps presses until a tick has consumed them
+    
+    Render_Snapshot snapshots[2];
+    int render_index;
+    
+#if HAS_THREADS
+    Thread thread;
+    Semaphore frame_ready;
+    Semaphore frame_done;
+    bool quit;
+#endif
+};
 
 void
-draw_level_bounds(Game_State* state) {
-    
-    // Level bounds
-    v2 size = vec2((f32) state->tile_map_width*TILE_SIZE + 1.0f, (f32) state->tile_map_width*TILE_SIZE);
-    
-    v2 cp;
-    cp.x = -state->camera_p.x * state->meters_to_pixels;
-    cp.y = -state->camera_p.y * state->meters_to_pixels;
-    v2 min_cursor_p = cp;//world_to_screen_space(vec2(0.0f, 0.0f), cp, state->meters_to_pixels);
-    v2 max_cursor_p = min_cursor_p + size + vec2(0.0f, 1.0f);
-    
-    Color background = BACKGROUND_COLOR;
-    
-    if (min_cursor_p.x > 0.0f) {
-        int w = (int) min_cursor_p.x;
-        DrawRectangle(0, 0, w, state->game_height, background);
+copy_tile_layer(Game_State* state, Render_Snapshot* snapshot) {
+    bool resized = false;
+    if (snapshot->tile_chunk_width != state->tile_chunk_width ||
+        snapshot->tile_chunk_height != state->tile_chunk_height) {
+        snapshot->tile_chunk_width = state->tile_chunk_width;
+        snapshot->tile_chunk_height = state->tile_chunk_height;
+        snapshot->tile_chunk_dirty = (u8*) realloc(snapshot->tile_chunk_dirty,
+                                                   state->tile_chunk_width*state->tile_chunk_height);
+        resized = true;
     }
     
-    if (max_cursor_p.x < size.y) {
-        DrawRectangle((int) max_cursor_p.x, 0, state->game_width - (int) max_cursor_p.x, state->game_height, background);
+    snapshot->any_tile_chunk_dirty = false;
+    for (int i = 0; i < state->tile_chunk_width*state->tile_chunk_height; i++) {
+        snapshot->tile_chunk_dirty[i] = state->tile_chunk_dirty[i];
+        snapshot->any_tile_chunk_dirty |= state->tile_chunk_dirty[i] != 0;
+        state->tile_chunk_dirty[i] = 0;
     }
     
-    if (min_cursor_p.y > 0.0f) {
-        DrawRectangle(0, 0, state->game_width, (int) min_cursor_p.y, background);
+    if (resized || snapshot->any_tile_chunk_dirty) {
+        snapshot->tile_map_width = state->tile_map_width;
+        snapshot->tile_map_height = state->tile_map_height;
+        
+        // NOTE(Alexander): realloc keeps the buffer as long as the layer size stays the same
+        s32 tile_count = state->tile_map_width*state->tile_map_height;
+        for (int i = 0; i < state->tile_layer_count; i++) {
+            Tile_Layer* src = &state->tile_layers[i];
+            Tile_Layer* dest = &snapshot->tile_layers[i];
+            dest->element_size = src->element_size;
+            dest->max_gid = src->max_gid;
+            dest->tiles = realloc(dest->tiles, tile_count*src->element_size);
+            memcpy(dest->tiles, src->tiles, tile_count*src->element_size);
+            
+            if (src->flips) {
+                dest->flips = (u8*) realloc(dest->flips, tile_count);
+                memcpy(dest->flips, src->flips, tile_count);
+            } else {
+                free(dest->flips);
+                dest->flips = 0;
+            }
+        }
+        snapshot->tile_layer_count = state->tile_layer_count;
     }
     
-    if (max_cursor_p.y < size.y) {
-        DrawRectangle(0, (int) max_cursor_p.y, 
-                      state->game_width, state->game_height - (int) max_cursor_p.y, background);
+    // NOTE(Alexander): has to run after build_render_commands, the chunks it drew were resident
+    // then and still are now, so they are either uploaded here or already were before
+    snapshot->streamed_upload_count = 0;
+    Level_Streamer* streamer = &state->level_streamer;
+    if (streamer->header) {
+        umm record_size = streamer->header->max_record_size;
+        if (snapshot->streamed_upload_record_size != record_size) {
+            snapshot->streamed_upload_data = (u8*) realloc(snapshot->streamed_upload_data, LEVEL_STREAM_CACHE_SIZE*record_size);
+            snapshot->streamed_upload_record_size = record_size;
+        }
+        if (!snapshot->streamed_uploads) {
+            snapshot->streamed_uploads = (Streamed_Chunk_Upload*) malloc(LEVEL_STREAM_CACHE_SIZE*sizeof(Streamed_Chunk_Upload));
+        }
         
+        for (int slot = 0; slot < LEVEL_STREAM_CACHE_SIZE; slot++) {
+            Streamed_Chunk* chunk = &streamer->chunks[slot];
+            if (chunk->is_uploaded || atomic_load_s32(&chunk->state) != Streamed_Chunk_Resident) {
+                continue;
+            }
+            
+            u8* data = snapshot->streamed_upload_data + slot*record_size;
+            memcpy(data, chunk->data, chunk->data_size);
+            
+            Streamed_Chunk_Upload* upload = &snapshot->streamed_uploads[snapshot->streamed_upload_count++];
+            upload->slot = slot;
+            upload->layer_count = chunk->layer_count;
+            for (int i = 0; i < chunk->layer_count; i++) {
+                Tile_Layer* layer = &upload->layers[i];
+                *layer = chunk->layers[i];
+                layer->tiles = data + ((u8*) layer->tiles - chunk->data);
+                if (layer->flips) {
+                    layer->flips = data + (layer->flips - chunk->data);
+                }
+            }
+            chunk->is_uploaded = true;
+        }
     }
 }
 
+// NOTE(Alexander): runs on the simulation thread
 void
-draw_health_bar(Game_State* game_state, Entity* entity, Color color, bool right=true) {
-    f32 width = (f32) (game_state->game_width/2-8);
-    width *= (f32) entity->health / entity->max_health;
-    s32 xoffset = 0;
-    s32 xoffset_inner = 0;
-    if (right) {
-        xoffset = game_state->game_width/2 - 7;
-    } else {
-        xoffset_inner = game_state->game_width/2 - 8 - (int) width;
-    }
-    DrawRectangle(7 + xoffset, 7, game_state->game_width/2-6, 6, BLACK);
-    DrawRectangle(8 + xoffset + xoffset_inner, 8, (int) width, 4, color);
-}
-
-Particle_System*
-init_particle_system(int max_particle_count) {
-    Particle_System* ps = (Particle_System*) calloc(1, sizeof(Particle_System));
-    ps->particles = (Particle*) malloc(max_particle_count * sizeof(Particle));
-    ps->max_particle_count = max_particle_count;
-    return ps;
-}
-
-void
-update_particle_system(Particle_System* ps, bool spawn_new) {
-    // Remove dead particles
-    for (int i = 0; i < ps->particle_count; i++) {
-        Particle* p = &ps->particles[i];
-        if (p->t <= 0.0f) {
-            if (ps->particle_count > 0) {
-                Particle* last = &ps->particles[ps->particle_count - 1];
-                *p = *last;
-                i--;
-            }
-            ps->particle_count--;
-        }
+simulate_frame(Frame_Pipeline* pipeline, Render_Snapshot* snapshot) {
+    Game_State* state = pipeline->state;
+    Frame_Input* frame = &pipeline->frame;
+    Input_Snapshot* input = &pipeline->input;
+    
+    snapshot->sound_event_count = 0;
+    snapshot->start_music = false;
+    
+    if (frame->restart_level) {
+        init_level(state, &state->level_arena);
     }
     
-    if (spawn_new) {
-        // Spawn new particles
-        for (int i = 0; i < 10; i++) {
-            if (ps->particle_count < ps->max_particle_count && random_f32() < ps->spawn_rate) {
-                Particle* p = &ps->particles[ps->particle_count];
-                ps->particle_count++;
-                p->p = ps->start_p;
-                
-                f32 a = ps->min_angle + random_f32() * (ps->max_angle - ps->min_angle);
-                p->v.x = cosf(a)*ps->speed;
-                p->v.y = sinf(a)*ps->speed;
-                
-                p->t = 1.0f;
-            }
-        }
+    if (frame->toggle_mode) {
+        state->mode = state->mode == Control_Boss_Enemy ?
+            Control_Player : Control_Boss_Enemy;
     }
     
-    // Update live particles
-    for (int i = 0; i < ps->particle_count; i++) {
-        Particle* p = &ps->particles[i];
-        p->p += p->v;
-        p->t -= ps->delta_t;
+    for (int i = 0; i < Button_Count; i++) {
+        input->down[i] = frame->input.down[i];
+        input->pressed[i] |= frame->input.pressed[i];
     }
-}
-
-bool
-check_collisions(Game_State* state, Entity* entity, v2* step_velocity) {
-    bool result = false;
-    entity->collided = false;
-    entity->collided_with = 0;
     
-    for (int j = 0; j < state->entity_count; j++) {
-        Entity* other = &state->entities[j];
-        if ((other != entity && other->is_rigidbody) || 
-            other->type == Box_Collider ||
-            other->type == Door) {
-            
-            // Some collision exceptions
-            if ((entity->type == Player && (other->type == Bullet || other->type == Charged_Bullet)) ||
-                ((entity->type == Bullet || entity->type == Charged_Bullet) &&  other->type == Player) ||
-                //(entity->type == Player && other->type == Boss_Dragon) ||
-                //(entity->type == Boss_Dragon && other->type == Player) ||
-                (entity->is_rigidbody && entity->health <= 0) ||
-                (other->is_rigidbody && other->health <= 0)) {
-                continue;
-            }
-            
-            bool collided = box_collision(entity, other, step_velocity, !other->is_rigidbody);
-            if (collided) {
-                entity->collided = true;
-                entity->collided_with = other;
-                result = true;
+    state->time_accumulator += frame->delta_time;
+    while (state->time_accumulator >= SIM_DT) {
+        simulate_tick(state, input, SIM_DT);
+        state->time_accumulator -= SIM_DT;
+        
+        for (int i = 0; i < Button_Count; i++) {
+            input->pressed[i] = false;
+        }
+        
+        if (state->start_music) {
+            snapshot->start_music = true;
+            state->start_music = false;
+        }
+        
+        for (int i = 0; i < state->sound_event_count; i++) {
+            if (snapshot->sound_event_count < MAX_SOUND_EVENTS) {
+                snapshot->sound_events[snapshot->sound_event_count++] = state->sound_events[i];
             }
         }
     }
     
-    return result;
+    // NOTE(Alexander): how far we are between the last two simulated states
+    f32 render_alpha = state->time_accumulator / SIM_DT;
+    
+    build_render_commands(state, &snapshot->commands, render_alpha, frame->delta_time);
+    snapshot->mode = state->mode;
+    snapshot->cutscene_time = state->cutscene_time;
+    copy_tile_layer(state, snapshot);
+    
+#if ARENA_STATS
+    snapshot->level_arena_stats = get_arena_stats(&state->level_arena);
+    snapshot->scratch_arena_stats = get_arena_stats(get_scratch_arena());
+#endif
 }
 
+#if HAS_THREADS
+void
+simulation_thread_proc(void* data) {
+    Frame_Pipeline* pipeline = (Frame_Pipeline*) data;
+    for (;;) {
+        wait_semaphore(&pipeline->frame_ready);
+        if (pipeline->quit) {
+            break;
+        }
+        
+        simulate_frame(pipeline, &pipeline->snapshots[pipeline->render_index ^ 1]);
+        signal_semaphore(&pipeline->frame_done);
+    }
+}
+#endif
 
 void
-shoot_bullet(Game_State* state, Entity* entity, Entity* bullet, bool upward) {
+init_frame_pipeline(Frame_Pipeline* pipeline, Game_State* state) {
+    pipeline->state = state;
+#if HAS_THREADS
+    init_semaphore(&pipeline->frame_ready, 0);
+    init_semaphore(&pipeline->frame_done, 1); // NOTE(Alexander): the first frame shows an empty snapshot
+    if (!create_thread(&pipeline->thread, simulation_thread_proc, pipeline)) {
+        pln("Failed to create the simulation thread");
+        assert(0 && "failed to create the simulation thread");
+    }
+#endif
+}
+
+// NOTE(Alexander): waits for the frame the simulation is working on, starts the next one
+// with the latest input and returns the finished snapshot that should be drawn now.
+Render_Snapshot*
+advance_frame_pipeline(Frame_Pipeline* pipeline) {
+#if HAS_THREADS
+    wait_semaphore(&pipeline->frame_done);
+#endif
     
-    PlaySound(state->sound_shoot_bullet);
+    pipeline->frame = pipeline->pending;
+    for (int i = 0; i < Button_Count; i++) {
+        pipeline->pending.input.pressed[i] = false;
+    }
+    pipeline->pending.restart_level = false;
+    pipeline->pending.toggle_mode = false;
     
-    bullet->health = bullet->type == Charged_Bullet ? 100 : 30;
-    bullet->p = entity->p + vec2((upward && entity->facing_dir == 1.0f) ? 1.3f : 0.0f, 0.75f);
+#if HAS_THREADS
+    pipeline->render_index ^= 1;
+    signal_semaphore(&pipeline->frame_ready);
+#else
+    simulate_frame(pipeline, &pipeline->snapshots[pipeline->render_index]);
+#endif
     
-    if (upward) {
-        bullet->sprite_rot = 90.0f;//PI_F32 / 2.0f;
-        bullet->facing_dir = 0.0f;
-    } else {
-        bullet->facing_dir = entity->facing_dir;
-        bullet->sprite_rot = 0.0f;
-    }
+    return &pipeline->snapshots[pipeline->render_index];
 }
 
-
+void
+free_frame_pipeline(Frame_Pipeline* pipeline) {
+#if HAS_THREADS
+    wait_semaphore(&pipeline->frame_done);
+    pipeline->quit = true;
+    signal_semaphore(&pipeline->frame_ready);
+    join_thread(&pipeline->thread);
+    free_semaphore(&pipeline->frame_ready);
+    free_semaphore(&pipeline->frame_done);
+#endif
+}
 
 int
 main() {
     Game_State game_state = {};
     Game_State* state = &game_state;
+    state->jobs = init_job_system(get_processor_count() - 1);
     
-    state->game_width = 22 * TILE_SIZE;
-    state->game_height = 15 * TILE_SIZE;
+    init_render_view(state);
     state->game_scale = 4;
     state->screen_width = state->game_width * state->game_scale;
     state->screen_height = state->game_height * state->game_scale;
     
-    state->meters_to_pixels = TILE_SIZE;
-    state->pixels_to_meters = 1.0f/state->meters_to_pixels;
-    
     SetConfigFlags(FLAG_WINDOW_RESIZABLE);
     
     InitWindow(state->screen_width, state->screen_height, "GMTK Game Jam 2023");
@@ -392,27 +742,29 @@ main() {
     InitAudioDevice();
     
     //cstring tiles = (cstring) "tiles.png";
-    state->texture_tiles = LoadTexture("assets/tiles.png");
-    state->texture_background = LoadTexture("assets/background.png");
-    state->texture_dragon = LoadTexture("assets/dragon.png");
-    state->texture_dragon_wings = LoadTexture("assets/dragon_wings.png");
-    state->texture_player = LoadTexture("assets/player.png");
-    state->texture_door = LoadTexture("assets/door.png");
-    state->texture_bullet = LoadTexture("assets/bullet.png");
-    state->texture_charged_bullet = LoadTexture("assets/charged_bullet.png");
-    
-    SetTextureWrap(state->texture_door, TEXTURE_WRAP_REPEAT);
-    SetTextureWrap(state->texture_dragon, TEXTURE_WRAP_REPEAT);
-    SetTextureWrap(state->texture_dragon_wings, TEXTURE_WRAP_REPEAT);
+    {
+        Atlas_Builder* atlas = (Atlas_Builder*) calloc(1, sizeof(Atlas_Builder));
+        add_atlas_image(atlas, "assets/tiles.png", &state->sprite_tiles);
+        add_atlas_image(atlas, "assets/background.png", &state->sprite_background);
+        add_atlas_image(atlas, "assets/dragon.png", &state->sprite_dragon, true);
+        add_atlas_image(atlas, "assets/dragon_wings.png", &state->sprite_dragon_wings, true);
+        add_atlas_image(atlas, "assets/player.png", &state->sprite_player);
+        add_atlas_image(atlas, "assets/door.png", &state->sprite_door, true);
+        add_atlas_image(atlas, "assets/bullet.png", &state->sprite_bullet);
+        add_atlas_image(atlas, "assets/charged_bullet.png", &state->sprite_charged_bullet);
+        add_atlas_image(atlas, GenImageGradientRadial(32, 32, 0.5f, WHITE, BLANK), &state->sprite_particle);
+        state->texture_atlas = build_atlas(atlas, 1024, state->jobs);
+        free(atlas);
+    }
     
-    state->sound_shoot_bullet = LoadSound("assets/shoot_bullet.wav");
-    state->sound_explosion = LoadSound("assets/explosion.wav");
-    state->sound_hurt = LoadSound("assets/hurt.wav");
-    state->sound_player_hurt = LoadSound("assets/player_hurt.wav");
-    state->sound_fire_breathing = LoadSound("assets/fire_breath.wav");
-    state->sound_charging = LoadSound("assets/charging.wav");
-    state->sound_lose = LoadSound("assets/lose.wav");
-    state->sound_win = LoadSound("assets/win.wav");
+    state->sounds[Sound_Shoot_Bullet] = LoadSound("assets/shoot_bullet.wav");
+    state->sounds[Sound_Explosion] = LoadSound("assets/explosion.wav");
+    state->sounds[Sound_Hurt] = LoadSound("assets/hurt.wav");
+    state->sounds[Sound_Player_Hurt] = LoadSound("assets/player_hurt.wav");
+    state->sounds[Sound_Fire_Breathing] = LoadSound("assets/fire_breath.wav");
+    state->sounds[Sound_Charging] = LoadSound("assets/charging.wav");
+    state->sounds[Sound_Lose] = LoadSound("assets/lose.wav");
+    state->sounds[Sound_Win] = LoadSound("assets/win.wav");
     
     state->music = LoadMusicStream("assets/music.mp3");
     
@@ -423,33 +775,18 @@ main() {
     SetTextureFilter(render_target.texture, TEXTURE_FILTER_POINT);
     
     
-    // Fire attack
-    state->ps_fire = init_particle_system(500);
-    state->ps_fire->start_p = vec2(5.0f, 5.0f);
-    
-    state->ps_fire->min_angle = PI_F32/4.0f + 0.3f; 
-    state->ps_fire->max_angle = PI_F32/4.0f - 0.3f;
-    
-    state->ps_fire->speed = 0.1f;
-    
-    state->ps_fire->spawn_rate = 0.6f;
-    state->ps_fire->delta_t = 0.015f;
-    
-    // Charging attack
-    state->ps_charging = init_particle_system(100);
-    state->ps_charging->start_p = vec2(5.0f, 5.0f);
+    init_simulation(state);
+    init_level(state, &state->level_arena);
     
-    state->ps_charging->min_angle = 0;
-    state->ps_charging->max_angle = PI_F32*2.0f;
-    
-    state->ps_charging->speed = 0.05f;
-    
-    state->ps_charging->spawn_rate = 0.5f;
-    state->ps_charging->delta_t = 0.04f;
+    Vector2 origin =  {};
     
+#if ARENA_STATS
+    bool show_arena_stats = false;
+#endif
     
-    Memory_Arena level_arena = {};
-    Entity* player = init_level(state, &level_arena);
+    Frame_Pipeline* pipeline = (Frame_Pipeline*) calloc(1, sizeof(Frame_Pipeline));
+    init_frame_pipeline(pipeline, state);
+    Frame_Input* frame = &pipeline->pending;
     
     while (!WindowShouldClose())
     {
@@ -464,6 +801,11 @@ main() {
         
         f32 delta_time = GetFrameTime();
         
+        // NOTE(Alexander): clamp long frames (e.g. window drag) so we don't spiral trying to catch up
+        if (delta_time > 0.25f) {
+            delta_time = 0.25f;
+        }
+        
         if (IsKeyPressed(KEY_F11)) {
             ToggleFullscreen();
         }
@@ -473,888 +815,54 @@ main() {
         
         
 #if BUILD_DEBUG
-        if (IsKeyPressed(KEY_R)) {
-            player = init_level(state, &level_arena);
-        }
-        
-        if (IsKeyPressed(KEY_M)) { 
-            state->mode = state->mode == Control_Boss_Enemy ?
-                Control_Player : Control_Boss_Enemy;
+        frame->restart_level |= IsKeyPressed(KEY_R);
+        frame->toggle_mode |= IsKeyPressed(KEY_M);
+#endif
+#if ARENA_STATS
+        if (IsKeyPressed(KEY_F3)) {
+            show_arena_stats = !show_arena_stats;
         }
 #endif
         
         // Update
+        frame->delta_time = delta_time;
+        frame->input.down[Button_Left] = IsKeyDown(KEY_A);
+        frame->input.down[Button_Right] = IsKeyDown(KEY_D);
+        frame->input.down[Button_Down] = IsKeyDown(KEY_S);
+        frame->input.down[Button_Jump] = IsKeyDown(KEY_SPACE);
+        frame->input.down[Button_Attack] = IsKeyDown(KEY_F);
+        frame->input.down[Button_Special] = IsKeyDown(KEY_E);
         
-        const f32 jump_height = 4.8f;
-        const f32 time_to_jump_apex = 3.0f * 0.3f;
-        const f32 initial_velocity = (-2.0f * jump_height) / time_to_jump_apex;
-        const f32 jump_gravity = (2.0f * jump_height) / (time_to_jump_apex * time_to_jump_apex);
-        const f32 gravity = jump_gravity*2.0f; // NOTE(Alexander): normal gravity is heavier than jumping gravity
+        // NOTE(Alexander): presses are kept until a tick has consumed them,
+        // a fast frame might not run any simulation tick at all.
+        frame->input.pressed[Button_Left] |= IsKeyPressed(KEY_A);
+        frame->input.pressed[Button_Right] |= IsKeyPressed(KEY_D);
+        frame->input.pressed[Button_Down] |= IsKeyPressed(KEY_S);
+        frame->input.pressed[Button_Jump] |= IsKeyPressed(KEY_SPACE);
+        frame->input.pressed[Button_Attack] |= IsKeyPressed(KEY_F);
+        frame->input.pressed[Button_Special] |= IsKeyPressed(KEY_E);
         
+        Render_Snapshot* snapshot = advance_frame_pipeline(pipeline);
         
-        if (state->mode == Intro_Cutscene) {
-            state->cutscene_time += delta_time;
-            
-            if (state->cutscene_time > 8.0f) {
-                PlayMusicStream(state->music);
-                state->mode = Control_Boss_Enemy;
-            }
+        if (snapshot->start_music) {
+            PlayMusicStream(state->music);
         }
         
-        Vector2 origin =  {};
-        
-        for (int i = 0; i < state->entity_count; i++) {
-            Entity* entity = &state->entities[i];
-            
-            switch (entity->type) {
-                case Player: {
-                    // Player controller
-                    entity->acceleration.y = 0.0f;
-                    entity->acceleration.x = 0.0f;
-                    
-                    if (state->mode == Intro_Cutscene) {
-                        if (cutscene_interval(0.4, 2.5f)) {
-                            entity->acceleration.x = -16;
-                            entity->facing_dir = -1.0f;
-                        } else if (cutscene_interval(3.5f, 5.5f)) {
-                            entity->facing_dir = 1.0f;
-                        } else {
-                            entity->facing_dir = -1.0f;
-                        }
-                        
-                    } else if (state->mode == Control_Player) {
-                        if (IsKeyDown(KEY_A)) {
-                            entity->acceleration.x = -16;
-                            entity->facing_dir = -1.0f;
-                        }
-                        
-                        if (IsKeyDown(KEY_D)) {
-                            entity->acceleration.x = 16;
-                            entity->facing_dir = 1.0f;
-                        }
-                        
-                        if (entity->is_jumping && (entity->velocity.y > 0.0f || !IsKeyDown(KEY_SPACE))) {
-                            entity->is_jumping = false;
-                        }
-                        
-                        if (entity->is_grounded && IsKeyPressed(KEY_SPACE)) {
-                            entity->velocity.y = initial_velocity;
-                            entity->is_jumping = true;
-                        }
-                        
-                    } else if (state->mode == Control_Boss_Enemy) {
-                        
-                        Entity* target = state->boss_enemy;
-                        
-                        v2 dist = ((entity->p + entity->size/2.0f) -
-                                   (target->p + (target->size/2.0f)));
-                        
-                        bool attack = false;
-                        bool jump = false;
-                        f32 move_x = 0.0f;
-                        
-                        f32 accuracy = 2.0f - min(fabsf(dist.x), fabsf(dist.y));
-                        f32 charge_accuracy = 4.0f - min(fabsf(dist.x), fabsf(dist.y));
-                        
-                        // Too far to hit
-                        if (max(fabsf(dist.x), fabsf(dist.y)) > 7.0f) {
-                            accuracy = -1.0f;
-                        }
-                        
-                        // no accuracy if looking the other way
-                        if (fabsf(dist.y) < 2.0f) {
-                            if ((int) entity->facing_dir == sign(dist.x)) {
-                                accuracy = -1.0f;
-                            }
-                        }
-                        
-                        //pln("%f, %f", dist.x, dist.y);
-                        
-                        
-                        bool go_to_attack = true;
-                        if (player->invincibility_frames > 0 || state->boss_enemy->is_attacking) {
-                            go_to_attack = false;
-                            
-                            if (state->boss_enemy->is_attacking && sign(dist.x) != (int) state->boss_enemy->facing_dir) {
-                                go_to_attack = true;
-                            }
-                        }
-                        
-                        // if safe distance away attack anyways
-                        if (fabsf(dist.x) > 7.0f || fabsf(dist.y) > 7.0f) {
-                            go_to_attack = true;
-                        }
-                        
-                        if (go_to_attack) {
-                            entity->is_cornered = false;
-                        }
-                        
-                        bool shoot_upwards = false;
-                        if (go_to_attack) {
-                            attack = accuracy > 0.0f;
-                            
-                            if (fabsf(dist.y) > 5.0f) {
-                                shoot_upwards = true;
-                                
-                                if (fabsf(dist.y) > 7.0f) {
-                                    jump = random_f32() <= 0.01f;
-                                }
-                                
-                                if (fabsf(dist.x) > 0.5f) {
-                                    move_x = -1.0f*sign(dist.x);
-                                }
-                            } else {
-                                if (fabsf(dist.x) > 3.0f) {
-                                    
-                                    if (fabsf(dist.y) > 2.0f) {
-                                        jump = true;
-                                    }
-                                    
-                                    if (fabsf(dist.x) > 7.0f) {
-                                        move_x = -1.0f*sign(dist.x);
-                                    }
-                                    
-                                } else {
-                                    move_x = 1.0f*sign(dist.x);
-                                }
-                            }
-                        } else {
-                            // Move away from danger
-                            // TODO: better corner handling
-                            if (entity->p.x < 3.0f || entity->p.x > 19.0f || entity->is_cornered) {
-                                // Avoid getting cornered (move to center of screen 
-                                entity->is_cornered = true;
-                                f32 escape_x = entity->p.x - 11.0f;
-                                move_x = -1.0f*sign(escape_x);
-                            } else {
-                                move_x = 1.0f*sign(dist.x);
-                            }
-                        }
-                        
-                        
-                        entity->is_attacking = false;
-                        for (int j = 0; j < array_count(entity->attack_time); j++) {
-                            if (entity->attack_time[j] > 0.0f) {
-                                entity->is_attacking = true;
-                                entity->attack_time[j] -= delta_time;
-                                
-                                if (j == 1) {
-                                    if (entity->invincibility_frames <= 0) {
-                                        if ((int) (entity->attack_time[j] * 80.0f) % 40 == 39) {
-                                            PlaySound(state->sound_charging);
-                                        }
-                                    } else {
-                                        entity->attack_time[j] = 0.0f;
-                                        continue;
-                                    }
-                                }
-                                
-                                if (j == 1 && entity->attack_time[1] <= 0.0f) {
-                                    PlaySound(state->sound_explosion);
-                                    shoot_bullet(state, entity, state->charged_bullet, fabsf(dist.y) > 3.0f);
-                                }
-                            }
-                            
-                            if (entity->attack_cooldown[j] > 0.0f) {
-                                entity->attack_cooldown[j] -= delta_time;
-                            }
-                        }
-                        
-                        for (int bi = 0; bi < array_count(state->bullets); bi++) {
-                            Entity* bullet = state->bullets[bi];
-                            if (bullet->health > 0) {
-                                bullet->health -= 1;
-                            }
-                        }
-                        
-                        
-                        bool is_charging =  entity->attack_time[1] > 0.0f;
-                        if (is_charging) {
-                            state->ps_charging->start_p = entity->p +
-                                vec2(entity->facing_dir > 0.0f ? 1.0f : 0.0f, 1.0f);
-                        }
-                        update_particle_system(state->ps_charging, is_charging);
-                        
-                        
-                        if (!entity->is_attacking) {
-                            // Initiate a new attack
-                            
-                            if (entity->invincibility_frames <= 0) {
-                                if (attack && entity->attack_cooldown[0] <= 0.0f) {
-                                    entity->attack_time[0] = 0.3f;
-                                    entity->attack_cooldown[0] = 0.5f;
-                                    entity->is_attacking = true;
-                                    
-                                    f32 far_dist = max(fabsf(dist.x), fabsf(dist.y));
-                                    
-                                    // Try use a charged bullet if there is a good chance
-                                    if (charge_accuracy > 0.25f &&
-                                        (state->boss_enemy->is_attacking || far_dist > 4.0f) &&
-                                        state->charged_bullet->health <= 0 &&
-                                        entity->is_grounded &&
-                                        entity->attack_cooldown[1] <= 0.0f) {
-                                        
-                                        entity->is_attacking = true;
-                                        entity->attack_time[1] = random_f32()*0.6f + 0.5f;
-                                        entity->attack_cooldown[0] = 2.0f;
-                                        entity->attack_cooldown[1] = 3.0f;
-                                        PlaySound(state->sound_charging);
-                                    } else {
-                                        
-                                        // Find available bullet
-                                        for (int bi = 0; bi < array_count(state->bullets); bi++) {
-                                            Entity* bullet = state->bullets[bi];
-                                            if (bullet->health <= 0) {
-                                                entity->is_attacking = true;
-                                                shoot_bullet(state, entity, bullet, shoot_upwards);
-                                                entity->attack_cooldown[0] = random_f32()*2.0f;
-                                                break;
-                                            }
-                                        }
-                                    }
-                                    
-                                } else {
-                                    // more attacks
-                                }
-                            }
-                            
-                            entity->acceleration.x = move_x*16;
-                            if (move_x != 0.0f) {
-                                entity->facing_dir = (f32) sign(move_x);
-                            } else {
-                                entity->facing_dir = (f32) -sign(dist.x);
-                            }
-                            
-                            if (entity->is_grounded && jump) {
-                                entity->velocity.y = initial_velocity;
-                                entity->is_jumping = true;
-                            }
-                        }
-                    }
-                    
-                    entity->acceleration.y = entity->is_jumping ? jump_gravity : gravity;
-                    
-                    
-#if 0
-                    if (IsKeyPressed(KEY_E)) {
-                        
-                        if (player->holding) {
-                            // Take out previous item (unless colliding with something)
-                            player->holding.p = player->p;
-                            v2 step_velocity = vec2(player->facing_dir, 0.0f);
-                            if (!check_collisions(state, player->holding, &step_velocity)) {
-                                player->holding.type = Box;
-                                &player->holding.p += step_velocity;
-                                
-                                if (!IsKeyDown(KEY_S)) {
-                                    player->holding.velocity = vec2(20.0f * player->facing_dir, -20.0f);
-                                }
-                                player->holding = 0;
-                            }
-                        } else {
-                            f32 closest = 2.0f;
-                            Entity* target = 0;
-                            
-                            for (int k = 0; k < state->entity_count; k++) {
-                                Entity* box_entity = state->entities[k];
-                                
-                                if (box_entity->type == Box) {
-                                    v2 p0 = box_entity->p + box_entity->size * 0.5f;
-                                    v2 p1 = player->p + player->size * 0.5f;
-                                    v2 diff = p0 - p1;
-                                    f32 dist = sqrt(diff.x*diff.x + diff.y*diff.y);
-                                    
-                                    if (dist < closest) {
-                                        target = box_entity;
-                                        closest = dist;
-                                    }
-                                }
-                            }
-                            
-                            if (target) {
-                                target.type = None;
-                                player->holding = target;
-                            }
-                        }
-                    }
-#endif
-                } break;
-                
-                case Door: {
-                    if (state->mode == Intro_Cutscene) {
-                        if (entity == state->right_door) {
-                            if (cutscene_interval(3.0f, 3.5f)) {
-                                entity->size.y += delta_time*8.0f;
-                            } else if (cutscene_interval(3.5f, 10.0f)) {
-                                entity->size.y = 4.0f;
-                                
-                                if (entity->health == 1) {
-                                    PlaySound(state->sound_explosion);
-                                    entity->health = 2;
-                                }
-                            }
-                        } else if (entity == state->left_door) {
-                            if (cutscene_interval(6.5f, 7.0f)) {
-                                entity->size.y += delta_time*8.0f;
-                            } else if (cutscene_interval(7.0f, 10.0f)) {
-                                entity->size.y = 4.0f;
-                                
-                                if (entity->health == 1) {
-                                    PlaySound(state->sound_explosion);
-                                    entity->health = 2;
-                                }
-                            }
-                        }
-                    } else {
-                        entity->size.y = 4.0f;
-                    }
-                } break;
-                
-                case Bullet:
-                case Charged_Bullet: {
-                    entity->velocity.x = 0.0f;
-                    entity->velocity.y = 0.0f;
-                    
-                    f32 bullet_speed = entity->type == Charged_Bullet ? 20.0f : 12.0f;
-                    if (entity->facing_dir == 0.0f) {
-                        entity->velocity.y = -bullet_speed;
-                    } else {
-                        entity->velocity.x = bullet_speed*entity->facing_dir;
-                    }
-                    if (entity->collided) {
-                        entity->health = 0;
-                        
-                        if (entity->collided_with == state->boss_enemy) {
-                            if (state->boss_enemy->invincibility_frames <= 0) {
-                                state->boss_enemy->health -= entity->type == Charged_Bullet ? 100 : 10;
-                                state->boss_enemy->invincibility_frames = 40;
-                                
-                                PlaySound(state->sound_hurt);
-                                if (entity->facing_dir == 0.0f) {
-                                    state->boss_enemy->velocity = vec2(0.0f, -3.0f);
-                                } else {
-                                    state->boss_enemy->velocity = vec2(entity->facing_dir*3.0f, 0.0f);
-                                }
-                            }
-                        }
-                    }
-                } break;
-                
-                
-                case Boss_Dragon: {
-                    f32 fly_upward_gravity = 4.25f;
-                    f32 fly_gravity = fly_upward_gravity*0.5f;
-                    entity->acceleration.x = 0.0f;
-                    entity->acceleration.y = (entity->is_jumping ? fly_upward_gravity : fly_gravity);
-                    
-                    //if (entity->is_grounded && abs(entity->acceleration.x) < epsilon32) {
-                    //entity->velocity.x *= 0.8f;
-                    //}
-                    
-                    if (entity->is_jumping && (entity->velocity.y > 0.0f || !IsKeyDown(KEY_SPACE))) {
-                        entity->is_jumping = false;
-                    }
-                    
-                    if (entity->facing_dir > 0.0f) {
-                        state->ps_fire->start_p = entity->p + vec2(entity->size.width - 0.8f, 0.8f);
-                        state->ps_fire->min_angle = PI_F32/4.0f + 0.3f; 
-                        state->ps_fire->max_angle = PI_F32/4.0f - 0.3f;
-                    } else {
-                        state->ps_fire->start_p = entity->p + vec2(0.8f, 0.8f);
-                        state->ps_fire->min_angle = -PI_F32/4.0f + PI_F32 + 0.3f; 
-                        state->ps_fire->max_angle = -PI_F32/4.0f + PI_F32 - 0.3f;
-                        
-                    }
-                    
-                    
-                    if (state->mode == Intro_Cutscene) {
-                        if (cutscene_interval(3.5f, 6.5f)) {
-                            entity->acceleration.x = 16;
-                            entity->facing_dir = 1.0f;
-                        }
-                        
-                    } else if (state->mode == Control_Boss_Enemy) {
-                        
-                        
-                        if (entity->collided) {
-                            if (entity->collided_with == state->player) {
-                                if (player->invincibility_frames <= 0) {
-                                    player->invincibility_frames = 30;
-                                    player->health -= 10;
-                                    player->velocity.x = -entity->facing_dir*2.0f;
-                                    PlaySound(state->sound_player_hurt);
-                                }
-                            }
-                        }
-                        
-                        entity->is_attacking = false;
-                        for (int j = 0; j < array_count(entity->attack_time); j++) {
-                            if (entity->attack_time[j] > 0.0f) {
-                                entity->is_attacking = true;
-                                entity->attack_time[j] -= delta_time;
-                            }
-                            
-                            if (entity->attack_cooldown[j] > 0.0f) {
-                                entity->attack_cooldown[j] -= delta_time;
-                            }
-                        }
-                        
-                        if (entity->is_attacking) {
-                            entity->velocity = vec2_zero;
-                            entity->acceleration = vec2_zero;
-                        } else {
-                            
-                            if (entity->invincibility_frames <= 0) {
-                                // Initiate a new attack
-                                if (IsKeyPressed(KEY_F) && entity->attack_cooldown[0] <= 0.0f) {
-                                    entity->attack_time[0] = 2.5f;
-                                    entity->attack_cooldown[0] = 5.0f;
-                                    entity->is_attacking = true;
-                                    PlaySound(state->sound_fire_breathing);
-                                    
-                                } else if (IsKeyPressed(KEY_E) && entity->attack_cooldown[1] <= 0.0f) {
-                                    //entity->attack_time[1] = 2.0f;
-                                    //entity->attack_cooldown[1] = 10.0f;
-                                    //entity->is_attacking = true;
-                                    
-                                }
-                            }
-                            
-                            if (IsKeyPressed(KEY_S)) { 
-                                entity->velocity.y = 1.5f;
-                            }
-                            if (IsKeyDown(KEY_S)) {
-                                entity->acceleration.y *= 2.0f;
-                            }
-                            
-                            if (IsKeyDown(KEY_A)) {
-                                entity->acceleration.x = -16;
-                                entity->facing_dir = -1.0f;
-                            }
-                            
-                            if (IsKeyPressed(KEY_SPACE)) {
-                                entity->velocity.y = -3.0f;
-                                entity->is_jumping = true;
-                            }
-                            
-                            
-                            if (IsKeyDown(KEY_D)) {
-                                entity->acceleration.x = 16;
-                                entity->facing_dir = 1.0f;
-                            }
-                        }
-                        
-                    } else {
-                        // Control the dragon using AI!
-                        
-                    }
-                    
-                    // Fire breathing attack
-                    //assert(entity->attack_time[0] == 0.0f);
-                    bool fire_breathing = entity->attack_time[0] > 0.0f;
-                    update_particle_system(state->ps_fire, entity->attack_time[0] > 0.5f);
-                    
-                    if (fire_breathing) {
-                        
-                        BoundingBox player_box;
-                        player_box.min = { player->p.x, player->p.y, 0.0f };
-                        player_box.max = { player->p.x + player->size.width, player->p.y +player->size.height, 0.0f };
-                        
-                        v2 rpos = state->ps_fire->start_p;
-                        
-                        Ray ray;
-                        ray.position = { rpos.x, rpos.y, 0.0f };
-                        
-                        v2 dir = { entity->facing_dir, 1.0f };
-                        dir = normalize(dir);
-                        ray.direction = { dir.x, dir.y, 0.0f };
-                        
-                        f32 t = (2.0f - entity->attack_time[0]) * 2.0f;
-                        if (t >= 1.0f) t = 1.0f;
-                        f32 min_d = 0.0f;
-                        f32 max_d = t*5.0f;
-                        pln("%f", max_d);
-                        
-                        bool collision = ray_box_collision(ray, min_d, max_d, player_box);
-                        
-                        dir = { entity->facing_dir, 1.6f };
-                        dir = normalize(dir);
-                        ray.direction = { dir.x, dir.y, 0.0f };
-                        
-                        collision = collision || ray_box_collision(ray, min_d, max_d, player_box);
-                        
-                        dir = { entity->facing_dir, 0.6f };
-                        dir = normalize(dir);
-                        ray.direction = { dir.x, dir.y, 0.0f };
-                        collision = collision || ray_box_collision(ray, min_d, max_d, player_box);
-                        
-                        if (collision) {
-                            if (player->invincibility_frames <= 0) {
-                                player->health -= 40;
-                                player->invincibility_frames = 40;
-                                SetSoundPitch(state->sound_player_hurt, random_f32()*0.3f + 1.0f);
-                                PlaySound(state->sound_player_hurt);
-                            }
-                        }
-                    }
-                    
-                    
-                    bool is_charging = entity->attack_time[1] > 0.0f;
-                    if (is_charging) {
-                        player->acceleration.x = player->facing_dir*30.0f;
-                    } else {
-                        
-                    }
-                } break;
-            }
-            
-            if (entity->invincibility_frames > 0) {
-                entity->invincibility_frames--;
-            }
-            
-            if (entity->is_rigidbody) {
-                // Rigidbody physics
-                v2 step_velocity = entity->velocity * delta_time + entity->acceleration * delta_time * delta_time * 0.5f;
-                entity->is_grounded = false;
-                check_collisions(state, entity, &step_velocity);
-                
-                entity->p += step_velocity;
-                entity->velocity += entity->acceleration * delta_time;
-                
-                if (entity->num_frames > 0) {
-                    entity->frame_advance += step_velocity.x * entity->frame_advance_rate;
-                    if (fabsf(step_velocity.x) <= 0.01f) {
-                        entity->frame_advance = 0.0f;
-                    }
-                    
-                    if (entity->frame_advance > entity->num_frames) {
-                        entity->frame_advance -= entity->num_frames;
-                    }
-                    
-                    if (entity->frame_advance < 0.0f) {
-                        entity->frame_advance += entity->num_frames;
-                    }
-                }
-                
-                
-                if (fabsf(entity->velocity.x) > entity->max_speed.x) {
-                    entity->velocity.x = sign(entity->velocity.x) * entity->max_speed.x;
-                }
-                
-                if (fabsf(entity->acceleration.x) > epsilon32 && fabsf(entity->velocity.x) > epsilon32 &&
-                    sign(entity->acceleration.x) != sign(entity->velocity.x)) {
-                    entity->acceleration.x *= 2.0f;
-                }
-                
-                if (fabsf(entity->acceleration.x) < epsilon32) {
-                    entity->velocity.x *= 0.8f;
-                }
-                
+        for (int i = 0; i < snapshot->sound_event_count; i++) {
+            Sound_Event* event = &snapshot->sound_events[i];
+            if (event->pitch > 0.0f) {
+                SetSoundPitch(state->sounds[event->id], event->pitch);
             }
+            PlaySound(state->sounds[event->id]);
         }
         
+        // NOTE(Alexander): must happen before we start drawing to the render target
+        update_tile_layer_cache(state, snapshot);
+        
         // Draw to render texture
         BeginTextureMode(render_target);
         ClearBackground(BACKGROUND_COLOR);
-        
-        
-#if 0
-        state->camera_p.x = player->p.x * state->meters_to_pixels - state->game_width/2.0f;
-        state->camera_p.x = round(state->camera_p.x) * state->pixels_to_meters;
-        state->camera_p.y = player->p.y * state->meters_to_pixels - state->game_height/2.0f;
-        state->camera_p.y = round(state->camera_p.y) * state->pixels_to_meters;
-#endif
-        
-        
-        for (int y = 0; y < 10; y++) {
-            for (int x = 0; x < 3; x++) {
-                int px = (int) round(x*state->texture_background.width-state->camera_p.x * state->meters_to_pixels);
-                int py = (int) round(y*state->texture_background.height-state->camera_p.y * state->meters_to_pixels);
-                DrawTexture(state->texture_background, px, py, WHITE);
-            }
-        }
-        
-        int tile_xcount = (int) (state->texture_tiles.width/state->meters_to_pixels);
-        for (int y = 0; y < state->tile_map_height; y++) {
-            for (int x = 0; x < state->tile_map_width; x++) {
-                u8 tile = state->tile_map[y*state->tile_map_width + x];
-                if (tile == 0) continue;
-                tile--;
-                
-                Rectangle src = { 0, 0, state->meters_to_pixels, state->meters_to_pixels };
-                src.x = (tile % tile_xcount) * state->meters_to_pixels;
-                src.y = (tile / tile_xcount) * state->meters_to_pixels;
-                
-                Rectangle dest = { 0, 0, state->meters_to_pixels, state->meters_to_pixels };
-                dest.x = (x - state->camera_p.x) * state->meters_to_pixels;
-                dest.y = (y - state->camera_p.y) * state->meters_to_pixels;
-                DrawTexturePro(state->texture_tiles, src, dest, origin, 0.0f, WHITE);
-            }
-        }
-        
-        for (int i = 0; i < state->entity_count; i++) {
-            Entity* entity = &state->entities[i];
-            if (!entity->type) continue;
-            if (entity->health <= 0) continue;
-            
-            if (entity->texture) {
-                v2 p = to_pixel(state, entity->p);
-                v2 size = entity->size * state->meters_to_pixels;
-                
-                bool facing_right = entity->facing_dir > 0.0f;
-                if (entity->flip_texture) {
-                    facing_right = !facing_right;
-                }
-                
-                
-                Rectangle src = { 0.0f, 0.0f, size.width, size.height };
-                if (entity->num_frames > 0 && entity->is_grounded) {
-                    int frame_index = (int) entity->frame_advance;
-                    if (fabsf(entity->velocity.x) < 0.01f) {
-                        frame_index = entity->idle_frame;
-                    }
-                    src.x += size.width*frame_index;
-                }
-                
-                Rectangle dest = { p.x, p.y, size.width, size.height };
-                if (facing_right) {
-                    src.width = -src.width;
-                }
-                
-                if (entity->invincibility_frames % 2 == 0) {
-                    DrawTexturePro(*entity->texture, src, dest, origin, entity->sprite_rot, WHITE);
-                }
-                
-            } else {
-                v2 p = to_pixel(state, entity->p);
-                v2 size = entity->size * state->meters_to_pixels;
-                DrawRectangle((int) p.x, (int) p.y,
-                              (int) size.x, (int) size.y, entity->color);
-            }
-            
-#if 0
-            {
-                v2 p = to_pixel(state, entity->p);
-                v2 size = entity->size * state->meters_to_pixels;
-                Rectangle r = { p.x, p.y, size.x, size.y };
-                DrawRectanglePro(r, origin, 0.0f, RED);
-            }
-#endif
-            
-            switch (entity->type) {
-                case Boss_Dragon: {
-                    Particle_System* ps = state->ps_fire;
-                    BeginBlendMode(BLEND_MULTIPLIED);
-                    for (int j = 0; j < ps->particle_count; j++) {
-                        Particle* particle = &ps->particles[j];
-                        if (particle->t > 0.0f) {
-                            v2 p = to_pixel(state, particle->p);
-                            Color color = ORANGE;
-                            color.r = (u8) (color.r*particle->t);
-                            color.g = (u8) (color.g*particle->t);
-                            color.b = (u8) (50*particle->t);
-                            color.a = (u8) (particle->t*particle->t*particle->t*255.0f);
-                            DrawCircle((int) p.x, (int) p.y, (1.0f - particle->t*particle->t)*10.0f, color);
-                        }
-                    }
-                    BeginBlendMode(BLEND_ALPHA);
-                    
-                    if (entity->invincibility_frames % 2 == 0) {
-                        // Draw tail
-                        v2 wp = entity->p + vec2(0.0f, 2.0f);
-                        if (entity->facing_dir <= 0.0f) {
-                            wp.x += entity->size.x;
-                        }
-                        //if (entity->facing_dir 
-                        //+ entity->size;
-                        Color color = rgb(165, 48, 48);
-                        v2 p = to_pixel(state, wp);
-                        
-                        static f32 angle_mod;
-                        
-                        angle_mod += delta_time;
-                        
-                        f32 angle = angle_mod + PI_F32/4.0f;
-                        int num_joints = 18;
-                        for (int c = 0; c < num_joints; c++) {
-                            f32 decr = 1.0f - (f32) c/num_joints;
-                            f32 radius = fabsf(cosf(c*PI_F32/2.0f))*3.5f*decr + 1.0f;
-                            if (c % 4 == 0) {
-                                DrawLine((int) p.x, (int) (p.y-radius*1.0f)+2, (int) p.x, (int) (p.y-radius*1.0f) -2, ORANGE);
-                            }
-                            DrawCircle((int) p.x, (int) p.y, radius, color);
-                            
-                            
-                            p.x += (radius * 0.8f)*(entity->facing_dir > 0.0f ? -1.0f : 1.0f);
-                            p.y += sinf(angle)*(radius * 0.8f)*0.5f;
-                            angle += PI_F32/8.0f;
-                        }
-                    }
-                    
-                    
-                    {
-                        // Draw wings
-                        v2 p = to_pixel(state, entity->p) - vec2(32.0f, 32.0f);
-                        v2 size = vec2(128.0f, 128.0f);
-                        
-                        bool facing_right = entity->facing_dir > 0.0f;
-                        if (entity->flip_texture) {
-                            facing_right = !facing_right;
-                        }
-                        
-                        
-                        static f32 wings_frame;
-                        if (entity->velocity.y < 0.0f) {
-                            wings_frame += delta_time*15.0f;
-                        } else {
-                            wings_frame = 0.0f;
-                        }
-                        
-                        
-                        Rectangle src = { 0.0f, 0.0f, size.width, size.height };
-                        int frame_index =  ((int) wings_frame) % 8;
-                        //if (fabsf(entity->velocity.x) < 0.01f) {
-                        //frame_index = entity->idle_frame;
-                        //}
-                        src.x += size.width*frame_index;
-                        
-                        Rectangle dest = { p.x, p.y, size.width, size.height };
-                        if (facing_right) {
-                            src.width = -src.width;
-                        }
-                        
-                        if (entity->invincibility_frames % 2 == 0) {
-                            DrawTexturePro(state->texture_dragon_wings, src, dest, origin, entity->sprite_rot, WHITE);
-                        }
-                        
-                    }
-                    
-#if BUILD_DEBUG && 0
-                    Ray ray;
-                    v2 rpos = to_pixel(state, state->ps_fire->start_p);
-                    ray.position = { rpos.x, rpos.y, 0.0f };
-                    
-                    v2 dir = { entity->facing_dir, 1.0f };
-                    dir = normalize(dir);
-                    ray.direction = { dir.x, dir.y, 0.0f };
-                    DrawRay(ray, PURPLE);
-                    
-                    dir = { entity->facing_dir, 1.6f };
-                    dir = normalize(dir);
-                    ray.direction = { dir.x, dir.y, 0.0f };
-                    DrawRay(ray, PURPLE);
-                    
-                    dir = { entity->facing_dir, 0.6f };
-                    dir = normalize(dir);
-                    ray.direction = { dir.x, dir.y, 0.0f };
-                    DrawRay(ray, PURPLE);
-#endif
-                    
-                } break;
-                
-                
-                case Player: {
-                    Particle_System* ps = state->ps_charging;
-                    BeginBlendMode(BLEND_ADDITIVE);
-                    for (int j = 0; j < ps->particle_count; j++) {
-                        Particle* particle = &ps->particles[j];
-                        if (particle->t > 0.0f) {
-                            v2 cp = to_pixel(state, ps->start_p);
-                            v2 p1 = to_pixel(state, particle->p);
-                            v2 p0 = cp + (p1 - cp)*(1.0f - particle->t);
-                            Color color = YELLOW;
-                            //color.r = (u8) (color.r*particle->t);
-                            //color.g = (u8) (color.g*particle->t);
-                            //color.b = (u8) (50*particle->t);
-                            color.a = 25;//(u8) (particle->t*particle->t*particle->t*255.0f);
-                            DrawLine((int) p0.x, (int) p0.y, (int) p1.x, (int) p1.y, color);
-                        }
-                    }
-                    BeginBlendMode(BLEND_ALPHA);
-                    
-                } break;
-            }
-            
-            
-#if 0
-            if (entity->holding) {
-                v2 size = entity->size * state->meters_to_pixels * 0.3f;
-                v2 p = entity->p + vec2(entity->size.x/2.0f + 0.4f * entity->facing_dir, 0.5f);
-                
-                if (IsKeyDown(KEY_S)) {
-                    p.y += entity->size.y - 0.5f ;
-                }
-                
-                p = to_pixel(state, p) - size.x/2.0f;
-                
-                Rectangle r = { p.x, p.y, size.x, size.y };
-                DrawRectanglePro(r, origin, 0.0f, entity->holding.color);
-            }
-#endif
-        }
-        
-        draw_level_bounds(state);
-        
-        
-        if (state->mode == Control_Boss_Enemy) {
-            draw_health_bar(state, state->boss_enemy, RED, false);
-            draw_health_bar(state, state->player, SKYBLUE, true);
-            
-            
-            // Checking victory conditions
-            Entity* boss = state->boss_enemy;
-            if (boss->health <= 0 || player->health <= 0) {
-                
-                if (boss->health > -1000 && boss->health <= 0) {
-                    PlaySound(state->sound_lose);
-                    boss->health = -2000;
-                    state->cutscene_time = 0.0f;
-                }
-                
-                if (player->health > -1000 && player->health <= 0) {
-                    PlaySound(state->sound_win);
-                    player->health = -2000;
-                    state->cutscene_time = 0.0f;
-                }
-                
-                state->cutscene_time += delta_time;
-                
-                cstring text;
-                Color text_color;
-                if (boss->health <= 0) {
-                    text = "You lost!";
-                    text_color = MAROON;
-                } else {
-                    text = "You win!";
-                    text_color = BLUE;
-                }
-                
-                
-                Vector2 size = MeasureTextEx(state->font, text, 42.0f, 0.0f);
-                Vector2 p;
-                p.x = state->game_width /2.0f - size.x /2.0f;
-                p.y = state->game_height /2.0f - size.y /2.0f;
-                DrawTextEx(state->font, text, p, 42.0f, 0.0f, text_color);
-                
-                f32 rate = 500.0f;
-                Color c = {};
-                if (cutscene_interval(3.5f, 5.5f)) {
-                    f32 val = (state->cutscene_time-3.5f)*rate;
-                    c.a = (u8) (val > 255.0f ? 255.0f : val);
-                    DrawRectangle(0, 0, state->game_width, state->game_height, c);
-                } else if (cutscene_interval(5.5f, 7.2f)) {
-                    player = init_level(state, &level_arena);
-                }
-            } 
-        }
-        
-        
-        //DrawRectangle(5, 5, state->game_width/2-10, 8, BLACK);
-        //DrawRectangle(6, 6, state->game_width/2-12, 6, RED);
-        
-        
-        //cstring text = "Congrats! You created your first window!";
-        //DrawText((s8*) text, 190, 200, 20, LIGHTGRAY);
+        submit_render_commands(state, &snapshot->commands);
         EndTextureMode();
         
         {
@@ -1370,9 +878,10 @@ main() {
             dest.x = (state->screen_width - dest.width)/2.0f;
             
             //dest.x += dest.width;
-            if (state->mode == Intro_Cutscene) {
-                if (cutscene_interval(7.0f, 7.5f)) {
-                    f32 t = (state->cutscene_time - 7.0f)*4.0f;
+            f32 cutscene_time = snapshot->cutscene_time;
+            if (snapshot->mode == Intro_Cutscene) {
+                if (cutscene_time > 7.0f && cutscene_time < 7.5f) {
+                    f32 t = (cutscene_time - 7.0f)*4.0f;
                     
                     f32 swap = fabsf(1.0f - t);
                     dest.x = dest.x + (dest.width / 2.0f) * (1.0f - swap);
@@ -1381,7 +890,7 @@ main() {
                 }
                 
                 
-                if (cutscene_interval(0.0f, 7.25f)) {
+                if (cutscene_time > 0.0f && cutscene_time < 7.25f) {
                     src.width = -src.width;
                 }
             }
@@ -1391,12 +900,21 @@ main() {
             
             DrawFPS(8, state->screen_height - 24);
 #endif
+#if ARENA_STATS
+            if (show_arena_stats) {
+                int y = draw_arena_stats("level arena", &snapshot->level_arena_stats, 8, 8);
+                draw_arena_stats("scratch arena", &snapshot->scratch_arena_stats, 8, y + 8);
+            }
+#endif
             
             EndDrawing();
         }
     }
     
+    free_frame_pipeline(pipeline);
+    free_job_system(state->jobs);
+    
     CloseWindow();        // Close window and OpenGL context
     
     return 0;
-}
\ No newline at end of file
+}
@@ -5,7 +5,7 @@
 
 
 #if BUILD_DEBUG
-#define pln(format, ...) printf(format##"\n", __VA_ARGS__)
+#define pln(format, ...) printf(format "\n", ##__VA_ARGS__)
 #else
 #define pln(format, ...)
 #endif
@@ -52,13 +52,6 @@ string_lit(cstring str) {
     return result;
 }
 
-inline cstring
-string_to_cstring(string str, u8* dest=0) {
-    u8* result = dest ? dest : (u8*) malloc(str.count + 1);
-    memcpy(result, str.data, str.count);
-    result[str.count] = 0;
-    return (cstring) result;
-}
 inline string
 cstring_to_string(cstring str) {
     string result;
@@ -67,11 +60,6 @@ cstring_to_string(cstring str) {
     return result;
 }
 
-inline void
-cstring_free(cstring str) {
-    free((void*) str);
-}
-
 #define array_count(array) (sizeof(array) / sizeof((array)[0]))
 
 #ifdef assert
@@ -95,9 +83,23 @@ __assert(const char* expression, const char* file, int line) {
 #include "raylib.h"
 
 #include "math.h"
+#include "simd.h"
 #include "tokenizer.h"
+#include "inflate.h"
 #include "memory.h"
+#include "thread.h"
+#include "jobs.h"
+
+// NOTE(Alexander): without a dest the string is only valid until the end of the tick
+inline cstring
+string_to_cstring(string str, u8* dest=0) {
+    u8* result = dest ? dest : (u8*) push_size(get_scratch_arena(), str.count + 1, 1, Arena_Tag_String);
+    memcpy(result, str.data, str.count);
+    result[str.count] = 0;
+    return (cstring) result;
+}
 
+#define TILE_SIZE 16
 
 enum Entity_Type {
     None,
@@ -117,28 +119,108 @@ enum Game_Mode {
 };
 
 #define NUM_ATTACKS 3
+#define MAX_BULLET_COUNT 5
 
+// NOTE(Alexander): the simulation always advances in fixed steps, timers that used to
+// count rendered frames now count simulation ticks instead.
+// NOTE(Alexander): the AI still makes its decisions once per tick so match outcomes shift
+// with the tick rate, keep this at the 60 Hz the game was tuned at.
+#define SIM_HZ 60
+#define SIM_DT (1.0f/SIM_HZ)
+#define seconds_to_ticks(seconds) ((s32) ((seconds)*SIM_HZ + 0.5f))
 
-struct Entity {
-    Entity_Type type;
+// NOTE(Alexander): the simulation never reads the keyboard directly, the platform
+// layer (or the headless runner) fills one of these before each simulate_tick.
+enum Input_Button {
+    Button_Left,
+    Button_Right,
+    Button_Down,
+    Button_Jump,
+    Button_Attack,
+    Button_Special,
     
-    v2 p;
-    v2 size;
-    f32 facing_dir;
-    
-    v2 velocity;
-    v2 acceleration;
-    v3 max_speed;
+    Button_Count,
+};
+
+struct Input_Snapshot {
+    bool down[Button_Count];
+    bool pressed[Button_Count];
+};
+
+enum Sound_Id {
+    Sound_Shoot_Bullet,
+    Sound_Explosion,
+    Sound_Hurt,
+    Sound_Player_Hurt,
+    Sound_Fire_Breathing,
+    Sound_Charging,
+    Sound_Lose,
+    Sound_Win,
     
-    Entity* collided_with;
-    bool collided;
+    Sound_Count,
+};
+
+struct Sound_Event {
+    Sound_Id id;
+    f32 pitch; // NOTE(Alexander): 0 keeps the current pitch
+};
+
+#define MAX_SOUND_EVENTS 32
+
+
+// NOTE(Alexander): region of a texture atlas, wrapping sprites repeat when drawn with a
+// source rect larger than the region (TEXTURE_WRAP_REPEAT doesn't work inside an atlas).
+struct Sprite {
+    Texture2D texture;
+    Rectangle rect;
+    bool wrap;
+};
+
+// NOTE(Alexander): hot entity state lives in Entity_Store arrays, these flags are what
+// the collision and integration passes test so they are kept out of the cold record.
+enum Entity_Flag {
+    Entity_Flag_Rigidbody = 1 << 0,
+    Entity_Flag_Fast      = 1 << 1, // NOTE(Alexander): uses swept collision against other entities
+    Entity_Flag_Grounded  = 1 << 2,
+    Entity_Flag_Collided  = 1 << 3,
+    Entity_Flag_Despawn   = 1 << 4, // NOTE(Alexander): removed from the store at the end of the tick
+};
+
+// NOTE(Alexander): stable reference to an entity, the dense index of an entity changes
+// whenever another entity is despawned. The generation is bumped every time a slot is
+// freed so stale handles stop resolving, generation 0 is never used so {} is a null handle.
+struct Entity_Handle {
+    u32 slot;
+    u32 generation;
+};
+
+inline bool
+operator==(Entity_Handle a, Entity_Handle b) {
+    return a.slot == b.slot && a.generation == b.generation;
+}
+
+inline bool
+operator!=(Entity_Handle a, Entity_Handle b) {
+    return !(a == b);
+}
+
+struct Entity_Slot {
+    u32 generation;
+    s32 index; // NOTE(Alexander): dense index while alive, next free slot (or -1) otherwise
+};
+
+#define MAX_ENTITY_COUNT 4096
+
+// NOTE(Alexander): cold entity data, only read by the AI and rendering code
+struct Entity {
+    f32 facing_dir;
     
-    Entity* holding;
+    Entity_Handle holding;
     
     v2 texture_size;
     bool flip_texture;
     f32 sprite_rot;
-    Texture* texture;
+    Sprite* sprite;
     Color color;
     
     int num_frames;
@@ -149,28 +231,53 @@ struct Entity {
     f32 attack_time[NUM_ATTACKS];
     f32 attack_cooldown[NUM_ATTACKS];
     
-    s32 health;
     s32 max_health;
     
-    s32 invincibility_frames;
+    s32 invincibility_ticks;
     
-    bool is_grounded;
     bool is_jumping;
     bool is_attacking;
-    bool is_rigidbody;
     bool is_cornered;
-    
-    u32 pad;
 };
 
-struct Particle {
-    v2 p;
-    v2 v;
-    f32 t;
+// NOTE(Alexander): structure of arrays entity storage, index i in every array is the same entity.
+// The broadphase, collision and integration passes only stride over the hot arrays,
+// everything else is in the cold Entity records.
+// Live entities are always packed in [0, count), despawning moves the last entity into the hole.
+struct Entity_Store {
+    s32 count;
+    s32 capacity;
+    
+    // Pool
+    Entity_Slot* slots;
+    u32* slot; // NOTE(Alexander): dense index to slot
+    s32 first_free_slot;
+    
+    // Hot
+    Entity_Type* type;
+    u32* flags;
+    v2* p;
+    v2* prev_p; // NOTE(Alexander): position before the last tick, used for render interpolation
+    v2* size;
+    v2* velocity;
+    v2* acceleration;
+    f32* max_speed;
+    s32* health;
+    Entity_Handle* collided_with;
+    
+    // Cold
+    Entity* cold;
 };
 
+// NOTE(Alexander): particles are stored as separate float arrays so they can be updated
+// SIMD_WIDTH at a time, the capacity is padded to a whole number of lanes so the kernels
+// can run past particle_count without a scalar tail.
 struct Particle_System {
-    Particle* particles;
+    f32* p_x;
+    f32* p_y;
+    f32* v_x;
+    f32* v_y;
+    f32* t; // NOTE(Alexander): remaining lifetime, 1 when spawned and dead at 0
     int max_particle_count;
     int particle_count;
     
@@ -185,7 +292,389 @@ struct Particle_System {
     f32 max_scale;
     
     f32 spawn_rate;
-    f32 delta_t;
+    f32 spawn_budget;
+    f32 fade_rate; // NOTE(Alexander): lifetime lost per second
+    
+    u32 random_state[SIMD_WIDTH]; // NOTE(Alexander): separate from rand() so effects don't change the gameplay
+};
+
+// NOTE(Alexander): particles per parallel_for batch, smaller systems are updated inline.
+// Sized so the 500 particle fire breath is split in four, the charging effect stays inline.
+#define PARTICLE_JOB_BATCH_SIZE 128
+
+struct Level_Streamer;
+
+// NOTE(Alexander): static level geometry, one bit per tile. The bounds cover the tile map
+// plus any collision rectangles that reach outside of it (e.g. the floor outside the doors).
+// Streamed levels have no bits here, each resident chunk has the bits for its own tiles.
+struct Solid_Map {
+    u32* bits;
+    s32 min_x;
+    s32 min_y;
+    s32 width;
+    s32 height;
+    
+    Level_Streamer* streamer;
+};
+
+// NOTE(Alexander): uniform grid broadphase, rebuilt at the start of every tick.
+// Cells are GRID_CELL_SIZE tiles wide and each cell lists the indices of the
+// entities overlapping it (entities spanning several cells are listed in each).
+#define GRID_CELL_SIZE 4.0f
+#define GRID_MARGIN 0.25f
+
+// NOTE(Alexander): entities per parallel_for batch when computing the grid ranges
+#define GRID_JOB_BATCH_SIZE 1024
+
+struct Grid_Range {
+    s32 min_x;
+    s32 min_y;
+    s32 max_x;
+    s32 max_y;
+};
+
+struct Spatial_Grid {
+    s32 width;
+    s32 height;
+    
+    Grid_Range* entity_ranges; // NOTE(Alexander): cells covered by each entity this tick, empty if not collidable
+    s32 entity_range_capacity;
+    
+    s32* cell_offsets; // NOTE(Alexander): width*height + 1 prefix sums into entity_indices
+    s32 cell_capacity;
+    
+    s32* entity_indices;
+    s32 entity_index_capacity;
+    
+    s32* candidates;
+    s32 candidate_capacity;
+};
+
+#define MAX_TILE_LAYERS 8
+
+// NOTE(Alexander): Tiled keeps the flips of a tile in the top bits of its gid
+#define TILE_FLIPPED_HORIZONTALLY 0x80000000
+#define TILE_FLIPPED_VERTICALLY 0x40000000
+#define TILE_FLIPPED_DIAGONALLY 0x20000000
+#define TILE_ROTATED_HEXAGONAL_120 0x10000000
+#define TILE_GID_MASK 0x0FFFFFFF
+
+// NOTE(Alexander): one layer of tile_map_width*tile_map_height gids, stored in the smallest
+// element that fits the largest gid of the layer (u8 for the usual small tileset). Flips are
+// rare so they get their own array, which is only there if some tile of the layer is flipped.
+struct Tile_Layer {
+    void* tiles;
+    u8* flips; // NOTE(Alexander): the flip bits of the gid shifted down by 28, may be null
+    s32 element_size; // NOTE(Alexander): 1, 2 or 4 bytes per tile
+    u32 max_gid;
+};
+
+inline u32
+get_tile(Tile_Layer* layer, s32 index) {
+    switch (layer->element_size) {
+        case 1: return ((u8*) layer->tiles)[index];
+        case 2: return ((u16*) layer->tiles)[index];
+        default: return ((u32*) layer->tiles)[index];
+    }
+}
+
+// NOTE(Alexander): returns the TILE_FLIPPED_* bits of the tile
+inline u32
+get_tile_flips(Tile_Layer* layer, s32 index) {
+    return layer->flips ? (u32) layer->flips[index] << 28 : 0;
+}
+
+// NOTE(Alexander): the tile layers are split into chunks of TILE_CHUNK_SIZE x TILE_CHUNK_SIZE
+// tiles, the renderer bakes each chunk into a render texture and only re-bakes dirty ones.
+#define TILE_CHUNK_SIZE 16
+
+// NOTE(Alexander): tiles of one chunk that is about to be baked, built on the job system
+// since only the draw calls have to happen on the main thread.
+struct Tile_Chunk_Quads {
+    int chunk_x;
+    int chunk_y;
+    int count;
+    Rectangle src[TILE_CHUNK_SIZE*TILE_CHUNK_SIZE];
+    Rectangle dest[TILE_CHUNK_SIZE*TILE_CHUNK_SIZE];
+    f32 rotation[TILE_CHUNK_SIZE*TILE_CHUNK_SIZE]; // NOTE(Alexander): degrees, diagonally flipped tiles
+};
+
+struct Tile_Layer_Cache {
+    RenderTexture2D* chunks;
+    Tile_Chunk_Quads* bake_quads; // NOTE(Alexander): scratch space, one per chunk
+    int width;
+    int height;
+    
+    // NOTE(Alexander): streamed levels bake each chunk into the texture of the streamer slot
+    // holding it instead, so the textures stay bounded by the chunk cache and not the map.
+    RenderTexture2D* streamed_chunks; // NOTE(Alexander): LEVEL_STREAM_CACHE_SIZE, created when first used
+    Tile_Chunk_Quads* streamed_bake_quads;
+};
+
+// NOTE(Alexander): a frame is first described as a list of render commands, then sorted on
+// (layer, blend mode, texture) and submitted, so draws sharing blend mode and texture end up
+// in the same raylib batch. The layer decides what is drawn on top, commands with the same
+// key are drawn in the order they were pushed.
+enum Render_Layer {
+    Render_Layer_Background,
+    Render_Layer_Tiles,
+    Render_Layer_Entities,
+    Render_Layer_Effects, // NOTE(Alexander): particles
+    Render_Layer_Entity_Details, // NOTE(Alexander): dragon tail
+    Render_Layer_Entity_Overlay, // NOTE(Alexander): dragon wings
+    Render_Layer_Level_Bounds,
+    Render_Layer_Hud,
+    Render_Layer_Hud_Text,
+    Render_Layer_Fade,
+    
+    Render_Layer_Count,
+};
+
+// NOTE(Alexander): which texture a command samples, resolved by the platform layer
+enum Render_Texture {
+    Render_Texture_None, // NOTE(Alexander): untextured shapes
+    Render_Texture_Atlas,
+    Render_Texture_Tile_Chunk,
+    Render_Texture_Font,
+    
+    Render_Texture_Count,
+};
+
+enum Render_Command_Type {
+    Render_Command_Sprite,
+    Render_Command_Tile_Chunk,
+    Render_Command_Rect,
+    Render_Command_Circle,
+    Render_Command_Line,
+    Render_Command_Text,
+    Render_Command_Particles,
+    
+    Render_Command_Type_Count,
+};
+
+enum Particle_Style {
+    Particle_Style_Fire,
+    Particle_Style_Charging,
+};
+
+struct Render_Sprite {
+    Sprite* sprite;
+    Rectangle src;
+    Rectangle dest;
+    f32 rotation;
+    Color tint;
+};
+
+struct Render_Tile_Chunk {
+    int chunk_index; // NOTE(Alexander): the streamer slot for streamed chunks
+    bool is_streamed;
+    v2 p;
+};
+
+struct Render_Rect {
+    Rectangle rect;
+    Color color;
+};
+
+struct Render_Circle {
+    v2 center;
+    f32 radius;
+    Color color;
+};
+
+struct Render_Line {
+    v2 p0;
+    v2 p1;
+    Color color;
+};
+
+struct Render_Text {
+    cstring text; // NOTE(Alexander): not copied, has to outlive the frame (e.g. string literals)
+    v2 p;
+    f32 font_size;
+    Color color;
+    bool centered; // NOTE(Alexander): p is the center of the text instead of the top left corner
+};
+
+// NOTE(Alexander): the live particles are copied into the buffer (see particle_data) so
+// the commands stay valid while the simulation keeps updating the particle system.
+struct Render_Particles {
+    Particle_Style style;
+    int count;
+    int data_offset; // NOTE(Alexander): count x, count y (both in pixels) and count lifetimes
+    v2 start_p; // NOTE(Alexander): emitter position in pixels
+};
+
+struct Render_Command {
+    Render_Command_Type type;
+    union {
+        Render_Sprite sprite;
+        Render_Tile_Chunk tile_chunk;
+        Render_Rect rect;
+        Render_Circle circle;
+        Render_Line line;
+        Render_Text text;
+        Render_Particles particles;
+    };
+};
+
+struct Render_Sort_Entry {
+    u32 key;
+    u32 index;
+};
+
+struct Render_Command_Buffer {
+    Render_Command* commands;
+    Render_Sort_Entry* sort_entries; // NOTE(Alexander): in push order until sorted
+    Render_Sort_Entry* sorted;
+    int count;
+    int capacity;
+    
+    f32* particle_data;
+    int particle_data_count;
+    int particle_data_capacity;
+};
+
+struct Render_Stats {
+    int command_count;
+    int batch_count; // NOTE(Alexander): estimated draw calls, a new batch starts when the blend mode or texture changes
+    int type_counts[Render_Command_Type_Count];
+};
+
+struct Streamed_Chunk_Upload;
+
+// NOTE(Alexander): everything the platform layer needs to present one frame, produced by the
+// simulation thread while the main thread is still drawing the previous one. The tile map
+// is only copied when some chunk changed, the renderer re-bakes the dirty chunks from it.
+struct Render_Snapshot {
+    Render_Command_Buffer commands;
+    
+    Sound_Event sound_events[MAX_SOUND_EVENTS];
+    int sound_event_count;
+    bool start_music;
+    
+    Game_Mode mode;
+    f32 cutscene_time;
+    
+    Tile_Layer tile_layers[MAX_TILE_LAYERS]; // NOTE(Alexander): malloced copies of the state's layers
+    int tile_layer_count;
+    int tile_map_width;
+    int tile_map_height;
+    
+    u8* tile_chunk_dirty;
+    int tile_chunk_width;
+    int tile_chunk_height;
+    bool any_tile_chunk_dirty;
+    
+    // NOTE(Alexander): streamed levels have no tile layers, the chunks that became resident
+    // since the last snapshot are copied instead since their slot may be reused before the
+    // main thread gets to bake them. The data has room for the record of every slot.
+    Streamed_Chunk_Upload* streamed_uploads; // NOTE(Alexander): LEVEL_STREAM_CACHE_SIZE of them
+    int streamed_upload_count;
+    u8* streamed_upload_data;
+    umm streamed_upload_record_size;
+    
+#if ARENA_STATS
+    // NOTE(Alexander): the arenas belong to the simulation thread so they are copied here
+    Arena_Stats level_arena_stats;
+    Arena_Stats scratch_arena_stats;
+#endif
+};
+
+// NOTE(Alexander): file mapped copy-on-write, writes only ever touch our private copy of the pages
+struct Mapped_File {
+    u8* data;
+    umm size;
+};
+
+#define LEVEL_STREAM_CHUNK_SIZE 32 // NOTE(Alexander): in tiles, changing it needs a re-cook, multiple of TILE_CHUNK_SIZE
+#define LEVEL_STREAM_CACHE_SIZE 64 // NOTE(Alexander): chunks that can be resident at once
+#define LEVEL_STREAM_MARGIN 1 // NOTE(Alexander): chunks around the view that are loaded ahead of time
+
+enum Streamed_Chunk_State {
+    Streamed_Chunk_Empty,
+    Streamed_Chunk_Loading,
+    Streamed_Chunk_Resident,
+};
+
+struct Collider;
+struct Level_Stream_Header;
+struct Level_Stream_Index_Entry;
+
+// NOTE(Alexander): one slot of the chunk cache, the layers point into data
+struct Streamed_Chunk {
+    volatile s32 state; // NOTE(Alexander): Streamed_Chunk_State, set by the loading job
+    s32 chunk_x;
+    s32 chunk_y;
+    u32 last_used; // NOTE(Alexander): streamer frame the chunk was last wanted
+    bool is_uploaded; // NOTE(Alexander): copied into a render snapshot since it was loaded
+    
+    Tile_Layer layers[MAX_TILE_LAYERS];
+    s32 layer_count;
+    
+    // NOTE(Alexander): the level colliders rasterized over the tiles of the chunk, see Solid_Map
+    u32 solid_bits[LEVEL_STREAM_CHUNK_SIZE*LEVEL_STREAM_CHUNK_SIZE/32];
+    
+    u8* data;
+    u32 data_size;
+    Level_Streamer* streamer;
+};
+
+struct Streamed_Chunk_Upload {
+    s32 slot;
+    Tile_Layer layers[MAX_TILE_LAYERS];
+    s32 layer_count;
+};
+
+// NOTE(Alexander): keeps the chunks of an open world level around the camera resident,
+// see level_stream.cpp. Closed (header is null) for levels that fit in memory.
+struct Level_Streamer {
+    Mapped_File file;
+    Level_Stream_Header* header;
+    Level_Stream_Index_Entry* index;
+    
+    Streamed_Chunk chunks[LEVEL_STREAM_CACHE_SIZE];
+    u8* chunk_memory;
+    Job_Counter pending;
+    u32 frame;
+    
+    // NOTE(Alexander): set before the first update, the loading jobs read them
+    Collider* colliders;
+    s32 collider_count;
+    
+    Streamed_Chunk* last_found; // NOTE(Alexander): most collision queries hit the same chunk again
+    
+    s32 load_count;
+    s32 evict_count;
+};
+
+// NOTE(Alexander): copy of everything init_level sets up, taken the first time the level is
+// loaded so restarting is a handful of memcpys instead of loading and spawning it again.
+struct Level_Snapshot {
+    bool is_valid;
+    
+    // NOTE(Alexander): the level arena block as it was after loading, pointers into it are
+    // rebased onto the arena's block on restore
+    u8* arena_base;
+    umm arena_used;
+    u8* arena_data;
+    
+    u8* tile_data; // NOTE(Alexander): tiles and flips of all layers before any runtime edits
+    Tile_Layer tile_layers[MAX_TILE_LAYERS];
+    int tile_layer_count;
+    int tile_map_width;
+    int tile_map_height;
+    u8* tile_chunk_dirty;
+    int tile_chunk_width;
+    int tile_chunk_height;
+    
+    Solid_Map solid_map;
+    
+    Entity_Store entities;
+    Entity_Handle player;
+    Entity_Handle boss_enemy;
+    Entity_Handle left_door;
+    Entity_Handle right_door;
 };
 
 struct Game_State {
@@ -193,20 +682,27 @@ struct Game_State {
     
     f32 cutscene_time;
     
-    Entity* player;
-    Entity* boss_enemy;
-    Entity* bullets[5];
-    Entity* charged_bullet;
-    Entity* left_door;
-    Entity* right_door;
+    Entity_Handle player;
+    Entity_Handle boss_enemy;
+    Entity_Handle charged_bullet;
+    Entity_Handle left_door;
+    Entity_Handle right_door;
+    
+    int bullet_count; // NOTE(Alexander): regular bullets currently alive, at most MAX_BULLET_COUNT
     
-    Entity* entities;
-    int entity_count;
+    Entity_Store entities;
     
-    u8* tile_map;
+    // NOTE(Alexander): drawn in order, the first layer is at the back
+    Tile_Layer tile_layers[MAX_TILE_LAYERS];
+    int tile_layer_count;
     int tile_map_width;
     int tile_map_height;
     
+    // NOTE(Alexander): one flag per tile chunk, set by the simulation whenever tiles change
+    u8* tile_chunk_dirty;
+    int tile_chunk_width;
+    int tile_chunk_height;
+    
     int game_width;
     int game_height;
     int game_scale;
@@ -221,23 +717,39 @@ struct Game_State {
     Particle_System* ps_fire;
     Particle_System* ps_charging;
     
-    Texture2D texture_tiles;
-    Texture2D texture_background;
-    Texture2D texture_player;
-    Texture2D texture_dragon;
-    Texture2D texture_dragon_wings;
-    Texture2D texture_door;
-    Texture2D texture_bullet;
-    Texture2D texture_charged_bullet;
-    
-    Sound sound_shoot_bullet;
-    Sound sound_explosion;
-    Sound sound_hurt;
-    Sound sound_player_hurt;
-    Sound sound_fire_breathing;
-    Sound sound_charging;
-    Sound sound_lose;
-    Sound sound_win;
+    Memory_Arena permanent_arena; // NOTE(Alexander): lives as long as the simulation, never cleared
+    Memory_Pool particle_system_pool;
+    Memory_Arena level_arena;
+    Mapped_File level_file; // NOTE(Alexander): cooked level, the tile layers point into it
+    Level_Streamer level_streamer;
+    Level_Snapshot level_snapshot;
+    
+    Job_System* jobs;
+    
+    Solid_Map solid_map;
+    Spatial_Grid grid;
+    
+    f32 time_accumulator;
+    
+    // NOTE(Alexander): audio requests produced by the simulation, consumed by the platform layer
+    Sound_Event sound_events[MAX_SOUND_EVENTS];
+    int sound_event_count;
+    bool start_music;
+    
+    Texture2D texture_atlas;
+    Sprite sprite_tiles;
+    Sprite sprite_background;
+    Sprite sprite_player;
+    Sprite sprite_dragon;
+    Sprite sprite_dragon_wings;
+    Sprite sprite_door;
+    Sprite sprite_bullet;
+    Sprite sprite_charged_bullet;
+    Sprite sprite_particle; // NOTE(Alexander): soft white circle generated at startup
+    
+    Tile_Layer_Cache tile_cache;
+    
+    Sound sounds[Sound_Count];
     
     Music music;
     
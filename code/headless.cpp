@@ -0,0 +1,207 @@
+// NOTE(Alexander): headless runner, steps the simulation core without a window,
+// audio device or OpenGL context so we can run many matches on build servers.
+// Run from run_tree/ (same as the game) since the level is loaded from assets/.
+//
+// With -render (or a max_batches) the frame's render commands are built and sorted every
+// other tick (60 Hz) like in the game so draw call regressions show up here, max_batches
+// fails the run when any frame needs more batches than that. Without them only the
+// simulation runs, which is what balance runs want.
+//
+// usage: headless [-render] [match_count] [seed] [max_batches]
+
+#include <time.h>
+
+#include "game.h"
+#include "format_tmx.cpp"
+#include "format_level.cpp"
+#include "level_stream.cpp"
+#include "simulate.cpp"
+#include "render.cpp"
+
+#define HEADLESS_MAX_TICKS (SIM_HZ*60*5)
+
+enum Match_Outcome {
+    Outcome_Draw,
+    Outcome_Dragon_Won,
+    Outcome_Player_Won,
+};
+
+// NOTE(Alexander): very simple scripted dragon, chases the player and breathes fire
+// when close enough. Only exists so we have something deterministic to balance against.
+Input_Snapshot
+headless_dragon_input(Game_State* state, Input_Snapshot* prev) {
+    Input_Snapshot result = {};
+    
+    Entity_Store* store = &state->entities;
+    s32 dragon = get_entity_index(store, state->boss_enemy);
+    s32 player = get_entity_index(store, state->player);
+    v2 dist = ((store->p[player] + store->size[player]/2.0f) -
+               (store->p[dragon] + store->size[dragon]/2.0f));
+    
+    if (dist.x < -1.0f) {
+        result.down[Button_Left] = true;
+    } else if (dist.x > 1.0f) {
+        result.down[Button_Right] = true;
+    }
+    
+    if (dist.y < -1.0f) {
+        result.down[Button_Jump] = !prev->down[Button_Jump] || random_f32() < 0.9f;
+    } else if (dist.y > 2.0f) {
+        result.down[Button_Down] = true;
+    }
+    
+    // NOTE(Alexander): attacks trigger on press so release the button every other frame
+    if (fabsf(dist.x) < 5.0f && dist.y > -1.0f) {
+        result.down[Button_Attack] = !prev->down[Button_Attack];
+    }
+    
+    for (int i = 0; i < Button_Count; i++) {
+        result.pressed[i] = result.down[i] && !prev->down[i];
+    }
+    
+    return result;
+}
+
+#define HEADLESS_TICKS_PER_FRAME (SIM_HZ/60)
+
+struct Render_Totals {
+    s64 frame_count;
+    s64 command_count;
+    s64 batch_count;
+    s64 type_counts[Render_Command_Type_Count];
+    int max_command_count;
+    int max_batch_count;
+};
+
+void
+accumulate_render_stats(Render_Totals* totals, Render_Stats* stats) {
+    totals->frame_count++;
+    totals->command_count += stats->command_count;
+    totals->batch_count += stats->batch_count;
+    for (int i = 0; i < Render_Command_Type_Count; i++) {
+        totals->type_counts[i] += stats->type_counts[i];
+    }
+    totals->max_command_count = max(totals->max_command_count, stats->command_count);
+    totals->max_batch_count = max(totals->max_batch_count, stats->batch_count);
+}
+
+Match_Outcome
+run_match(Game_State* state, Render_Command_Buffer* render_commands, Render_Totals* render_totals, int* tick_count) {
+    // NOTE(Alexander): render_commands is null when render stats weren't asked for
+    init_level(state, &state->level_arena);
+    
+    // NOTE(Alexander): the script decides once per 60 Hz frame like a player at 60 fps would and
+    // holds the buttons in between, so the balance doesn't change with the simulation rate
+    Input_Snapshot input = {};
+    for (int tick = 0; tick < HEADLESS_MAX_TICKS; tick++) {
+        if (tick % HEADLESS_TICKS_PER_FRAME == 0) {
+            input = headless_dragon_input(state, &input);
+        } else {
+            for (int i = 0; i < Button_Count; i++) {
+                input.pressed[i] = false;
+            }
+        }
+        simulate_tick(state, &input, SIM_DT);
+        
+        if (render_commands && tick % HEADLESS_TICKS_PER_FRAME == 0) {
+            build_render_commands(state, render_commands, 1.0f, SIM_DT*HEADLESS_TICKS_PER_FRAME);
+            Render_Stats stats = get_render_stats(render_commands);
+            accumulate_render_stats(render_totals, &stats);
+        }
+        
+        Entity_Store* store = &state->entities;
+        if (store->health[get_entity_index(store, state->boss_enemy)] <= 0) {
+            *tick_count = tick + 1;
+            return Outcome_Player_Won;
+        }
+        
+        if (store->health[get_entity_index(store, state->player)] <= 0) {
+            *tick_count = tick + 1;
+            return Outcome_Dragon_Won;
+        }
+    }
+    
+    *tick_count = HEADLESS_MAX_TICKS;
+    return Outcome_Draw;
+}
+
+int
+main(int argc, char** argv) {
+    bool render = argc > 1 && strcmp(argv[1], "-render") == 0;
+    if (render) {
+        argc--;
+        argv++;
+    }
+    
+    int match_count = argc > 1 ? atoi(argv[1]) : 100;
+    u32 seed = argc > 2 ? (u32) atoi(argv[2]) : 1;
+    int max_batches = argc > 3 ? atoi(argv[3]) : 0;
+    render = render || max_batches > 0;
+    srand(seed);
+    
+    Game_State game_state = {};
+    Game_State* state = &game_state;
+    state->jobs = init_job_system(get_processor_count() - 1);
+    init_render_view(state);
+    init_simulation(state);
+    
+    Render_Command_Buffer render_commands = {};
+    Render_Totals render_totals = {};
+    
+    int outcomes[3] = {};
+    s64 total_ticks = 0;
+    
+    clock_t begin = clock();
+    for (int match = 0; match < match_count; match++) {
+        int tick_count = 0;
+        Match_Outcome outcome = run_match(state, render ? &render_commands : 0, &render_totals, &tick_count);
+        outcomes[outcome]++;
+        total_ticks += tick_count;
+    }
+    f64 elapsed = (f64) (clock() - begin) / CLOCKS_PER_SEC;
+    
+    printf("matches:     %d (seed %u)\n", match_count, seed);
+    printf("dragon won:  %d\n", outcomes[Outcome_Dragon_Won]);
+    printf("player won:  %d\n", outcomes[Outcome_Player_Won]);
+    printf("draw:        %d\n", outcomes[Outcome_Draw]);
+    if (match_count > 0) {
+        printf("avg length:  %.2f s\n", (f64) total_ticks*SIM_DT/match_count);
+    }
+    printf("elapsed:     %.3f s (%.0f matches/s)\n", elapsed,
+           elapsed > 0.0 ? match_count/elapsed : 0.0);
+    
+    if (render_totals.frame_count > 0) {
+        f64 frame_count = (f64) render_totals.frame_count;
+        printf("render cmds: %.1f avg, %d max per frame\n",
+               render_totals.command_count/frame_count, render_totals.max_command_count);
+        printf("batches:     %.1f avg, %d max per frame\n",
+               render_totals.batch_count/frame_count, render_totals.max_batch_count);
+        
+        cstring type_names[Render_Command_Type_Count] = {
+            "sprite", "tile chunk", "rect", "circle", "line", "text", "particles"
+        };
+        printf("per frame:  ");
+        for (int i = 0; i < Render_Command_Type_Count; i++) {
+            printf(" %s %.1f", type_names[i], render_totals.type_counts[i]/frame_count);
+        }
+        printf("\n");
+    }
+    
+#if ARENA_STATS
+    Arena_Stats level_arena_stats = get_arena_stats(&state->level_arena);
+    Arena_Stats scratch_arena_stats = get_arena_stats(get_scratch_arena());
+    Arena_Stats permanent_arena_stats = get_arena_stats(&state->permanent_arena);
+    print_arena_stats("permanent arena", &permanent_arena_stats);
+    print_arena_stats("level arena", &level_arena_stats);
+    print_arena_stats("scratch arena", &scratch_arena_stats);
+#endif
+    
+    free_job_system(state->jobs);
+    
+    if (max_batches > 0 && render_totals.max_batch_count > max_batches) {
+        printf("FAILED: %d batches in a frame, the limit is %d\n", render_totals.max_batch_count, max_batches);
+        return 1;
+    }
+    
+    return 0;
+}
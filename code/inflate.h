@@ -0,0 +1,405 @@
+// NOTE(Alexander): small DEFLATE (RFC 1951) decoder for compressed tmx layers, decodes
+// canonical huffman codes the same way as zlib's puff.c but with a lookup table for the
+// short codes. Output goes into a buffer the caller sized up front and nothing is allocated,
+// so it works in the headless build too.
+// zlib (RFC 1950) and gzip (RFC 1952) streams are unwrapped by the helpers at the bottom,
+// their checksums aren't verified.
+
+#define INFLATE_MAX_BITS 15
+#define INFLATE_MAX_LENGTH_CODES 286
+#define INFLATE_MAX_DISTANCE_CODES 30
+#define INFLATE_FIXED_LENGTH_CODES 288
+#define INFLATE_FAST_BITS 9 // NOTE(Alexander): codes up to this long are decoded with one lookup
+
+struct Inflate_Huffman {
+    s16 counts[INFLATE_MAX_BITS + 1]; // NOTE(Alexander): number of codes of each length
+    s16 symbols[INFLATE_FIXED_LENGTH_CODES]; // NOTE(Alexander): symbols ordered by code
+    
+    // NOTE(Alexander): indexed by the next INFLATE_FAST_BITS bits of input, symbol << 4 | code
+    // length or zero if the code is longer than that
+    u16 fast[1 << INFLATE_FAST_BITS];
+};
+
+struct Inflate_State {
+    u8* out;
+    umm out_size;
+    umm out_count;
+    
+    u8* in;
+    umm in_size;
+    umm in_count;
+    
+    u32 bit_buffer;
+    s32 bit_count;
+    
+    bool error; // NOTE(Alexander): corrupt data, ran out of input or the output didn't fit
+};
+
+const s16 inflate_length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const s16 inflate_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+const s16 inflate_distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+const s16 inflate_distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// NOTE(Alexander): tops the bit buffer up to at least 25 bits, unless the input runs out
+inline void
+inflate_refill(Inflate_State* state) {
+    while (state->bit_count <= 24 && state->in_count < state->in_size) {
+        state->bit_buffer |= (u32) state->in[state->in_count++] << state->bit_count;
+        state->bit_count += 8;
+    }
+}
+
+inline u32
+inflate_bits(Inflate_State* state, s32 count) {
+    u32 value = state->bit_buffer;
+    while (state->bit_count < count) {
+        if (state->in_count == state->in_size) {
+            state->error = true;
+            return 0;
+        }
+        value |= (u32) state->in[state->in_count++] << state->bit_count;
+        state->bit_count += 8;
+    }
+    
+    state->bit_buffer = value >> count;
+    state->bit_count -= count;
+    return value & ((1u << count) - 1);
+}
+
+// NOTE(Alexander): returns false if the lengths describe an over-subscribed code,
+// incomplete codes are fine (e.g. a block with a single distance code).
+bool
+build_inflate_huffman(Inflate_Huffman* huffman, s16* lengths, s32 count) {
+    memset(huffman->counts, 0, sizeof(huffman->counts));
+    for (s32 symbol = 0; symbol < count; symbol++) {
+        huffman->counts[lengths[symbol]]++;
+    }
+    if (huffman->counts[0] == count) {
+        return true;
+    }
+    
+    s32 left = 1;
+    for (s32 length = 1; length <= INFLATE_MAX_BITS; length++) {
+        left <<= 1;
+        left -= huffman->counts[length];
+        if (left < 0) {
+            return false;
+        }
+    }
+    
+    s16 offsets[INFLATE_MAX_BITS + 1];
+    offsets[1] = 0;
+    for (s32 length = 1; length < INFLATE_MAX_BITS; length++) {
+        offsets[length + 1] = (s16) (offsets[length] + huffman->counts[length]);
+    }
+    for (s32 symbol = 0; symbol < count; symbol++) {
+        if (lengths[symbol] != 0) {
+            huffman->symbols[offsets[lengths[symbol]]++] = (s16) symbol;
+        }
+    }
+    
+    // NOTE(Alexander): codes are stored first bit first, so the table is indexed by the
+    // reversed code and every entry whose low bits match the code gets the symbol
+    memset(huffman->fast, 0, sizeof(huffman->fast));
+    s32 code = 0;
+    s32 index = 0;
+    for (s32 length = 1; length <= INFLATE_FAST_BITS; length++) {
+        for (s32 i = 0; i < huffman->counts[length]; i++) {
+            s32 reversed = 0;
+            for (s32 bit = 0; bit < length; bit++) {
+                reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+            }
+            
+            u16 entry = (u16) ((huffman->symbols[index] << 4) | length);
+            for (s32 j = reversed; j < (1 << INFLATE_FAST_BITS); j += 1 << length) {
+                huffman->fast[j] = entry;
+            }
+            code++;
+            index++;
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+// NOTE(Alexander): codes are read a bit at a time, canonical codes of the same length are
+// consecutive so only the first code and count per length are needed.
+s32
+inflate_decode(Inflate_State* state, Inflate_Huffman* huffman) {
+    inflate_refill(state);
+    u16 entry = huffman->fast[state->bit_buffer & ((1 << INFLATE_FAST_BITS) - 1)];
+    s32 entry_length = entry & 0xF;
+    if (entry && entry_length <= state->bit_count) {
+        state->bit_buffer >>= entry_length;
+        state->bit_count -= entry_length;
+        return entry >> 4;
+    }
+    
+    s32 code = 0;
+    s32 first = 0;
+    s32 index = 0;
+    for (s32 length = 1; length <= INFLATE_MAX_BITS; length++) {
+        code |= inflate_bits(state, 1);
+        s32 count = huffman->counts[length];
+        if (code - count < first) {
+            return huffman->symbols[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    
+    state->error = true;
+    return -1;
+}
+
+void
+inflate_stored_block(Inflate_State* state) {
+    // NOTE(Alexander): stored blocks start at the next byte boundary, whole bytes that were
+    // already pulled into the bit buffer go back to the input
+    state->in_count -= state->bit_count/8;
+    state->bit_buffer = 0;
+    state->bit_count = 0;
+    
+    if (state->in_count + 4 > state->in_size) {
+        state->error = true;
+        return;
+    }
+    
+    u8* in = state->in + state->in_count;
+    umm length = in[0] | (in[1] << 8);
+    umm inverted_length = in[2] | (in[3] << 8);
+    state->in_count += 4;
+    if (length != (~inverted_length & 0xFFFF) ||
+        state->in_count + length > state->in_size ||
+        state->out_count + length > state->out_size) {
+        state->error = true;
+        return;
+    }
+    
+    memcpy(state->out + state->out_count, state->in + state->in_count, length);
+    state->in_count += length;
+    state->out_count += length;
+}
+
+void
+inflate_codes(Inflate_State* state, Inflate_Huffman* length_code, Inflate_Huffman* distance_code) {
+    while (!state->error) {
+        s32 symbol = inflate_decode(state, length_code);
+        if (symbol < 0) {
+            return;
+        }
+        
+        if (symbol < 256) {
+            if (state->out_count == state->out_size) {
+                state->error = true;
+                return;
+            }
+            state->out[state->out_count++] = (u8) symbol;
+            
+        } else if (symbol == 256) {
+            return;
+            
+        } else {
+            symbol -= 257;
+            if (symbol >= 29) {
+                state->error = true;
+                return;
+            }
+            umm length = inflate_length_base[symbol] + inflate_bits(state, inflate_length_extra[symbol]);
+            
+            s32 distance_symbol = inflate_decode(state, distance_code);
+            if (distance_symbol < 0 || distance_symbol >= 30) {
+                state->error = true;
+                return;
+            }
+            umm distance = (inflate_distance_base[distance_symbol] +
+                            inflate_bits(state, inflate_distance_extra[distance_symbol]));
+            if (distance > state->out_count || state->out_count + length > state->out_size) {
+                state->error = true;
+                return;
+            }
+            
+            // NOTE(Alexander): the match may overlap itself (runs), everything between src and
+            // dest repeats so each copy can be as long as everything copied so far
+            u8* dest = state->out + state->out_count;
+            u8* src = dest - distance;
+            state->out_count += length;
+            while (length > 0) {
+                umm chunk = (umm) (dest - src);
+                if (chunk > length) {
+                    chunk = length;
+                }
+                memcpy(dest, src, chunk);
+                dest += chunk;
+                length -= chunk;
+            }
+        }
+    }
+}
+
+void
+inflate_fixed_block(Inflate_State* state) {
+    s16 lengths[INFLATE_FIXED_LENGTH_CODES + INFLATE_MAX_DISTANCE_CODES];
+    s32 symbol = 0;
+    for (; symbol < 144; symbol++) lengths[symbol] = 8;
+    for (; symbol < 256; symbol++) lengths[symbol] = 9;
+    for (; symbol < 280; symbol++) lengths[symbol] = 7;
+    for (; symbol < INFLATE_FIXED_LENGTH_CODES; symbol++) lengths[symbol] = 8;
+    for (s32 i = 0; i < INFLATE_MAX_DISTANCE_CODES; i++) lengths[symbol + i] = 5;
+    
+    Inflate_Huffman length_code;
+    Inflate_Huffman distance_code;
+    build_inflate_huffman(&length_code, lengths, INFLATE_FIXED_LENGTH_CODES);
+    build_inflate_huffman(&distance_code, lengths + INFLATE_FIXED_LENGTH_CODES, INFLATE_MAX_DISTANCE_CODES);
+    inflate_codes(state, &length_code, &distance_code);
+}
+
+void
+inflate_dynamic_block(Inflate_State* state) {
+    static const u8 code_length_order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    
+    s32 length_count = inflate_bits(state, 5) + 257;
+    s32 distance_count = inflate_bits(state, 5) + 1;
+    s32 code_length_count = inflate_bits(state, 4) + 4;
+    if (length_count > INFLATE_MAX_LENGTH_CODES || distance_count > INFLATE_MAX_DISTANCE_CODES) {
+        state->error = true;
+        return;
+    }
+    
+    s16 lengths[INFLATE_MAX_LENGTH_CODES + INFLATE_MAX_DISTANCE_CODES] = {};
+    for (s32 i = 0; i < code_length_count; i++) {
+        lengths[code_length_order[i]] = (s16) inflate_bits(state, 3);
+    }
+    
+    Inflate_Huffman length_code;
+    Inflate_Huffman distance_code;
+    if (!build_inflate_huffman(&length_code, lengths, 19)) {
+        state->error = true;
+        return;
+    }
+    
+    // NOTE(Alexander): the literal/length and distance code lengths are run length encoded
+    s32 index = 0;
+    while (index < length_count + distance_count && !state->error) {
+        s32 symbol = inflate_decode(state, &length_code);
+        if (symbol < 0) {
+            return;
+        }
+        
+        if (symbol < 16) {
+            lengths[index++] = (s16) symbol;
+            continue;
+        }
+        
+        s16 length = 0;
+        s32 repeat;
+        if (symbol == 16) {
+            if (index == 0) {
+                state->error = true;
+                return;
+            }
+            length = lengths[index - 1];
+            repeat = 3 + inflate_bits(state, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + inflate_bits(state, 3);
+        } else {
+            repeat = 11 + inflate_bits(state, 7);
+        }
+        
+        if (index + repeat > length_count + distance_count) {
+            state->error = true;
+            return;
+        }
+        while (repeat--) {
+            lengths[index++] = length;
+        }
+    }
+    
+    if (state->error || lengths[256] == 0 ||
+        !build_inflate_huffman(&length_code, lengths, length_count) ||
+        !build_inflate_huffman(&distance_code, lengths + length_count, distance_count)) {
+        state->error = true;
+        return;
+    }
+    inflate_codes(state, &length_code, &distance_code);
+}
+
+// NOTE(Alexander): decompresses a raw deflate stream, returns the decompressed size or -1
+// if the data is corrupt or doesn't fit in out_size bytes.
+smm
+decompress_deflate(u8* out, umm out_size, u8* in, umm in_size) {
+    Inflate_State state = {};
+    state.out = out;
+    state.out_size = out_size;
+    state.in = in;
+    state.in_size = in_size;
+    
+    u32 last = 0;
+    while (!last && !state.error) {
+        last = inflate_bits(&state, 1);
+        u32 type = inflate_bits(&state, 2);
+        switch (type) {
+            case 0: inflate_stored_block(&state); break;
+            case 1: inflate_fixed_block(&state); break;
+            case 2: inflate_dynamic_block(&state); break;
+            default: state.error = true; break;
+        }
+    }
+    
+    return state.error ? -1 : (smm) state.out_count;
+}
+
+smm
+decompress_zlib(u8* out, umm out_size, u8* in, umm in_size) {
+    // NOTE(Alexander): 2 byte header, deflate method and no preset dictionary
+    if (in_size < 6 || (in[0] & 0x0F) != 8 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20)) {
+        return -1;
+    }
+    return decompress_deflate(out, out_size, in + 2, in_size - 2);
+}
+
+smm
+decompress_gzip(u8* out, umm out_size, u8* in, umm in_size) {
+    if (in_size < 18 || in[0] != 0x1F || in[1] != 0x8B || in[2] != 8) {
+        return -1;
+    }
+    
+    // NOTE(Alexander): skip the optional header fields
+    u8 flags = in[3];
+    umm offset = 10;
+    if (flags & 0x04) {
+        if (offset + 2 > in_size) return -1;
+        offset += 2 + (in[offset] | (in[offset + 1] << 8));
+    }
+    if (flags & 0x08) { // NOTE(Alexander): zero terminated file name
+        while (offset < in_size && in[offset]) offset++;
+        offset++;
+    }
+    if (flags & 0x10) { // NOTE(Alexander): zero terminated comment
+        while (offset < in_size && in[offset]) offset++;
+        offset++;
+    }
+    if (flags & 0x02) {
+        offset += 2;
+    }
+    if (offset >= in_size) {
+        return -1;
+    }
+    return decompress_deflate(out, out_size, in + offset, in_size - offset);
+}
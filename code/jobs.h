@@ -0,0 +1,290 @@
+// NOTE(Alexander): small work-stealing job system. Every thread that pushes or runs jobs has
+// its own queue, the owner pushes and pops at the bottom (newest first) while idle threads
+// steal the oldest job from the top of other queues. Jobs decrement their Job_Counter when
+// done and waiting on a counter runs other jobs instead of blocking, so jobs can wait too.
+// Without worker threads (web build) every job runs right away on the pushing thread.
+
+#define MAX_JOB_WORKERS 15
+#define MAX_JOB_QUEUES (MAX_JOB_WORKERS + 4) // NOTE(Alexander): room for the main and simulation threads
+#define JOB_QUEUE_SIZE 1024 // NOTE(Alexander): has to be a power of two
+#define MAX_PARALLEL_FOR_BATCHES 64
+
+typedef void Job_Proc(void* data);
+
+struct Job_Counter {
+    volatile s32 value;
+};
+
+struct Job {
+    Job_Proc* proc;
+    void* data;
+    Job_Counter* counter; // NOTE(Alexander): decremented when the job is done, may be null
+    Job_Counter* dependency; // NOTE(Alexander): the job doesn't start before this reaches zero, may be null
+};
+
+struct Job_Queue {
+    Spin_Lock lock;
+    s32 top; // NOTE(Alexander): oldest job, thieves take from here
+    s32 bottom; // NOTE(Alexander): one past the newest job, the owner pushes and pops here
+    Job jobs[JOB_QUEUE_SIZE];
+};
+
+struct Job_System {
+    Job_Queue queues[MAX_JOB_QUEUES];
+    volatile s32 queue_count;
+    
+#if HAS_THREADS
+    Thread workers[MAX_JOB_WORKERS];
+    Semaphore work_available;
+#endif
+    s32 worker_count;
+    volatile s32 quit;
+};
+
+// NOTE(Alexander): queue of the calling thread, assigned the first time a thread touches the
+// job system. There is only ever one job system so this doesn't have to be per system.
+thread_local s32 job_queue_index = -1;
+
+Job_Queue*
+get_job_queue(Job_System* system) {
+    if (job_queue_index == -1) {
+        job_queue_index = atomic_add_s32(&system->queue_count, 1) - 1;
+        assert(job_queue_index < MAX_JOB_QUEUES && "too many threads are using the job system");
+    }
+    return &system->queues[job_queue_index];
+}
+
+inline void
+run_job(Job_System* system, Job* job) {
+    job->proc(job->data);
+    if (job->counter) {
+        if (atomic_add_s32(&job->counter->value, -1) == 0) {
+#if HAS_THREADS
+            // NOTE(Alexander): wake someone up to retry jobs that were waiting on this counter
+            if (system->worker_count > 0) {
+                signal_semaphore(&system->work_available);
+            }
+#endif
+        }
+    }
+}
+
+bool
+pop_job(Job_Queue* queue, Job* job) {
+    bool result = false;
+    lock_spin_lock(&queue->lock);
+    if (queue->bottom != queue->top) {
+        queue->bottom--;
+        *job = queue->jobs[queue->bottom & (JOB_QUEUE_SIZE - 1)];
+        result = true;
+    }
+    unlock_spin_lock(&queue->lock);
+    return result;
+}
+
+bool
+steal_job(Job_Queue* queue, Job* job) {
+    bool result = false;
+    lock_spin_lock(&queue->lock);
+    if (queue->bottom != queue->top) {
+        *job = queue->jobs[queue->top & (JOB_QUEUE_SIZE - 1)];
+        queue->top++;
+        result = true;
+    }
+    unlock_spin_lock(&queue->lock);
+    return result;
+}
+
+// NOTE(Alexander): puts a job that isn't ready yet back at the top, so it is the last
+// thing the owner picks up again.
+void
+requeue_job(Job_Queue* queue, Job* job) {
+    lock_spin_lock(&queue->lock);
+    assert(queue->bottom - queue->top < JOB_QUEUE_SIZE);
+    queue->top--;
+    queue->jobs[queue->top & (JOB_QUEUE_SIZE - 1)] = *job;
+    unlock_spin_lock(&queue->lock);
+}
+
+// NOTE(Alexander): runs one job from our own queue or steals one, returns false if there
+// was nothing that could run.
+bool
+try_run_job(Job_System* system) {
+    Job_Queue* queue = get_job_queue(system);
+    
+    Job job;
+    bool found = pop_job(queue, &job);
+    if (!found) {
+        s32 queue_count = atomic_load_s32(&system->queue_count);
+        if (queue_count > MAX_JOB_QUEUES) queue_count = MAX_JOB_QUEUES;
+        for (s32 i = 1; i < queue_count && !found; i++) {
+            found = steal_job(&system->queues[(job_queue_index + i) % queue_count], &job);
+        }
+    }
+    
+    if (!found) {
+        return false;
+    }
+    
+    if (job.dependency && atomic_load_s32(&job.dependency->value) > 0) {
+        requeue_job(queue, &job);
+        return false;
+    }
+    
+    run_job(system, &job);
+    return true;
+}
+
+// NOTE(Alexander): helps out with other jobs until the counter reaches zero
+void
+wait_for_counter(Job_System* system, Job_Counter* counter) {
+    if (!counter) return;
+    
+    while (atomic_load_s32(&counter->value) > 0) {
+        if (!try_run_job(system)) {
+            cpu_relax();
+        }
+    }
+}
+
+void
+push_job(Job_System* system, Job_Proc* proc, void* data, Job_Counter* counter=0, Job_Counter* dependency=0) {
+    Job job;
+    job.proc = proc;
+    job.data = data;
+    job.counter = counter;
+    job.dependency = dependency;
+    
+    if (counter) {
+        atomic_add_s32(&counter->value, 1);
+    }
+    
+#if HAS_THREADS
+    if (system->worker_count > 0) {
+        Job_Queue* queue = get_job_queue(system);
+        bool pushed = false;
+        lock_spin_lock(&queue->lock);
+        if (queue->bottom - queue->top < JOB_QUEUE_SIZE) {
+            queue->jobs[queue->bottom & (JOB_QUEUE_SIZE - 1)] = job;
+            queue->bottom++;
+            pushed = true;
+        }
+        unlock_spin_lock(&queue->lock);
+        
+        if (pushed) {
+            signal_semaphore(&system->work_available);
+            return;
+        }
+    }
+#endif
+    
+    // NOTE(Alexander): no workers or our queue is full, run it right here
+    wait_for_counter(system, dependency);
+    run_job(system, &job);
+}
+
+typedef void Parallel_For_Proc(void* data, s32 begin, s32 end);
+
+struct Parallel_For_Batch {
+    Parallel_For_Proc* proc;
+    void* data;
+    s32 begin;
+    s32 end;
+};
+
+void
+run_parallel_for_batch(void* data) {
+    Parallel_For_Batch* batch = (Parallel_For_Batch*) data;
+    batch->proc(batch->data, batch->begin, batch->end);
+}
+
+// NOTE(Alexander): calls proc on [begin, end) ranges of at least batch_size elements covering
+// [0, count) and returns when all of them are done. Small counts run inline on the caller,
+// so it is cheap to use on loops that are usually small.
+void
+parallel_for(Job_System* system, s32 count, s32 batch_size, Parallel_For_Proc* proc, void* data) {
+    if (count <= 0) return;
+    
+    if (count <= batch_size || system->worker_count == 0) {
+        proc(data, 0, count);
+        return;
+    }
+    
+    s32 batch_count = (count + batch_size - 1)/batch_size;
+    if (batch_count > MAX_PARALLEL_FOR_BATCHES) {
+        batch_count = MAX_PARALLEL_FOR_BATCHES;
+        batch_size = (count + batch_count - 1)/batch_count;
+    }
+    
+    Parallel_For_Batch batches[MAX_PARALLEL_FOR_BATCHES];
+    Job_Counter counter = {};
+    for (s32 i = 0; i < batch_count; i++) {
+        Parallel_For_Batch* batch = &batches[i];
+        batch->proc = proc;
+        batch->data = data;
+        batch->begin = i*batch_size;
+        batch->end = batch->begin + batch_size < count ? batch->begin + batch_size : count;
+        
+        // NOTE(Alexander): the first batch is run by the caller after pushing the rest
+        if (i > 0 && batch->begin < batch->end) {
+            push_job(system, run_parallel_for_batch, batch, &counter);
+        }
+    }
+    
+    run_parallel_for_batch(&batches[0]);
+    wait_for_counter(system, &counter);
+}
+
+#if HAS_THREADS
+void
+job_worker_proc(void* data) {
+    Job_System* system = (Job_System*) data;
+    get_job_queue(system);
+    
+    while (!atomic_load_s32(&system->quit)) {
+        if (!try_run_job(system)) {
+            wait_semaphore(&system->work_available);
+        }
+    }
+}
+#endif
+
+// NOTE(Alexander): the calling thread doesn't count as a worker but runs jobs while it waits,
+// worker_count is clamped to MAX_JOB_WORKERS and ignored without thread support.
+Job_System*
+init_job_system(s32 worker_count) {
+    Job_System* system = (Job_System*) calloc(1, sizeof(Job_System));
+    get_job_queue(system);
+    
+#if HAS_THREADS
+    init_semaphore(&system->work_available, 0);
+    if (worker_count < 0) worker_count = 0;
+    if (worker_count > MAX_JOB_WORKERS) worker_count = MAX_JOB_WORKERS;
+    
+    system->worker_count = worker_count;
+    for (s32 i = 0; i < worker_count; i++) {
+        if (!create_thread(&system->workers[i], job_worker_proc, system)) {
+            pln("Failed to create job worker thread");
+            system->worker_count = i;
+            break;
+        }
+    }
+#endif
+    
+    return system;
+}
+
+void
+free_job_system(Job_System* system) {
+#if HAS_THREADS
+    atomic_store_s32(&system->quit, 1);
+    for (s32 i = 0; i < system->worker_count; i++) {
+        signal_semaphore(&system->work_available);
+    }
+    for (s32 i = 0; i < system->worker_count; i++) {
+        join_thread(&system->workers[i]);
+    }
+    free_semaphore(&system->work_available);
+#endif
+    free(system);
+}
@@ -0,0 +1,419 @@
+// NOTE(Alexander): open world levels are too big to keep in memory, so the cooker splits their
+// tile layers into LEVEL_STREAM_CHUNK_SIZE chunks and writes them to an indexed stream file.
+// The game maps the file and keeps a fixed number of chunks resident around the camera, the
+// ones coming into view are copied out of the mapping on the job system and the least recently
+// used ones are evicted to make room. Copying out of the mapping is what does the actual disk
+// reads, so that happens on the workers and the OS is free to drop the clean pages again.
+// The level colliders are rasterized into each chunk as it loads, so collision only ever
+// looks at resident chunks, and the renderer bakes each chunk once into its slot's texture.
+//
+// File layout: Level_Stream_Header, the index (one entry per chunk, row major) and the chunk
+// records. A record is Level_File_Tile_Layer[tile_layer_count], with offsets from the start
+// of the record, followed by the packed tiles and flips of each layer. Chunks without any
+// tiles have no record, colliders over those are tested directly.
+
+#define LEVEL_STREAM_MAGIC 0x5453564C // NOTE(Alexander): "LVST" when read as bytes
+#define LEVEL_STREAM_VERSION 1
+#define LEVEL_STREAM_RECORD_ALIGNMENT 8
+
+struct Level_Stream_Header {
+    u32 magic;
+    u32 version;
+    u32 file_size;
+    
+    u32 index_offset; // NOTE(Alexander): Level_Stream_Index_Entry[chunk_count_x*chunk_count_y]
+    u32 max_record_size; // NOTE(Alexander): size of every slot in the chunk cache
+    
+    s32 chunk_size; // NOTE(Alexander): tiles along each side of a chunk
+    s32 chunk_count_x;
+    s32 chunk_count_y;
+    s32 tile_map_width;
+    s32 tile_map_height;
+    s32 tile_width;
+    s32 tile_height;
+    s32 tile_layer_count;
+};
+
+struct Level_Stream_Index_Entry {
+    u32 offset;
+    u32 size; // NOTE(Alexander): 0 if the chunk is empty
+};
+
+// NOTE(Alexander): writes the tiles of the level as a chunk stream, objects aren't included
+// since they have to be around even when their part of the map isn't.
+bool
+write_level_stream(cstring filename, Loaded_Tmx* tmx) {
+    Level_Stream_Header header = {};
+    header.magic = LEVEL_STREAM_MAGIC;
+    header.version = LEVEL_STREAM_VERSION;
+    header.chunk_size = LEVEL_STREAM_CHUNK_SIZE;
+    header.chunk_count_x = (tmx->tile_map_width + LEVEL_STREAM_CHUNK_SIZE - 1)/LEVEL_STREAM_CHUNK_SIZE;
+    header.chunk_count_y = (tmx->tile_map_height + LEVEL_STREAM_CHUNK_SIZE - 1)/LEVEL_STREAM_CHUNK_SIZE;
+    header.tile_map_width = tmx->tile_map_width;
+    header.tile_map_height = tmx->tile_map_height;
+    header.tile_width = tmx->tile_width;
+    header.tile_height = tmx->tile_height;
+    header.tile_layer_count = tmx->layer_count;
+    
+    s32 chunk_count = header.chunk_count_x*header.chunk_count_y;
+    umm index_size = chunk_count*sizeof(Level_Stream_Index_Entry);
+    header.index_offset = (u32) align_forward(sizeof(Level_Stream_Header), LEVEL_STREAM_RECORD_ALIGNMENT);
+    
+    umm capacity = header.index_offset + index_size + megabytes(1);
+    u8* contents = (u8*) calloc(1, capacity);
+    umm size = align_forward(header.index_offset + index_size, LEVEL_STREAM_RECORD_ALIGNMENT);
+    
+    // NOTE(Alexander): every chunk is packed on its own, so a chunk only pays for the
+    // largest gid and the flips it actually has
+    s32 tiles_per_chunk = LEVEL_STREAM_CHUNK_SIZE*LEVEL_STREAM_CHUNK_SIZE;
+    Temporary_Memory temp = begin_temp(get_scratch_arena());
+    u32* gids = push_array_of_structs(temp.arena, tiles_per_chunk, u32, Arena_Tag_Tile_Layer);
+    
+    for (s32 chunk_index = 0; chunk_index < chunk_count; chunk_index++) {
+        s32 min_x = (chunk_index % header.chunk_count_x)*LEVEL_STREAM_CHUNK_SIZE;
+        s32 min_y = (chunk_index / header.chunk_count_x)*LEVEL_STREAM_CHUNK_SIZE;
+        
+        Temporary_Memory chunk_temp = begin_temp(temp.arena);
+        Tile_Layer layers[MAX_TILE_LAYERS] = {};
+        bool is_empty = true;
+        for (s32 layer_index = 0; layer_index < tmx->layer_count; layer_index++) {
+            Tile_Layer* layer = &tmx->layers[layer_index];
+            for (s32 y = 0; y < LEVEL_STREAM_CHUNK_SIZE; y++) {
+                for (s32 x = 0; x < LEVEL_STREAM_CHUNK_SIZE; x++) {
+                    u32 gid = 0;
+                    if (min_x + x < tmx->tile_map_width && min_y + y < tmx->tile_map_height) {
+                        s32 index = (min_y + y)*tmx->tile_map_width + min_x + x;
+                        gid = get_tile(layer, index) | get_tile_flips(layer, index);
+                    }
+                    gids[y*LEVEL_STREAM_CHUNK_SIZE + x] = gid;
+                }
+            }
+            pack_tile_layer(&layers[layer_index], gids, tiles_per_chunk, chunk_temp.arena);
+            is_empty = is_empty && layers[layer_index].max_gid == 0;
+        }
+        
+        if (is_empty) {
+            end_temp(chunk_temp);
+            continue;
+        }
+        
+        Level_File_Tile_Layer record_layers[MAX_TILE_LAYERS] = {};
+        umm record_size = tmx->layer_count*sizeof(Level_File_Tile_Layer);
+        for (s32 layer_index = 0; layer_index < tmx->layer_count; layer_index++) {
+            Tile_Layer* layer = &layers[layer_index];
+            record_layers[layer_index].element_size = layer->element_size;
+            record_layers[layer_index].max_gid = layer->max_gid;
+            record_size = align_forward(record_size, sizeof(u32));
+            record_layers[layer_index].tiles_offset = (u32) record_size;
+            record_size += tiles_per_chunk*layer->element_size;
+            if (layer->flips) {
+                record_layers[layer_index].flips_offset = (u32) record_size;
+                record_size += tiles_per_chunk;
+            }
+        }
+        
+        // NOTE(Alexander): room for the padding after the record as well
+        umm next_size = align_forward(size + record_size, LEVEL_STREAM_RECORD_ALIGNMENT);
+        if (next_size > capacity) {
+            umm new_capacity = capacity*2 > next_size ? capacity*2 : next_size;
+            contents = (u8*) realloc(contents, new_capacity);
+            memset(contents + capacity, 0, new_capacity - capacity);
+            capacity = new_capacity;
+        }
+        
+        u8* record = contents + size;
+        memcpy(record, record_layers, tmx->layer_count*sizeof(Level_File_Tile_Layer));
+        for (s32 layer_index = 0; layer_index < tmx->layer_count; layer_index++) {
+            Tile_Layer* layer = &layers[layer_index];
+            memcpy(record + record_layers[layer_index].tiles_offset, layer->tiles, tiles_per_chunk*layer->element_size);
+            if (layer->flips) {
+                memcpy(record + record_layers[layer_index].flips_offset, layer->flips, tiles_per_chunk);
+            }
+        }
+        
+        Level_Stream_Index_Entry* entry = (Level_Stream_Index_Entry*) (contents + header.index_offset) + chunk_index;
+        entry->offset = (u32) size;
+        entry->size = (u32) record_size;
+        if (record_size > header.max_record_size) {
+            header.max_record_size = (u32) record_size;
+        }
+        size = next_size;
+        end_temp(chunk_temp);
+    }
+    end_temp(temp);
+    
+    header.file_size = (u32) size;
+    memcpy(contents, &header, sizeof(header));
+    
+    bool result = false;
+    FILE* file = fopen(filename, "wb");
+    if (file) {
+        result = fwrite(contents, 1, size, file) == size;
+        fclose(file);
+    }
+    free(contents);
+    
+    if (!result) {
+        pln("Failed to write level stream: %s", filename);
+    }
+    return result;
+}
+
+// NOTE(Alexander): runs on the job system, the slot was claimed by update_level_streamer and
+// isn't touched by anyone else until it is marked resident.
+void
+load_streamed_chunk(void* data) {
+    Streamed_Chunk* chunk = (Streamed_Chunk*) data;
+    Level_Streamer* streamer = chunk->streamer;
+    Level_Stream_Header* header = streamer->header;
+    Level_Stream_Index_Entry* entry = &streamer->index[chunk->chunk_y*header->chunk_count_x + chunk->chunk_x];
+    memcpy(chunk->data, streamer->file.data + entry->offset, entry->size);
+    chunk->data_size = entry->size;
+    
+    // NOTE(Alexander): same rules as init_solid_map, clipped to the chunk
+    s32 chunk_size = header->chunk_size;
+    s32 chunk_min_x = chunk->chunk_x*chunk_size;
+    s32 chunk_min_y = chunk->chunk_y*chunk_size;
+    memset(chunk->solid_bits, 0, sizeof(chunk->solid_bits));
+    for (s32 i = 0; i < streamer->collider_count; i++) {
+        s32 x0, y0, x1, y1;
+        get_collider_tiles(&streamer->colliders[i], &x0, &y0, &x1, &y1);
+        x0 = x0 < chunk_min_x ? 0 : x0 - chunk_min_x;
+        y0 = y0 < chunk_min_y ? 0 : y0 - chunk_min_y;
+        x1 = x1 > chunk_min_x + chunk_size ? chunk_size : x1 - chunk_min_x;
+        y1 = y1 > chunk_min_y + chunk_size ? chunk_size : y1 - chunk_min_y;
+        for (s32 y = y0; y < y1; y++) {
+            for (s32 x = x0; x < x1; x++) {
+                s32 index = y*chunk_size + x;
+                chunk->solid_bits[index >> 5] |= 1u << (index & 31);
+            }
+        }
+    }
+    
+    umm tiles_per_chunk = (umm) header->chunk_size*header->chunk_size;
+    Level_File_Tile_Layer* layers = (Level_File_Tile_Layer*) chunk->data;
+    chunk->layer_count = header->tile_layer_count;
+    for (s32 i = 0; i < header->tile_layer_count; i++) {
+        u32 element_size = layers[i].element_size;
+        bool valid = ((element_size == 1 || element_size == 2 || element_size == 4) &&
+                      layers[i].tiles_offset + tiles_per_chunk*element_size <= entry->size &&
+                      (layers[i].flips_offset == 0 || layers[i].flips_offset + tiles_per_chunk <= entry->size));
+        if (!valid) {
+            pln("Level stream has a corrupt chunk (%d, %d)", chunk->chunk_x, chunk->chunk_y);
+            chunk->layer_count = 0;
+            break;
+        }
+        
+        Tile_Layer* layer = &chunk->layers[i];
+        layer->tiles = chunk->data + layers[i].tiles_offset;
+        layer->flips = layers[i].flips_offset ? chunk->data + layers[i].flips_offset : 0;
+        layer->element_size = element_size;
+        layer->max_gid = layers[i].max_gid;
+    }
+    
+    atomic_store_s32(&chunk->state, Streamed_Chunk_Resident);
+}
+
+void
+close_level_streamer(Level_Streamer* streamer, Job_System* jobs) {
+    wait_for_counter(jobs, &streamer->pending);
+    unmap_file(&streamer->file);
+    free(streamer->chunk_memory);
+    *streamer = {};
+}
+
+// NOTE(Alexander): returns false if the file is missing or corrupt, the streamer stays closed then
+bool
+open_level_streamer(Level_Streamer* streamer, Job_System* jobs, cstring filename) {
+    close_level_streamer(streamer, jobs);
+    if (!map_file(&streamer->file, filename)) {
+        return false;
+    }
+    
+    Level_Stream_Header* header = (Level_Stream_Header*) streamer->file.data;
+    s64 chunk_count = 0;
+    bool valid = (streamer->file.size >= sizeof(Level_Stream_Header) &&
+                  header->magic == LEVEL_STREAM_MAGIC &&
+                  header->version == LEVEL_STREAM_VERSION &&
+                  header->file_size == streamer->file.size &&
+                  header->chunk_size == LEVEL_STREAM_CHUNK_SIZE &&
+                  header->chunk_count_x > 0 && header->chunk_count_y > 0 &&
+                  header->tile_layer_count >= 0 && header->tile_layer_count <= MAX_TILE_LAYERS);
+    if (valid) {
+        chunk_count = (s64) header->chunk_count_x*header->chunk_count_y;
+        valid = (header->index_offset % sizeof(u32) == 0 &&
+                 header->index_offset + chunk_count*sizeof(Level_Stream_Index_Entry) <= header->file_size);
+    }
+    
+    Level_Stream_Index_Entry* index = (Level_Stream_Index_Entry*) (streamer->file.data + header->index_offset);
+    for (s64 i = 0; valid && i < chunk_count; i++) {
+        valid = (index[i].size == 0 ||
+                 (index[i].size <= header->max_record_size &&
+                  index[i].size >= header->tile_layer_count*sizeof(Level_File_Tile_Layer) &&
+                  (umm) index[i].offset + index[i].size <= header->file_size));
+    }
+    
+    if (!valid) {
+        pln("Level stream is corrupt or outdated, re-run the cooker: %s", filename);
+        unmap_file(&streamer->file);
+        return false;
+    }
+    
+    streamer->header = header;
+    streamer->index = index;
+    streamer->chunk_memory = (u8*) malloc(LEVEL_STREAM_CACHE_SIZE*(umm) header->max_record_size);
+    for (s32 i = 0; i < LEVEL_STREAM_CACHE_SIZE; i++) {
+        Streamed_Chunk* chunk = &streamer->chunks[i];
+        chunk->streamer = streamer;
+        chunk->data = streamer->chunk_memory + i*(umm) header->max_record_size;
+    }
+    return true;
+}
+
+// NOTE(Alexander): also returns chunks that are still loading, check the state before use
+Streamed_Chunk*
+find_streamed_chunk(Level_Streamer* streamer, s32 chunk_x, s32 chunk_y) {
+    for (s32 i = 0; i < LEVEL_STREAM_CACHE_SIZE; i++) {
+        Streamed_Chunk* chunk = &streamer->chunks[i];
+        if (atomic_load_s32(&chunk->state) != Streamed_Chunk_Empty &&
+            chunk->chunk_x == chunk_x && chunk->chunk_y == chunk_y) {
+            return chunk;
+        }
+    }
+    return 0;
+}
+
+// NOTE(Alexander): chunks are only evicted by update_level_streamer, so the result stays valid
+// until then and this has to be called on the same thread.
+Streamed_Chunk*
+find_resident_streamed_chunk(Level_Streamer* streamer, s32 chunk_x, s32 chunk_y) {
+    Streamed_Chunk* chunk = streamer->last_found;
+    if (!chunk || chunk->chunk_x != chunk_x || chunk->chunk_y != chunk_y) {
+        chunk = find_streamed_chunk(streamer, chunk_x, chunk_y);
+    }
+    if (!chunk || atomic_load_s32(&chunk->state) != Streamed_Chunk_Resident) {
+        return 0;
+    }
+    
+    streamer->last_found = chunk;
+    return chunk;
+}
+
+bool
+is_streamed_collider_tile(Level_Streamer* streamer, s32 x, s32 y) {
+    for (s32 i = 0; i < streamer->collider_count; i++) {
+        s32 x0, y0, x1, y1;
+        get_collider_tiles(&streamer->colliders[i], &x0, &y0, &x1, &y1);
+        if (x >= x0 && y >= y0 && x < x1 && y < y1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// NOTE(Alexander): tiles of chunks that aren't resident (yet) are empty, so bodies far away
+// from the camera fall through the level. Colliders reaching outside of the map and colliders
+// over chunks without any tiles (those have no record in the stream) aren't part of any loaded
+// chunk, there are only a few of those so they are tested directly.
+bool
+is_streamed_tile_solid(Level_Streamer* streamer, s32 x, s32 y) {
+    Level_Stream_Header* header = streamer->header;
+    if (x < 0 || y < 0 || x >= header->tile_map_width || y >= header->tile_map_height) {
+        return is_streamed_collider_tile(streamer, x, y);
+    }
+    
+    s32 chunk_size = header->chunk_size;
+    s32 chunk_x = x/chunk_size;
+    s32 chunk_y = y/chunk_size;
+    if (streamer->index[chunk_y*header->chunk_count_x + chunk_x].size == 0) {
+        return is_streamed_collider_tile(streamer, x, y);
+    }
+    
+    Streamed_Chunk* chunk = find_resident_streamed_chunk(streamer, chunk_x, chunk_y);
+    if (!chunk) {
+        return false;
+    }
+    
+    s32 index = (y % chunk_size)*chunk_size + x % chunk_size;
+    return (chunk->solid_bits[index >> 5] >> (index & 31)) & 1;
+}
+
+void
+request_streamed_chunk(Level_Streamer* streamer, Job_System* jobs, s32 chunk_x, s32 chunk_y) {
+    Streamed_Chunk* chunk = find_streamed_chunk(streamer, chunk_x, chunk_y);
+    if (chunk) {
+        chunk->last_used = streamer->frame;
+        return;
+    }
+    
+    Level_Stream_Index_Entry* entry = &streamer->index[chunk_y*streamer->header->chunk_count_x + chunk_x];
+    if (entry->size == 0) {
+        return;
+    }
+    
+    // NOTE(Alexander): a free slot or else the one unused for the longest time, chunks that are
+    // loading or wanted this frame are never evicted
+    Streamed_Chunk* victim = 0;
+    for (s32 i = 0; i < LEVEL_STREAM_CACHE_SIZE; i++) {
+        Streamed_Chunk* candidate = &streamer->chunks[i];
+        s32 state = atomic_load_s32(&candidate->state);
+        if (state == Streamed_Chunk_Empty) {
+            victim = candidate;
+            break;
+        }
+        if (state == Streamed_Chunk_Resident &&
+            candidate->last_used != streamer->frame &&
+            (!victim || candidate->last_used < victim->last_used)) {
+            victim = candidate;
+        }
+    }
+    
+    if (!victim) {
+        // NOTE(Alexander): the view needs more chunks than LEVEL_STREAM_CACHE_SIZE
+        return;
+    }
+    
+    if (victim->state == Streamed_Chunk_Resident) {
+        streamer->evict_count++;
+    }
+    if (streamer->last_found == victim) {
+        streamer->last_found = 0;
+    }
+    streamer->load_count++;
+    
+    victim->chunk_x = chunk_x;
+    victim->chunk_y = chunk_y;
+    victim->last_used = streamer->frame;
+    victim->is_uploaded = false;
+    victim->layer_count = 0;
+    atomic_store_s32(&victim->state, Streamed_Chunk_Loading);
+    push_job(jobs, load_streamed_chunk, victim, &streamer->pending);
+}
+
+// NOTE(Alexander): call once per tick with the part of the world that is visible (in tiles),
+// the chunks in view are requested first so they win over the margin when the cache is full.
+void
+update_level_streamer(Level_Streamer* streamer, Job_System* jobs, v2 min_p, v2 max_p) {
+    Level_Stream_Header* header = streamer->header;
+    if (!header) return;
+    
+    streamer->frame++;
+    f32 chunk_size = (f32) header->chunk_size;
+    for (s32 pass = 0; pass < 2; pass++) {
+        s32 margin = pass*LEVEL_STREAM_MARGIN;
+        s32 min_x = (s32) floorf(min_p.x/chunk_size) - margin;
+        s32 min_y = (s32) floorf(min_p.y/chunk_size) - margin;
+        s32 max_x = (s32) floorf(max_p.x/chunk_size) + margin;
+        s32 max_y = (s32) floorf(max_p.y/chunk_size) + margin;
+        min_x = min_x < 0 ? 0 : min_x;
+        min_y = min_y < 0 ? 0 : min_y;
+        max_x = max_x >= header->chunk_count_x ? header->chunk_count_x - 1 : max_x;
+        max_y = max_y >= header->chunk_count_y ? header->chunk_count_y - 1 : max_y;
+        
+        for (s32 chunk_y = min_y; chunk_y <= max_y; chunk_y++) {
+            for (s32 chunk_x = min_x; chunk_x <= max_x; chunk_x++) {
+                request_streamed_chunk(streamer, jobs, chunk_x, chunk_y);
+            }
+        }
+    }
+}
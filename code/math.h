@@ -170,6 +170,14 @@ lerp(f32 a, f32 b, f32 t) {
     return a*(1.0f - t) + b*t;
 }
 
+inline v2
+lerp(v2 a, v2 b, f32 t) {
+    v2 result;
+    result.x = lerp(a.x, b.x, t);
+    result.y = lerp(a.y, b.y, t);
+    return result;
+}
+
 
 /***************************************************************************
  * 2D vector functions
@@ -8,6 +8,43 @@
 #define DEFAULT_ALIGNMENT (2*alignof(smm))
 #endif
 #define ARENA_DEFAULT_BLOCK_SIZE kilobytes(10)
+#define SCRATCH_ARENA_BLOCK_SIZE kilobytes(64)
+#define ARENA_COMMIT_SIZE kilobytes(64) // NOTE(Alexander): virtual arenas commit in steps of this, a multiple of the page size
+
+// NOTE(Alexander): arenas keep statistics in debug builds, define ARENA_STATS to override that
+#ifndef ARENA_STATS
+#define ARENA_STATS BUILD_DEBUG
+#endif
+
+#define POOL_DEFAULT_SLAB_COUNT 64
+#define POOL_POISON_BYTE 0xDD
+
+// NOTE(Alexander): freed pool elements are filled with POOL_POISON_BYTE and checked when they are
+// handed out again, catches writes through stale pointers. On in debug builds by default.
+#ifndef POOL_POISON
+#define POOL_POISON BUILD_DEBUG
+#endif
+
+// NOTE(Alexander): windows.h clashes with raylib, see thread.h. The web build has no
+// virtual memory so arenas stay with calloc blocks there.
+#if defined(_WIN32)
+#define VIRTUAL_MEMORY_WIN32 1
+extern "C" {
+    __declspec(dllimport) void* __stdcall VirtualAlloc(void* address, size_t size, unsigned long allocation_type, unsigned long protect);
+    __declspec(dllimport) int __stdcall VirtualFree(void* address, size_t size, unsigned long free_type);
+}
+
+#define WIN32_MEM_COMMIT 0x1000
+#define WIN32_MEM_RESERVE 0x2000
+#define WIN32_MEM_DECOMMIT 0x4000
+#define WIN32_MEM_RELEASE 0x8000
+#define WIN32_PAGE_NOACCESS 0x01
+#define WIN32_PAGE_READWRITE 0x04
+
+#elif !defined(PLATFORM_WEB)
+#define VIRTUAL_MEMORY_POSIX 1
+#include <sys/mman.h>
+#endif
 
 // TODO(Alexander): special asserts
 #define assert_enum(T, v) assert((v) > 0 && (v) < T##_Count && "enum value out of range")
@@ -25,14 +62,186 @@ align_forward(umm address, umm align) {
     return address;
 }
 
+// NOTE(Alexander): what an allocation is for, only used for the arena statistics
+enum Arena_Tag {
+    Arena_Tag_Untagged,
+    Arena_Tag_Tile_Layer,
+    Arena_Tag_Tile_Chunk,
+    Arena_Tag_Solid_Map,
+    Arena_Tag_Collider,
+    Arena_Tag_Entity_Spawn,
+    Arena_Tag_Level_Snapshot,
+    Arena_Tag_String,
+    Arena_Tag_Render_Sort,
+    Arena_Tag_Particle_System,
+    Arena_Tag_Count
+};
+
+cstring arena_tag_names[Arena_Tag_Count] = {
+    "untagged", "tile layer", "tile chunk", "solid map", "collider", "entity spawn",
+    "level snapshot", "string", "render sort", "particle system"
+};
+
+// NOTE(Alexander): used and size are what the arena holds right now, peaks and waste add up over
+// the lifetime of the arena. Per tag usage only goes down in clear, rewinds and temporary memory
+// don't know what they pop, so it is the total pushed since the last clear.
+struct Arena_Stats {
+    umm used; // NOTE(Alexander): over all blocks, alignment padding included
+    umm peak_used;
+    umm size; // NOTE(Alexander): blocks allocated by the arena or committed pages
+    umm peak_size;
+    s32 peak_block_count;
+    
+    s32 overflow_count; // NOTE(Alexander): pushes that didn't fit and started a new block
+    umm overflow_waste; // NOTE(Alexander): unused bytes left at the end of those blocks
+    umm alignment_waste;
+    
+    umm tag_used[Arena_Tag_Count];
+    s32 tag_push_count[Arena_Tag_Count];
+};
+
+// NOTE(Alexander): an arena either allocates calloc blocks as it goes, or (reserve_size != 0)
+// reserves one range of address space up front and commits pages of it as it grows, so the
+// memory never moves and nothing is left behind when it grows. size is the committed part then.
 struct Memory_Arena {
     u8* base;
     umm size;
     umm curr_used;
     umm prev_used;
     umm min_block_size;
+    
+    s32 block_count; // NOTE(Alexander): blocks allocated by the arena, a specific block isn't counted
+    s32 temp_count;
+    
+    umm reserve_size;
+    bool decommit_on_clear; // NOTE(Alexander): hands the pages back to the OS in clear
+    
+#if ARENA_STATS
+    Arena_Stats stats;
+#endif
+};
+
+// NOTE(Alexander): sits right before the base of every block the arena allocated and
+// remembers the block that was current before it, so the blocks form a chain.
+struct Memory_Block_Header {
+    u8* prev_base;
+    umm prev_size;
+    umm prev_used;
+    umm prev_prev_used;
+};
+
+inline Memory_Block_Header*
+get_block_header(u8* base) {
+    return (Memory_Block_Header*) base - 1;
+}
+
+// NOTE(Alexander): everything pushed since begin_temp is popped again by end_temp, including
+// any blocks allocated in the meantime. Scopes can nest but have to end in reverse order.
+struct Temporary_Memory {
+    Memory_Arena* arena;
+    u8* base;
+    umm used;
+    umm prev_used;
 };
 
+#if ARENA_STATS
+inline void
+add_arena_stats_size(Memory_Arena* arena, smm size) {
+    arena->stats.size += size;
+    if (arena->stats.size > arena->stats.peak_size) {
+        arena->stats.peak_size = arena->stats.size;
+    }
+}
+#endif
+
+// NOTE(Alexander): returns false without virtual memory (web build) or if the address space
+// can't be reserved, the arena is left as a regular block arena then.
+bool
+init_virtual_arena(Memory_Arena* arena, umm reserve_size, bool decommit_on_clear=false) {
+    reserve_size = align_forward(reserve_size, ARENA_COMMIT_SIZE);
+    
+    void* base = 0;
+#if VIRTUAL_MEMORY_WIN32
+    base = VirtualAlloc(0, reserve_size, WIN32_MEM_RESERVE, WIN32_PAGE_NOACCESS);
+#elif VIRTUAL_MEMORY_POSIX
+    base = mmap(0, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        base = 0;
+    }
+#endif
+    if (!base) {
+        return false;
+    }
+    
+    *arena = {};
+    arena->base = (u8*) base;
+    arena->reserve_size = reserve_size;
+    arena->decommit_on_clear = decommit_on_clear;
+    return true;
+}
+
+void
+free_virtual_arena(Memory_Arena* arena) {
+    if (!arena->reserve_size) return;
+    
+#if VIRTUAL_MEMORY_WIN32
+    VirtualFree(arena->base, 0, WIN32_MEM_RELEASE);
+#elif VIRTUAL_MEMORY_POSIX
+    munmap(arena->base, arena->reserve_size);
+#endif
+    *arena = {};
+}
+
+// NOTE(Alexander): commits up to the next ARENA_COMMIT_SIZE step past size, so pushing a few
+// bytes at a time doesn't call into the OS on every push. Running out of the reservation or
+// failing to commit aborts, in release too, the memory can't move to a bigger range and
+// returning pages that aren't committed would only crash later on at the first write.
+void
+commit_arena_memory(Memory_Arena* arena, umm size) {
+    if (size > arena->reserve_size) {
+        fprintf(stderr, "Virtual arena ran out of its %zu byte reservation pushing up to %zu bytes\n",
+                (size_t) arena->reserve_size, (size_t) size);
+        abort();
+    }
+    
+    umm new_size = align_forward(size, ARENA_COMMIT_SIZE);
+    if (new_size > arena->reserve_size) {
+        new_size = arena->reserve_size;
+    }
+    
+    bool committed = true;
+#if VIRTUAL_MEMORY_WIN32
+    committed = VirtualAlloc(arena->base + arena->size, new_size - arena->size, WIN32_MEM_COMMIT, WIN32_PAGE_READWRITE) != 0;
+#elif VIRTUAL_MEMORY_POSIX
+    committed = mprotect(arena->base + arena->size, new_size - arena->size, PROT_READ | PROT_WRITE) == 0;
+#endif
+    if (!committed) {
+        fprintf(stderr, "Virtual arena failed to commit %zu bytes\n", (size_t) (new_size - arena->size));
+        abort();
+    }
+#if ARENA_STATS
+    add_arena_stats_size(arena, (smm) (new_size - arena->size));
+#endif
+    arena->size = new_size;
+}
+
+// NOTE(Alexander): the pages read as zero again when they are committed the next time
+void
+decommit_arena_memory(Memory_Arena* arena) {
+    if (arena->size == 0) return;
+    
+#if VIRTUAL_MEMORY_WIN32
+    VirtualFree(arena->base, arena->size, WIN32_MEM_DECOMMIT);
+#elif VIRTUAL_MEMORY_POSIX
+    madvise(arena->base, arena->size, MADV_DONTNEED);
+    mprotect(arena->base, arena->size, PROT_NONE);
+#endif
+#if ARENA_STATS
+    add_arena_stats_size(arena, -(smm) arena->size);
+#endif
+    arena->size = 0;
+}
+
 inline void
 set_specific_arena_block(Memory_Arena* arena, u8* base, umm size) {
     arena->base = base;
@@ -51,25 +260,63 @@ set_minimum_arena_block_size(Memory_Arena* arena, umm min_block_size=0) {
 }
 
 void*
-push_size(Memory_Arena* arena, umm size, umm align=DEFAULT_ALIGNMENT, umm flags=0) {
+push_size(Memory_Arena* arena, umm size, umm align=DEFAULT_ALIGNMENT, Arena_Tag tag=Arena_Tag_Untagged, umm flags=0) {
     umm current = (umm) (arena->base + arena->curr_used);
     umm offset = align_forward(current, align) - (umm) arena->base;
     
-    if (offset + size > arena->size) {
+    if (offset + size > arena->size && arena->reserve_size) {
+        commit_arena_memory(arena, offset + size);
+    } else if (offset + size > arena->size) {
         if (arena->min_block_size == 0) {
             arena->min_block_size = ARENA_DEFAULT_BLOCK_SIZE;
         }
         
-        arena->base = (u8*) calloc(1, arena->min_block_size);
+        // NOTE(Alexander): big allocations (e.g. large tile layers) get a block of their own size
+        umm block_size = arena->min_block_size;
+        if (block_size < size + align) {
+            block_size = size + align;
+        }
+        
+#if ARENA_STATS
+        if (arena->base) {
+            arena->stats.overflow_count++;
+            arena->stats.overflow_waste += arena->size - arena->curr_used;
+            pln("Arena overflowed its %zu byte block pushing %zu bytes, %zu bytes are left unused",
+                (size_t) arena->size, (size_t) size, (size_t) (arena->size - arena->curr_used));
+        }
+        add_arena_stats_size(arena, (smm) block_size);
+#endif
+        
+        Memory_Block_Header* header = (Memory_Block_Header*) calloc(1, sizeof(Memory_Block_Header) + block_size);
+        header->prev_base = arena->base;
+        header->prev_size = arena->size;
+        header->prev_used = arena->curr_used;
+        header->prev_prev_used = arena->prev_used;
+        
+        arena->base = (u8*) (header + 1);
         arena->curr_used = 0;
         arena->prev_used = 0;
-        arena->size = arena->min_block_size;
+        arena->size = block_size;
+        arena->block_count++;
         
         current = (umm) arena->base + arena->curr_used;
         offset = align_forward(current, align) - (umm) arena->base;
-        // TODO(Alexander): we need to also store the previous memory block so we can eventually free it.
     }
     
+#if ARENA_STATS
+    Arena_Stats* stats = &arena->stats;
+    stats->used += offset + size - arena->curr_used;
+    stats->alignment_waste += offset - arena->curr_used;
+    stats->tag_used[tag] += size;
+    stats->tag_push_count[tag]++;
+    if (stats->used > stats->peak_used) {
+        stats->peak_used = stats->used;
+    }
+    if (arena->block_count > stats->peak_block_count) {
+        stats->peak_block_count = arena->block_count;
+    }
+#endif
+    
     void* result = arena->base + offset;
     arena->prev_used = arena->curr_used;
     arena->curr_used = offset + size;
@@ -81,16 +328,267 @@ push_size(Memory_Arena* arena, umm size, umm align=DEFAULT_ALIGNMENT, umm flags=
     return result;
 }
 
-#define push_struct(arena, type) (type*) push_size(arena, sizeof(type), alignof(type))
-#define push_array_of_structs(arena, count, type) (type*) push_size(arena, count*sizeof(type), alignof(type))
+// NOTE(Alexander): takes an optional Arena_Tag after the type
+#define push_struct(arena, type, ...) (type*) push_size(arena, sizeof(type), alignof(type), ##__VA_ARGS__)
+#define push_array_of_structs(arena, count, type, ...) (type*) push_size(arena, count*sizeof(type), alignof(type), ##__VA_ARGS__)
 
 inline void
 arena_rewind(Memory_Arena* arena) {
+#if ARENA_STATS
+    arena->stats.used -= arena->curr_used - arena->prev_used;
+#endif
     arena->curr_used = arena->prev_used;
 }
 
+// NOTE(Alexander): makes the previous block current again
+void
+free_last_arena_block(Memory_Arena* arena) {
+    assert(arena->block_count > 0 && "the current block wasn't allocated by the arena");
+    
+#if ARENA_STATS
+    arena->stats.used -= arena->curr_used;
+    add_arena_stats_size(arena, -(smm) arena->size);
+#endif
+    
+    Memory_Block_Header* header = get_block_header(arena->base);
+    arena->base = header->prev_base;
+    arena->size = header->prev_size;
+    arena->curr_used = header->prev_used;
+    arena->prev_used = header->prev_prev_used;
+    arena->block_count--;
+    free(header);
+}
+
+// NOTE(Alexander): keeps the current block, which is usually the biggest one, so a cleared
+// arena normally doesn't have to allocate again. The blocks before it are freed.
 inline void
 clear(Memory_Arena* arena) {
+    assert(arena->temp_count == 0 && "arena is cleared inside a temporary memory scope");
+    
+    if (arena->block_count > 1) {
+        Memory_Block_Header* header = get_block_header(arena->base);
+        u8* base = header->prev_base;
+        umm block_size = header->prev_size;
+        for (s32 i = 1; i < arena->block_count; i++) {
+            Memory_Block_Header* prev_header = get_block_header(base);
+#if ARENA_STATS
+            add_arena_stats_size(arena, -(smm) block_size);
+#endif
+            base = prev_header->prev_base;
+            block_size = prev_header->prev_size;
+            free(prev_header);
+        }
+        header->prev_base = 0;
+        header->prev_size = 0;
+        header->prev_used = 0;
+        header->prev_prev_used = 0;
+        arena->block_count = 1;
+    }
+    
+#if ARENA_STATS
+    arena->stats.used = 0;
+    for (int i = 0; i < Arena_Tag_Count; i++) {
+        arena->stats.tag_used[i] = 0;
+        arena->stats.tag_push_count[i] = 0;
+    }
+#endif
+    
     arena->curr_used = 0;
     arena->prev_used = 0;
+    if (arena->decommit_on_clear) {
+        decommit_arena_memory(arena);
+    }
+}
+
+// NOTE(Alexander): frees every block (or the reserved range), a specific block is left to its owner
+void
+free_arena(Memory_Arena* arena) {
+    assert(arena->temp_count == 0 && "arena is freed inside a temporary memory scope");
+    
+    if (arena->reserve_size) {
+        free_virtual_arena(arena);
+        return;
+    }
+    
+    while (arena->block_count > 0) {
+        free_last_arena_block(arena);
+    }
+    *arena = {};
+}
+
+inline Temporary_Memory
+begin_temp(Memory_Arena* arena) {
+    Temporary_Memory result;
+    result.arena = arena;
+    result.base = arena->base;
+    result.used = arena->curr_used;
+    result.prev_used = arena->prev_used;
+    arena->temp_count++;
+    return result;
+}
+
+inline void
+end_temp(Temporary_Memory temp) {
+    Memory_Arena* arena = temp.arena;
+    assert(arena->temp_count > 0);
+    
+    // NOTE(Alexander): the first block of an arena is kept, otherwise temporary scopes on an arena
+    // that hasn't allocated anything else yet (e.g. a fresh scratch arena) allocate it every time
+    while (arena->base != temp.base) {
+        if (!temp.base && arena->block_count == 1) {
+            break;
+        }
+        free_last_arena_block(arena);
+    }
+    assert(arena->curr_used >= temp.used && "temporary memory scopes ended out of order");
+#if ARENA_STATS
+    arena->stats.used -= arena->curr_used - temp.used;
+#endif
+    arena->curr_used = temp.used;
+    arena->prev_used = temp.prev_used;
+    arena->temp_count--;
+}
+
+// NOTE(Alexander): per thread memory for things that only have to live until the end of the
+// tick, the simulation clears it at the start of every tick. Use temporary memory on it for
+// anything shorter lived, so the scratch arena doesn't keep growing during the tick.
+thread_local Memory_Arena scratch_arena;
+
+inline Memory_Arena*
+get_scratch_arena() {
+    if (scratch_arena.min_block_size == 0) {
+        scratch_arena.min_block_size = SCRATCH_ARENA_BLOCK_SIZE;
+    }
+    return &scratch_arena;
+}
+
+// NOTE(Alexander): fixed size elements carved out of slabs pushed on an arena. Free elements
+// form a list threaded through the elements themselves, so allocating and freeing are O(1)
+// and freed elements are reused before the arena grows. The slabs belong to the arena, reset
+// the pool when the arena is cleared.
+struct Memory_Pool {
+    Memory_Arena* arena;
+    umm element_size; // NOTE(Alexander): rounded up to fit the free list pointer and the alignment
+    umm align;
+    s32 slab_count; // NOTE(Alexander): elements per slab
+    Arena_Tag tag;
+    
+    void* first_free;
+    s32 used_count;
+    s32 capacity;
+};
+
+void
+init_pool(Memory_Pool* pool, Memory_Arena* arena, umm element_size, umm align,
+          Arena_Tag tag=Arena_Tag_Untagged, s32 slab_count=POOL_DEFAULT_SLAB_COUNT) {
+    assert_power_of_two(align);
+    if (element_size < sizeof(void*)) {
+        element_size = sizeof(void*);
+    }
+    if (align < alignof(void*)) {
+        align = alignof(void*);
+    }
+    
+    *pool = {};
+    pool->arena = arena;
+    pool->element_size = align_forward(element_size, align);
+    pool->align = align;
+    pool->slab_count = slab_count > 0 ? slab_count : 1;
+    pool->tag = tag;
+}
+
+// NOTE(Alexander): forgets every element, has to be called when the arena has been cleared
+inline void
+reset_pool(Memory_Pool* pool) {
+    pool->first_free = 0;
+    pool->used_count = 0;
+    pool->capacity = 0;
+}
+
+// NOTE(Alexander): size is only there to check that the element fits, use pool_alloc_struct
+void*
+pool_alloc(Memory_Pool* pool, umm size) {
+    assert(size <= pool->element_size && "element doesn't fit in the pool");
+    
+    if (!pool->first_free) {
+        u8* slab = (u8*) push_size(pool->arena, pool->slab_count*pool->element_size, pool->align, pool->tag);
+        for (s32 i = pool->slab_count - 1; i >= 0; i--) {
+            u8* element = slab + i*pool->element_size;
+#if POOL_POISON
+            memset(element, POOL_POISON_BYTE, pool->element_size);
+#endif
+            *(void**) element = pool->first_free;
+            pool->first_free = element;
+        }
+        pool->capacity += pool->slab_count;
+    }
+    
+    u8* result = (u8*) pool->first_free;
+    pool->first_free = *(void**) result;
+    pool->used_count++;
+    
+#if POOL_POISON
+    for (umm i = sizeof(void*); i < pool->element_size; i++) {
+        assert(result[i] == POOL_POISON_BYTE && "pool element was written to after it was freed");
+    }
+#endif
+    
+    memset(result, 0, pool->element_size);
+    return result;
+}
+
+void
+pool_free(Memory_Pool* pool, void* element) {
+    if (!element) return;
+    
+    assert(pool->used_count > 0);
+#if POOL_POISON
+    memset(element, POOL_POISON_BYTE, pool->element_size);
+#endif
+    *(void**) element = pool->first_free;
+    pool->first_free = element;
+    pool->used_count--;
+}
+
+#if BUILD_DEBUG
+// NOTE(Alexander): the pools in the game are only ever allocated from, this runs the free path
+// once at startup so the free list reuse and the poison check don't go untested
+void
+check_pool_reuse(Memory_Pool* pool) {
+    s32 used_count = pool->used_count;
+    void* element = pool_alloc(pool, pool->element_size);
+    pool_free(pool, element);
+    void* reused = pool_alloc(pool, pool->element_size);
+    assert(reused == element && "pool didn't reuse the freed element");
+    pool_free(pool, reused);
+    assert(pool->used_count == used_count);
+}
+#endif
+
+#define init_pool_of_structs(pool, arena, type, ...) init_pool(pool, arena, sizeof(type), alignof(type), ##__VA_ARGS__)
+#define pool_alloc_struct(pool, type) (type*) pool_alloc(pool, sizeof(type))
+
+// NOTE(Alexander): zeroed if the statistics are compiled out
+inline Arena_Stats
+get_arena_stats(Memory_Arena* arena) {
+#if ARENA_STATS
+    return arena->stats;
+#else
+    return {};
+#endif
+}
+
+void
+print_arena_stats(cstring name, Arena_Stats* stats) {
+    printf("%s: %.1f KB used (peak %.1f KB), %.1f KB in blocks (peak %.1f KB, %d blocks)\n", name,
+           stats->used/1024.0, stats->peak_used/1024.0, stats->size/1024.0, stats->peak_size/1024.0,
+           stats->peak_block_count);
+    printf("  %d overflows wasting %.1f KB, %.1f KB of alignment padding\n",
+           stats->overflow_count, stats->overflow_waste/1024.0, stats->alignment_waste/1024.0);
+    for (int i = 0; i < Arena_Tag_Count; i++) {
+        if (stats->tag_push_count[i] > 0) {
+            printf("  %-15s %.1f KB in %d pushes\n", arena_tag_names[i],
+                   stats->tag_used[i]/1024.0, stats->tag_push_count[i]);
+        }
+    }
 }
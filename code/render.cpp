@@ -0,0 +1,576 @@
+// NOTE(Alexander): builds and sorts the render commands for a frame. Nothing in here calls
+// into raylib so the headless runner can build the same commands and count them,
+// the platform layer is responsible for submitting them (see submit_render_commands).
+
+#define BACKGROUND_COLOR rgb(52, 28, 39)
+
+Color
+rgb(u8 r, u8 g, u8 b, u8 a=255) {
+    Color result;
+    result.r = r;
+    result.g = g;
+    result.b = b;
+    result.a = a;
+    return result;
+}
+
+v2
+to_pixel(Game_State* state, v2 world_p) {
+    v2 result;
+    result.x = roundf((world_p.x - state->camera_p.x) * state->meters_to_pixels);
+    result.y = roundf((world_p.y - state->camera_p.y) * state->meters_to_pixels);
+    return result;
+}
+
+// NOTE(Alexander): invincible entities blink every other 60 Hz frame
+inline bool
+is_flicker_visible(Entity* entity) {
+    return (entity->invincibility_ticks*60/SIM_HZ) % 2 == 0;
+}
+
+// NOTE(Alexander): size of the game render target, the platform layer scales it up to the window
+void
+init_render_view(Game_State* state) {
+    state->game_width = 22 * TILE_SIZE;
+    state->game_height = 15 * TILE_SIZE;
+    
+    state->meters_to_pixels = TILE_SIZE;
+    state->pixels_to_meters = 1.0f/state->meters_to_pixels;
+}
+
+// NOTE(Alexander): the part of the world covered by the game screen, in meters
+struct View_Rect {
+    v2 min_p;
+    v2 max_p;
+};
+
+inline View_Rect
+get_view_rect(Game_State* state) {
+    View_Rect result;
+    result.min_p = state->camera_p;
+    result.max_p = state->camera_p + vec2((f32) state->game_width, (f32) state->game_height)*state->pixels_to_meters;
+    return result;
+}
+
+inline bool
+is_visible(View_Rect* view, v2 min_p, v2 max_p) {
+    return (max_p.x >= view->min_p.x && min_p.x <= view->max_p.x &&
+            max_p.y >= view->min_p.y && min_p.y <= view->max_p.y);
+}
+
+// NOTE(Alexander): how far (in meters) an entity draws outside of its collision box,
+// e.g. the dragon wings, tail and fire breath or the charging particles around the player.
+inline f32
+get_entity_draw_margin(Entity_Type type) {
+    switch (type) {
+        case Boss_Dragon: return 8.0f;
+        case Player: return 2.0f;
+    }
+    return 0.0f;
+}
+
+// NOTE(Alexander): layer in the top byte so it decides the draw order, then blend mode
+// and texture so equal state ends up next to each other within a layer.
+inline u32
+get_render_sort_key(Render_Layer layer, BlendMode blend, Render_Texture texture) {
+    return ((u32) layer << 16) | ((u32) blend << 8) | (u32) texture;
+}
+
+#define RENDER_SORT_KEY_BITS 24
+
+inline void
+begin_render_commands(Render_Command_Buffer* buffer) {
+    buffer->count = 0;
+    buffer->sorted = buffer->sort_entries;
+    buffer->particle_data_count = 0;
+}
+
+Render_Command*
+push_render_command(Render_Command_Buffer* buffer, Render_Command_Type type,
+                    Render_Layer layer, BlendMode blend, Render_Texture texture) {
+    if (buffer->count >= buffer->capacity) {
+        buffer->capacity = max(buffer->capacity*2, 256);
+        buffer->commands = (Render_Command*) realloc(buffer->commands, buffer->capacity*sizeof(Render_Command));
+        buffer->sort_entries = (Render_Sort_Entry*) realloc(buffer->sort_entries, buffer->capacity*sizeof(Render_Sort_Entry));
+        buffer->sorted = buffer->sort_entries;
+    }
+    
+    int index = buffer->count++;
+    buffer->sort_entries[index].key = get_render_sort_key(layer, blend, texture);
+    buffer->sort_entries[index].index = (u32) index;
+    
+    Render_Command* command = &buffer->commands[index];
+    command->type = type;
+    return command;
+}
+
+inline void
+push_sprite(Render_Command_Buffer* buffer, Render_Layer layer, Sprite* sprite,
+            Rectangle src, Rectangle dest, f32 rotation=0.0f, Color tint=WHITE) {
+    Render_Command* command = push_render_command(buffer, Render_Command_Sprite, layer,
+                                                  BLEND_ALPHA, Render_Texture_Atlas);
+    command->sprite.sprite = sprite;
+    command->sprite.src = src;
+    command->sprite.dest = dest;
+    command->sprite.rotation = rotation;
+    command->sprite.tint = tint;
+}
+
+inline void
+push_tile_chunk(Render_Command_Buffer* buffer, Render_Layer layer, int chunk_index, v2 p, bool is_streamed=false) {
+    Render_Command* command = push_render_command(buffer, Render_Command_Tile_Chunk, layer,
+                                                  BLEND_ALPHA, Render_Texture_Tile_Chunk);
+    command->tile_chunk.chunk_index = chunk_index;
+    command->tile_chunk.is_streamed = is_streamed;
+    command->tile_chunk.p = p;
+}
+
+inline void
+push_rect(Render_Command_Buffer* buffer, Render_Layer layer, Rectangle rect, Color color) {
+    Render_Command* command = push_render_command(buffer, Render_Command_Rect, layer,
+                                                  BLEND_ALPHA, Render_Texture_None);
+    command->rect.rect = rect;
+    command->rect.color = color;
+}
+
+inline void
+push_rect(Render_Command_Buffer* buffer, Render_Layer layer, int x, int y, int width, int height, Color color) {
+    Rectangle rect = { (f32) x, (f32) y, (f32) width, (f32) height };
+    push_rect(buffer, layer, rect, color);
+}
+
+inline void
+push_circle(Render_Command_Buffer* buffer, Render_Layer layer, v2 center, f32 radius, Color color) {
+    Render_Command* command = push_render_command(buffer, Render_Command_Circle, layer,
+                                                  BLEND_ALPHA, Render_Texture_None);
+    command->circle.center = center;
+    command->circle.radius = radius;
+    command->circle.color = color;
+}
+
+inline void
+push_line(Render_Command_Buffer* buffer, Render_Layer layer, v2 p0, v2 p1, Color color) {
+    Render_Command* command = push_render_command(buffer, Render_Command_Line, layer,
+                                                  BLEND_ALPHA, Render_Texture_None);
+    command->line.p0 = p0;
+    command->line.p1 = p1;
+    command->line.color = color;
+}
+
+inline void
+push_text(Render_Command_Buffer* buffer, Render_Layer layer, cstring text, v2 p,
+          f32 font_size, Color color, bool centered=false) {
+    Render_Command* command = push_render_command(buffer, Render_Command_Text, layer,
+                                                  BLEND_ALPHA, Render_Texture_Font);
+    command->text.text = text;
+    command->text.p = p;
+    command->text.font_size = font_size;
+    command->text.color = color;
+    command->text.centered = centered;
+}
+
+// NOTE(Alexander): copies the live particles, converted to pixels, into the buffer
+void
+push_particles(Game_State* state, Render_Command_Buffer* buffer, Render_Layer layer,
+               Particle_System* ps, Particle_Style style, BlendMode blend) {
+    if (ps->particle_count == 0) return;
+    
+    int needed = buffer->particle_data_count + ps->particle_count*3;
+    if (needed > buffer->particle_data_capacity) {
+        buffer->particle_data_capacity = max(needed*2, 1024);
+        buffer->particle_data = (f32*) realloc(buffer->particle_data, buffer->particle_data_capacity*sizeof(f32));
+    }
+    
+    f32* data = buffer->particle_data + buffer->particle_data_count;
+    int count = 0;
+    for (int j = 0; j < ps->particle_count; j++) {
+        if (ps->t[j] <= 0.0f) continue;
+        v2 p = to_pixel(state, vec2(ps->p_x[j], ps->p_y[j]));
+        data[count] = p.x;
+        data[ps->particle_count + count] = p.y;
+        data[ps->particle_count*2 + count] = ps->t[j];
+        count++;
+    }
+    if (count == 0) return;
+    
+    // NOTE(Alexander): keep the three arrays packed back to back
+    memmove(data + count, data + ps->particle_count, count*sizeof(f32));
+    memmove(data + count*2, data + ps->particle_count*2, count*sizeof(f32));
+    
+    Render_Command* command = push_render_command(buffer, Render_Command_Particles, layer,
+                                                  blend, Render_Texture_Atlas);
+    command->particles.style = style;
+    command->particles.count = count;
+    command->particles.data_offset = buffer->particle_data_count;
+    command->particles.start_p = to_pixel(state, ps->start_p);
+    buffer->particle_data_count += count*3;
+}
+
+// NOTE(Alexander): LSD radix sort on the sort key one byte at a time, it is stable so
+// commands with the same key keep their push order. Passes where every key has the
+// same byte are skipped, most frames only have a couple of distinct keys.
+void
+sort_render_commands(Render_Command_Buffer* buffer) {
+    int count = buffer->count;
+    Temporary_Memory scratch = begin_temp(get_scratch_arena());
+    Render_Sort_Entry* src = buffer->sort_entries;
+    Render_Sort_Entry* dest = push_array_of_structs(scratch.arena, count, Render_Sort_Entry, Arena_Tag_Render_Sort);
+    
+    for (int shift = 0; shift < RENDER_SORT_KEY_BITS && count > 1; shift += 8) {
+        int offsets[256] = {};
+        for (int i = 0; i < count; i++) {
+            offsets[(src[i].key >> shift) & 0xFF]++;
+        }
+        
+        if (offsets[(src[0].key >> shift) & 0xFF] == count) {
+            continue;
+        }
+        
+        int total = 0;
+        for (int bucket = 0; bucket < 256; bucket++) {
+            int bucket_count = offsets[bucket];
+            offsets[bucket] = total;
+            total += bucket_count;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            dest[offsets[(src[i].key >> shift) & 0xFF]++] = src[i];
+        }
+        
+        Render_Sort_Entry* temp = src;
+        src = dest;
+        dest = temp;
+    }
+    
+    // NOTE(Alexander): an odd number of passes leaves the result in the scratch buffer
+    if (src != buffer->sort_entries) {
+        memcpy(buffer->sort_entries, src, count*sizeof(Render_Sort_Entry));
+    }
+    buffer->sorted = buffer->sort_entries;
+    end_temp(scratch);
+}
+
+// NOTE(Alexander): has to be called after sort_render_commands. Every tile chunk is
+// its own texture so each of them counts as a separate batch.
+Render_Stats
+get_render_stats(Render_Command_Buffer* buffer) {
+    Render_Stats result = {};
+    result.command_count = buffer->count;
+    
+    u32 state_mask = 0xFFFF; // NOTE(Alexander): blend mode and texture, the layer doesn't break batches
+    u32 prev_state = 0;
+    for (int i = 0; i < buffer->count; i++) {
+        Render_Sort_Entry* entry = &buffer->sorted[i];
+        Render_Command* command = &buffer->commands[entry->index];
+        result.type_counts[command->type]++;
+        
+        u32 state = entry->key & state_mask;
+        if (i == 0 || state != prev_state || command->type == Render_Command_Tile_Chunk) {
+            result.batch_count++;
+        }
+        prev_state = state;
+    }
+    
+    return result;
+}
+
+void
+push_level_bounds(Game_State* state, Render_Command_Buffer* buffer) {
+    
+    // Level bounds
+    v2 size = vec2((f32) state->tile_map_width*TILE_SIZE + 1.0f, (f32) state->tile_map_width*TILE_SIZE);
+    
+    v2 cp;
+    cp.x = -state->camera_p.x * state->meters_to_pixels;
+    cp.y = -state->camera_p.y * state->meters_to_pixels;
+    v2 min_cursor_p = cp;
+    v2 max_cursor_p = min_cursor_p + size + vec2(0.0f, 1.0f);
+    
+    Color background = BACKGROUND_COLOR;
+    Render_Layer layer = Render_Layer_Level_Bounds;
+    
+    if (min_cursor_p.x > 0.0f) {
+        int w = (int) min_cursor_p.x;
+        push_rect(buffer, layer, 0, 0, w, state->game_height, background);
+    }
+    
+    if (max_cursor_p.x < size.y) {
+        push_rect(buffer, layer, (int) max_cursor_p.x, 0, state->game_width - (int) max_cursor_p.x, state->game_height, background);
+    }
+    
+    if (min_cursor_p.y > 0.0f) {
+        push_rect(buffer, layer, 0, 0, state->game_width, (int) min_cursor_p.y, background);
+    }
+    
+    if (max_cursor_p.y < size.y) {
+        push_rect(buffer, layer, 0, (int) max_cursor_p.y,
+                  state->game_width, state->game_height - (int) max_cursor_p.y, background);
+        
+    }
+}
+
+void
+push_health_bar(Game_State* game_state, Render_Command_Buffer* buffer, Entity_Handle handle, Color color, bool right=true) {
+    Entity_Store* store = &game_state->entities;
+    s32 index = get_entity_index(store, handle);
+    f32 width = (f32) (game_state->game_width/2-8);
+    width *= (f32) store->health[index] / store->cold[index].max_health;
+    s32 xoffset = 0;
+    s32 xoffset_inner = 0;
+    if (right) {
+        xoffset = game_state->game_width/2 - 7;
+    } else {
+        xoffset_inner = game_state->game_width/2 - 8 - (int) width;
+    }
+    push_rect(buffer, Render_Layer_Hud, 7 + xoffset, 7, game_state->game_width/2-6, 6, BLACK);
+    push_rect(buffer, Render_Layer_Hud, 8 + xoffset + xoffset_inner, 8, (int) width, 4, color);
+}
+
+// NOTE(Alexander): only the chunks that overlap the view, uses the simulation side chunk
+// counts so it doesn't depend on the platform layer having created the textures.
+void
+push_tile_layer(Game_State* state, Render_Command_Buffer* buffer, View_Rect* view) {
+    // NOTE(Alexander): only the resident chunks of streamed levels are drawn, every chunk that
+    // is resident now gets copied into this frame's snapshot for baking if it wasn't already
+    Level_Streamer* streamer = &state->level_streamer;
+    if (streamer->header) {
+        f32 chunk_meters = (f32) LEVEL_STREAM_CHUNK_SIZE;
+        int min_x = max((int) floorf(view->min_p.x/chunk_meters), 0);
+        int min_y = max((int) floorf(view->min_p.y/chunk_meters), 0);
+        int max_x = min((int) floorf(view->max_p.x/chunk_meters), streamer->header->chunk_count_x - 1);
+        int max_y = min((int) floorf(view->max_p.y/chunk_meters), streamer->header->chunk_count_y - 1);
+        
+        for (int chunk_y = min_y; chunk_y <= max_y; chunk_y++) {
+            for (int chunk_x = min_x; chunk_x <= max_x; chunk_x++) {
+                Streamed_Chunk* chunk = find_resident_streamed_chunk(streamer, chunk_x, chunk_y);
+                if (chunk) {
+                    v2 p;
+                    p.x = (chunk_x*chunk_meters - state->camera_p.x) * state->meters_to_pixels;
+                    p.y = (chunk_y*chunk_meters - state->camera_p.y) * state->meters_to_pixels;
+                    push_tile_chunk(buffer, Render_Layer_Tiles, (int) (chunk - streamer->chunks), p, true);
+                }
+            }
+        }
+        return;
+    }
+    
+    f32 chunk_meters = (f32) TILE_CHUNK_SIZE;
+    
+    int min_x = max((int) floorf(view->min_p.x/chunk_meters), 0);
+    int min_y = max((int) floorf(view->min_p.y/chunk_meters), 0);
+    int max_x = min((int) floorf(view->max_p.x/chunk_meters), state->tile_chunk_width - 1);
+    int max_y = min((int) floorf(view->max_p.y/chunk_meters), state->tile_chunk_height - 1);
+    
+    for (int chunk_y = min_y; chunk_y <= max_y; chunk_y++) {
+        for (int chunk_x = min_x; chunk_x <= max_x; chunk_x++) {
+            v2 p;
+            p.x = (chunk_x*chunk_meters - state->camera_p.x) * state->meters_to_pixels;
+            p.y = (chunk_y*chunk_meters - state->camera_p.y) * state->meters_to_pixels;
+            push_tile_chunk(buffer, Render_Layer_Tiles, chunk_y*state->tile_chunk_width + chunk_x, p);
+        }
+    }
+}
+
+// NOTE(Alexander): describes the whole game screen, delta_time only drives purely
+// visual animations (dragon tail and wings) that aren't part of the simulation.
+void
+build_render_commands(Game_State* state, Render_Command_Buffer* buffer, f32 render_alpha, f32 delta_time) {
+    begin_render_commands(buffer);
+    
+    Entity_Store* store = &state->entities;
+    View_Rect view = get_view_rect(state);
+    
+    {
+        // NOTE(Alexander): the background covers 3x10 copies of the texture, only draw the visible ones
+        Sprite* background = &state->sprite_background;
+        f32 background_width = background->rect.width*state->pixels_to_meters;
+        f32 background_height = background->rect.height*state->pixels_to_meters;
+        int min_x = max((int) floorf(view.min_p.x/background_width), 0);
+        int min_y = max((int) floorf(view.min_p.y/background_height), 0);
+        int max_x = min((int) floorf(view.max_p.x/background_width), 2);
+        int max_y = min((int) floorf(view.max_p.y/background_height), 9);
+        
+        Rectangle src = { 0.0f, 0.0f, background->rect.width, background->rect.height };
+        for (int y = min_y; y <= max_y; y++) {
+            for (int x = min_x; x <= max_x; x++) {
+                int px = (int) round(x*background->rect.width-state->camera_p.x * state->meters_to_pixels);
+                int py = (int) round(y*background->rect.height-state->camera_p.y * state->meters_to_pixels);
+                Rectangle dest = { (f32) px, (f32) py, src.width, src.height };
+                push_sprite(buffer, Render_Layer_Background, background, src, dest);
+            }
+        }
+    }
+    
+    push_tile_layer(state, buffer, &view);
+    
+    for (int i = 0; i < store->count; i++) {
+        Entity* entity = &store->cold[i];
+        if (!store->type[i]) continue;
+        if (store->health[i] <= 0) continue;
+        
+        v2 render_p = lerp(store->prev_p[i], store->p[i], render_alpha);
+        v2 entity_size = store->size[i];
+        
+        f32 margin = get_entity_draw_margin(store->type[i]);
+        if (!is_visible(&view, render_p - vec2(margin, margin), render_p + entity_size + vec2(margin, margin))) {
+            continue;
+        }
+        
+        if (entity->sprite) {
+            v2 p = to_pixel(state, render_p);
+            v2 size = entity_size * state->meters_to_pixels;
+            
+            bool facing_right = entity->facing_dir > 0.0f;
+            if (entity->flip_texture) {
+                facing_right = !facing_right;
+            }
+            
+            
+            Rectangle src = { 0.0f, 0.0f, size.width, size.height };
+            if (entity->num_frames > 0 && (store->flags[i] & Entity_Flag_Grounded)) {
+                int frame_index = (int) entity->frame_advance;
+                if (fabsf(store->velocity[i].x) < 0.01f) {
+                    frame_index = entity->idle_frame;
+                }
+                src.x += size.width*frame_index;
+            }
+            
+            Rectangle dest = { p.x, p.y, size.width, size.height };
+            if (facing_right) {
+                src.width = -src.width;
+            }
+            
+            if (is_flicker_visible(entity)) {
+                push_sprite(buffer, Render_Layer_Entities, entity->sprite, src, dest, entity->sprite_rot);
+            }
+            
+        } else {
+            v2 p = to_pixel(state, render_p);
+            v2 size = entity_size * state->meters_to_pixels;
+            push_rect(buffer, Render_Layer_Entities, (int) p.x, (int) p.y,
+                      (int) size.x, (int) size.y, entity->color);
+        }
+        
+        switch (store->type[i]) {
+            case Boss_Dragon: {
+                push_particles(state, buffer, Render_Layer_Effects, state->ps_fire,
+                               Particle_Style_Fire, BLEND_MULTIPLIED);
+                
+                if (is_flicker_visible(entity)) {
+                    // Draw tail
+                    v2 wp = render_p + vec2(0.0f, 2.0f);
+                    if (entity->facing_dir <= 0.0f) {
+                        wp.x += entity_size.x;
+                    }
+                    Color color = rgb(165, 48, 48);
+                    v2 p = to_pixel(state, wp);
+                    
+                    static f32 angle_mod;
+                    
+                    angle_mod += delta_time;
+                    
+                    f32 angle = angle_mod + PI_F32/4.0f;
+                    int num_joints = 18;
+                    for (int c = 0; c < num_joints; c++) {
+                        f32 decr = 1.0f - (f32) c/num_joints;
+                        f32 radius = fabsf(cosf(c*PI_F32/2.0f))*3.5f*decr + 1.0f;
+                        
+                        // NOTE(Alexander): snapped to whole pixels like DrawLine/DrawCircle used to
+                        v2 joint_p = vec2((f32) (int) p.x, (f32) (int) p.y);
+                        if (c % 4 == 0) {
+                            v2 top = vec2(joint_p.x, (f32) ((int) (p.y-radius*1.0f)+2));
+                            v2 bottom = vec2(joint_p.x, (f32) ((int) (p.y-radius*1.0f)-2));
+                            push_line(buffer, Render_Layer_Entity_Details, top, bottom, ORANGE);
+                        }
+                        push_circle(buffer, Render_Layer_Entity_Details, joint_p, radius, color);
+                        
+                        
+                        p.x += (radius * 0.8f)*(entity->facing_dir > 0.0f ? -1.0f : 1.0f);
+                        p.y += sinf(angle)*(radius * 0.8f)*0.5f;
+                        angle += PI_F32/8.0f;
+                    }
+                }
+                
+                
+                {
+                    // Draw wings
+                    v2 p = to_pixel(state, render_p) - vec2(32.0f, 32.0f);
+                    v2 size = vec2(128.0f, 128.0f);
+                    
+                    bool facing_right = entity->facing_dir > 0.0f;
+                    if (entity->flip_texture) {
+                        facing_right = !facing_right;
+                    }
+                    
+                    
+                    static f32 wings_frame;
+                    if (store->velocity[i].y < 0.0f) {
+                        wings_frame += delta_time*15.0f;
+                    } else {
+                        wings_frame = 0.0f;
+                    }
+                    
+                    
+                    Rectangle src = { 0.0f, 0.0f, size.width, size.height };
+                    int frame_index =  ((int) wings_frame) % 8;
+                    src.x += size.width*frame_index;
+                    
+                    Rectangle dest = { p.x, p.y, size.width, size.height };
+                    if (facing_right) {
+                        src.width = -src.width;
+                    }
+                    
+                    if (is_flicker_visible(entity)) {
+                        push_sprite(buffer, Render_Layer_Entity_Overlay, &state->sprite_dragon_wings,
+                                    src, dest, entity->sprite_rot);
+                    }
+                    
+                }
+            } break;
+            
+            
+            case Player: {
+                push_particles(state, buffer, Render_Layer_Effects, state->ps_charging,
+                               Particle_Style_Charging, BLEND_ADDITIVE);
+            } break;
+        }
+    }
+    
+    push_level_bounds(state, buffer);
+    
+    
+    if (state->mode == Control_Boss_Enemy) {
+        push_health_bar(state, buffer, state->boss_enemy, RED, false);
+        push_health_bar(state, buffer, state->player, SKYBLUE, true);
+        
+        
+        // Victory conditions are checked by simulate_tick, only present the outcome here
+        s32 boss_health = store->health[get_entity_index(store, state->boss_enemy)];
+        s32 player_health = store->health[get_entity_index(store, state->player)];
+        if (boss_health <= 0 || player_health <= 0) {
+            
+            cstring text;
+            Color text_color;
+            if (boss_health <= 0) {
+                text = "You lost!";
+                text_color = MAROON;
+            } else {
+                text = "You win!";
+                text_color = BLUE;
+            }
+            
+            v2 center = vec2(state->game_width/2.0f, state->game_height/2.0f);
+            push_text(buffer, Render_Layer_Hud_Text, text, center, 42.0f, text_color, true);
+            
+            f32 rate = 500.0f;
+            Color c = {};
+            if (cutscene_interval(3.5f, 5.5f)) {
+                f32 val = (state->cutscene_time-3.5f)*rate;
+                c.a = (u8) (val > 255.0f ? 255.0f : val);
+                push_rect(buffer, Render_Layer_Fade, 0, 0, state->game_width, state->game_height, c);
+            }
+        }
+    }
+    
+    sort_render_commands(buffer);
+}
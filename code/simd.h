@@ -0,0 +1,315 @@
+// NOTE(Alexander): minimal SIMD wrappers, 4 wide floats and ints plus 16 wide bytes. SSE2 on x64
+// (always available there), NEON on ARM and a plain scalar fallback for everything else (e.g. wasm).
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define SIMD_WIDTH 4
+
+struct f32x4 {
+#if SIMD_SSE2
+    __m128 v;
+#elif SIMD_NEON
+    float32x4_t v;
+#else
+    f32 v[4];
+#endif
+};
+
+struct u32x4 {
+#if SIMD_SSE2
+    __m128i v;
+#elif SIMD_NEON
+    uint32x4_t v;
+#else
+    u32 v[4];
+#endif
+};
+
+inline f32x4
+f32x4_set1(f32 value) {
+    f32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_set1_ps(value);
+#elif SIMD_NEON
+    result.v = vdupq_n_f32(value);
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = value;
+#endif
+    return result;
+}
+
+// NOTE(Alexander): no alignment requirements
+inline f32x4
+f32x4_load(f32* src) {
+    f32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_loadu_ps(src);
+#elif SIMD_NEON
+    result.v = vld1q_f32(src);
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = src[i];
+#endif
+    return result;
+}
+
+inline void
+f32x4_store(f32* dest, f32x4 a) {
+#if SIMD_SSE2
+    _mm_storeu_ps(dest, a.v);
+#elif SIMD_NEON
+    vst1q_f32(dest, a.v);
+#else
+    for (int i = 0; i < 4; i++) dest[i] = a.v[i];
+#endif
+}
+
+inline f32x4
+operator+(f32x4 a, f32x4 b) {
+    f32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_add_ps(a.v, b.v);
+#elif SIMD_NEON
+    result.v = vaddq_f32(a.v, b.v);
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = a.v[i] + b.v[i];
+#endif
+    return result;
+}
+
+inline f32x4
+operator-(f32x4 a, f32x4 b) {
+    f32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_sub_ps(a.v, b.v);
+#elif SIMD_NEON
+    result.v = vsubq_f32(a.v, b.v);
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = a.v[i] - b.v[i];
+#endif
+    return result;
+}
+
+inline f32x4
+operator*(f32x4 a, f32x4 b) {
+    f32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_mul_ps(a.v, b.v);
+#elif SIMD_NEON
+    result.v = vmulq_f32(a.v, b.v);
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = a.v[i] * b.v[i];
+#endif
+    return result;
+}
+
+inline u32x4
+u32x4_load(u32* src) {
+    u32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_loadu_si128((__m128i*) src);
+#elif SIMD_NEON
+    result.v = vld1q_u32(src);
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = src[i];
+#endif
+    return result;
+}
+
+inline void
+u32x4_store(u32* dest, u32x4 a) {
+#if SIMD_SSE2
+    _mm_storeu_si128((__m128i*) dest, a.v);
+#elif SIMD_NEON
+    vst1q_u32(dest, a.v);
+#else
+    for (int i = 0; i < 4; i++) dest[i] = a.v[i];
+#endif
+}
+
+inline u32x4
+operator^(u32x4 a, u32x4 b) {
+    u32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_xor_si128(a.v, b.v);
+#elif SIMD_NEON
+    result.v = veorq_u32(a.v, b.v);
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = a.v[i] ^ b.v[i];
+#endif
+    return result;
+}
+
+inline u32x4
+operator<<(u32x4 a, int shift) {
+    u32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_slli_epi32(a.v, shift);
+#elif SIMD_NEON
+    result.v = vshlq_u32(a.v, vdupq_n_s32(shift));
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = a.v[i] << shift;
+#endif
+    return result;
+}
+
+inline u32x4
+operator>>(u32x4 a, int shift) {
+    u32x4 result;
+#if SIMD_SSE2
+    result.v = _mm_srli_epi32(a.v, shift);
+#elif SIMD_NEON
+    result.v = vshlq_u32(a.v, vdupq_n_s32(-shift));
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = a.v[i] >> shift;
+#endif
+    return result;
+}
+
+// NOTE(Alexander): xorshift32 in every lane, the state must never be zero
+inline u32x4
+random_next_x4(u32x4 x) {
+    x = x ^ (x << 13);
+    x = x ^ (x >> 17);
+    x = x ^ (x << 5);
+    return x;
+}
+
+// NOTE(Alexander): maps the top 24 bits to [0, 1)
+inline f32x4
+random_unilateral_x4(u32x4 x) {
+    f32x4 result;
+    x = x >> 8;
+#if SIMD_SSE2
+    result.v = _mm_cvtepi32_ps(x.v);
+#elif SIMD_NEON
+    result.v = vcvtq_f32_u32(x.v);
+#else
+    for (int i = 0; i < 4; i++) result.v[i] = (f32) x.v[i];
+#endif
+    return result * f32x4_set1(1.0f/16777216.0f);
+}
+
+// NOTE(Alexander): 16 wide bytes, only what the text parsers need. The masks have bit i set
+// for byte i so they can be walked with find_first_set_bit.
+struct u8x16 {
+#if SIMD_SSE2
+    __m128i v;
+#elif SIMD_NEON
+    uint8x16_t v;
+#else
+    u8 v[16];
+#endif
+};
+
+// NOTE(Alexander): mask must not be zero
+inline u32
+find_first_set_bit(u32 mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// NOTE(Alexander): mask must not be zero
+inline u32
+find_last_set_bit(u32 mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return index;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+#if SIMD_NEON
+// NOTE(Alexander): NEON has no movemask, weigh each lane by its bit and add the halves up
+inline u32
+neon_movemask_u8(uint8x16_t a) {
+    const uint8x16_t weights = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t bits = vandq_u8(a, weights);
+    return vaddv_u8(vget_low_u8(bits)) | (vaddv_u8(vget_high_u8(bits)) << 8);
+}
+#endif
+
+// NOTE(Alexander): no alignment requirements
+inline u8x16
+u8x16_load(u8* src) {
+    u8x16 result;
+#if SIMD_SSE2
+    result.v = _mm_loadu_si128((__m128i*) src);
+#elif SIMD_NEON
+    result.v = vld1q_u8(src);
+#else
+    for (int i = 0; i < 16; i++) result.v[i] = src[i];
+#endif
+    return result;
+}
+
+inline void
+u8x16_store(u8* dest, u8x16 a) {
+#if SIMD_SSE2
+    _mm_storeu_si128((__m128i*) dest, a.v);
+#elif SIMD_NEON
+    vst1q_u8(dest, a.v);
+#else
+    for (int i = 0; i < 16; i++) dest[i] = a.v[i];
+#endif
+}
+
+// NOTE(Alexander): wraps around like regular u8 math
+inline u8x16
+operator-(u8x16 a, u8 value) {
+    u8x16 result;
+#if SIMD_SSE2
+    result.v = _mm_sub_epi8(a.v, _mm_set1_epi8((char) value));
+#elif SIMD_NEON
+    result.v = vsubq_u8(a.v, vdupq_n_u8(value));
+#else
+    for (int i = 0; i < 16; i++) result.v[i] = (u8) (a.v[i] - value);
+#endif
+    return result;
+}
+
+inline u32
+u8x16_equal_mask(u8x16 a, u8 value) {
+#if SIMD_SSE2
+    return (u32) _mm_movemask_epi8(_mm_cmpeq_epi8(a.v, _mm_set1_epi8((char) value)));
+#elif SIMD_NEON
+    return neon_movemask_u8(vceqq_u8(a.v, vdupq_n_u8(value)));
+#else
+    u32 result = 0;
+    for (int i = 0; i < 16; i++) result |= (u32) (a.v[i] == value) << i;
+    return result;
+#endif
+}
+
+// NOTE(Alexander): bytes that are less than limit, compared as unsigned
+inline u32
+u8x16_less_mask(u8x16 a, u8 limit) {
+#if SIMD_SSE2
+    // NOTE(Alexander): SSE2 only has signed compares, flipping the top bit makes them unsigned
+    __m128i bias = _mm_set1_epi8((char) 0x80);
+    __m128i less = _mm_cmplt_epi8(_mm_xor_si128(a.v, bias), _mm_xor_si128(_mm_set1_epi8((char) limit), bias));
+    return (u32) _mm_movemask_epi8(less);
+#elif SIMD_NEON
+    return neon_movemask_u8(vcltq_u8(a.v, vdupq_n_u8(limit)));
+#else
+    u32 result = 0;
+    for (int i = 0; i < 16; i++) result |= (u32) (a.v[i] < limit) << i;
+    return result;
+#endif
+}
@@ -0,0 +1,1903 @@
+// NOTE(Alexander): the simulation core, everything in here must stay free of
+// raylib window, audio, input and drawing calls so it can run headless.
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define sign(value) ((value) < 0 ? -1 : ((value) > 0 ? 1 : 0 ))
+
+bool
+box_collision(Entity_Store* store, s32 index, s32 other_index, v2* step_velocity, bool resolve) {
+    bool found = false;
+    
+    v2 p = store->p[index];
+    v2 size = store->size[index];
+    v2 other_p = store->p[other_index];
+    v2 other_size = store->size[other_index];
+    
+    v2 step_position = p + *step_velocity;
+    if (step_position.y + size.y > other_p.y && 
+        step_position.y < other_p.y + other_size.y) {
+        
+        if (step_velocity->x < 0.0f && p.x >= other_p.x + other_size.x) {
+            f32 x_overlap = other_p.x + other_size.x - step_position.x;
+            if (x_overlap > 0.0f) {
+                if (resolve) {
+                    step_velocity->x = other_p.x + other_size.x - p.x;
+                    store->velocity[index].x = 0.0f;
+                }
+                found = true;
+            }
+        } else if (step_velocity->x > 0.0f && p.x + size.x <= other_p.x) {
+            f32 x_overlap = step_position.x - other_p.x + size.x;
+            if (x_overlap > 0.0f) {
+                if (resolve) {
+                    step_velocity->x = other_p.x - size.x - p.x;
+                    store->velocity[index].x = 0.0f;
+                }
+                found = true;
+            }
+        }
+    }
+    
+    if (p.x + size.x > other_p.x && 
+        p.x < other_p.x + other_size.x) {
+        if (step_velocity->y < 0.0f && p.y < other_p.y + other_size.y &&
+            p.y + size.y > other_p.y) {
+            f32 y_overlap = step_position.y - other_p.y + other_size.y;
+            if (y_overlap > 0.0f) {
+                if (resolve) {
+                    step_velocity->y = other_p.y + other_size.y - p.y;
+                    store->velocity[index].y = 0.0f;
+                }
+                found = true;
+            }
+        } else if (step_velocity->y > 0.0f && p.y + size.y <= other_p.y) {
+            f32 y_overlap = step_position.y - other_p.y + size.y;
+            if (y_overlap > 0.0f) {
+                if (resolve) {
+                    step_velocity->y = other_p.y - size.y - p.y;
+                    store->velocity[index].y = 0.0f;
+                    store->flags[index] |= Entity_Flag_Grounded;
+                }
+                found = true;
+            }
+        }
+    }
+    
+    return found;
+}
+
+struct Sweep_Result {
+    bool hit;
+    f32 t; // NOTE(Alexander): fraction of the step at the time of impact
+    v2 normal;
+};
+
+// NOTE(Alexander): swept AABB, moves the box along step_velocity and finds the earliest
+// time of impact with other (slab test against other grown by the moving box size).
+// Boxes that already overlap at the start hit at t = 0, otherwise a target that moved
+// into the box between ticks is tunneled through and hits depend on the tick rate.
+Sweep_Result
+sweep_box(v2 p, v2 size, v2 step_velocity, v2 other_p, v2 other_size) {
+    Sweep_Result result = {};
+    
+    v2 min_p = other_p - size;
+    v2 max_p = other_p + other_size;
+    
+    f32 t_enter = -1e30f;
+    f32 t_exit = 1e30f;
+    v2 normal = {};
+    
+    for (int axis = 0; axis < 2; axis++) {
+        f32 d = step_velocity.data[axis];
+        f32 origin = p.data[axis];
+        if (d == 0.0f) {
+            if (origin <= min_p.data[axis] || origin >= max_p.data[axis]) {
+                return result;
+            }
+            continue;
+        }
+        
+        f32 inv_d = 1.0f/d;
+        f32 t0 = (min_p.data[axis] - origin)*inv_d;
+        f32 t1 = (max_p.data[axis] - origin)*inv_d;
+        if (t0 > t1) {
+            f32 temp = t0;
+            t0 = t1;
+            t1 = temp;
+        }
+        
+        if (t0 > t_enter) {
+            t_enter = t0;
+            normal = vec2_zero;
+            normal.data[axis] = d > 0.0f ? -1.0f : 1.0f;
+        }
+        t_exit = min(t_exit, t1);
+    }
+    
+    if (t_enter >= t_exit || t_exit <= 0.0f || t_enter > 1.0f) {
+        return result;
+    }
+    
+    result.hit = true;
+    result.t = max(t_enter, 0.0f);
+    result.normal = normal;
+    return result;
+}
+
+// NOTE(Alexander): 2D slab test, matches GetRayCollisionBox for rays in the z = 0 plane
+bool
+ray_box_collision(v2 origin, v2 dir, f32 min_dist, f32 max_dist, v2 box_min, v2 box_max) {
+    f32 inv_x = 1.0f/dir.x;
+    f32 inv_y = 1.0f/dir.y;
+    f32 t0 = (box_min.x - origin.x)*inv_x;
+    f32 t1 = (box_max.x - origin.x)*inv_x;
+    f32 t2 = (box_min.y - origin.y)*inv_y;
+    f32 t3 = (box_max.y - origin.y)*inv_y;
+    
+    f32 t_enter = fmaxf(fminf(t0, t1), fminf(t2, t3));
+    f32 t_exit = fminf(fmaxf(t0, t1), fmaxf(t2, t3));
+    if (t_exit < 0.0f || t_enter > t_exit) {
+        return false;
+    }
+    
+    return t_enter >= min_dist && t_enter <= max_dist;
+}
+
+
+inline void
+play_sound(Game_State* state, Sound_Id id, f32 pitch=0.0f) {
+    if (state->sound_event_count < MAX_SOUND_EVENTS) {
+        Sound_Event* event = &state->sound_events[state->sound_event_count++];
+        event->id = id;
+        event->pitch = pitch;
+    }
+}
+
+
+inline bool
+is_solid_tile(Solid_Map* map, s32 x, s32 y) {
+    if (map->streamer) {
+        return is_streamed_tile_solid(map->streamer, x, y);
+    }
+    
+    x -= map->min_x;
+    y -= map->min_y;
+    if (x < 0 || y < 0 || x >= map->width || y >= map->height) {
+        return false;
+    }
+    
+    s32 index = y*map->width + x;
+    return (map->bits[index >> 5] >> (index & 31)) & 1;
+}
+
+void
+init_solid_map(Solid_Map* map, Loaded_Tmx* tmx, Memory_Arena* arena) {
+    s32 min_x = 0;
+    s32 min_y = 0;
+    s32 max_x = tmx->tile_map_width;
+    s32 max_y = tmx->tile_map_height;
+    for (int i = 0; i < tmx->collider_count; i++) {
+        Collider* collider = &tmx->colliders[i];
+        min_x = min(min_x, (s32) floorf(collider->min_p.x));
+        min_y = min(min_y, (s32) floorf(collider->min_p.y));
+        max_x = max(max_x, (s32) ceilf(collider->max_p.x));
+        max_y = max(max_y, (s32) ceilf(collider->max_p.y));
+    }
+    
+    map->min_x = min_x;
+    map->min_y = min_y;
+    map->width = max_x - min_x;
+    map->height = max_y - min_y;
+    
+    s32 word_count = (map->width*map->height + 31)/32;
+    map->bits = push_array_of_structs(arena, word_count, u32, Arena_Tag_Solid_Map);
+    memset(map->bits, 0, word_count*sizeof(u32));
+    
+    for (int i = 0; i < tmx->collider_count; i++) {
+        s32 x0, y0, x1, y1;
+        get_collider_tiles(&tmx->colliders[i], &x0, &y0, &x1, &y1);
+        for (s32 y = y0 - min_y; y < y1 - min_y; y++) {
+            for (s32 x = x0 - min_x; x < x1 - min_x; x++) {
+                s32 index = y*map->width + x;
+                map->bits[index >> 5] |= 1u << (index & 31);
+            }
+        }
+    }
+}
+
+// NOTE(Alexander): sweeps the body against the solid tiles, first vertically using the
+// current x range then horizontally using the resolved y range. Only the tiles the step
+// crosses are visited, nearest first, so the first solid tile found is the one to stop at.
+bool
+tile_map_collision(Solid_Map* map, Entity_Store* store, s32 index, v2* step_velocity) {
+    bool found = false;
+    
+    v2 p = store->p[index];
+    v2 size = store->size[index];
+    
+    if (step_velocity->y != 0.0f) {
+        s32 x0 = (s32) floorf(p.x + TILE_EPSILON);
+        s32 x1 = (s32) ceilf(p.x + size.x - TILE_EPSILON);
+        
+        if (step_velocity->y > 0.0f) {
+            f32 bottom = p.y + size.y;
+            s32 y0 = (s32) ceilf(bottom - TILE_EPSILON);
+            s32 y1 = (s32) ceilf(bottom + step_velocity->y);
+            for (s32 y = y0; y < y1 && !found; y++) {
+                for (s32 x = x0; x < x1; x++) {
+                    if (is_solid_tile(map, x, y)) {
+                        step_velocity->y = (f32) y - size.y - p.y;
+                        store->velocity[index].y = 0.0f;
+                        store->flags[index] |= Entity_Flag_Grounded;
+                        found = true;
+                        break;
+                    }
+                }
+            }
+        } else {
+            s32 y0 = (s32) floorf(p.y + TILE_EPSILON) - 1;
+            s32 y1 = (s32) floorf(p.y + step_velocity->y);
+            for (s32 y = y0; y >= y1 && !found; y--) {
+                for (s32 x = x0; x < x1; x++) {
+                    if (is_solid_tile(map, x, y)) {
+                        step_velocity->y = (f32) (y + 1) - p.y;
+                        store->velocity[index].y = 0.0f;
+                        found = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    
+    if (step_velocity->x != 0.0f) {
+        f32 step_y = p.y + step_velocity->y;
+        s32 y0 = (s32) floorf(step_y + TILE_EPSILON);
+        s32 y1 = (s32) ceilf(step_y + size.y - TILE_EPSILON);
+        
+        bool blocked = false;
+        if (step_velocity->x > 0.0f) {
+            f32 right = p.x + size.x;
+            s32 x0 = (s32) ceilf(right - TILE_EPSILON);
+            s32 x1 = (s32) ceilf(right + step_velocity->x);
+            for (s32 x = x0; x < x1 && !blocked; x++) {
+                for (s32 y = y0; y < y1; y++) {
+                    if (is_solid_tile(map, x, y)) {
+                        step_velocity->x = (f32) x - size.x - p.x;
+                        blocked = true;
+                        break;
+                    }
+                }
+            }
+        } else {
+            s32 x0 = (s32) floorf(p.x + TILE_EPSILON) - 1;
+            s32 x1 = (s32) floorf(p.x + step_velocity->x);
+            for (s32 x = x0; x >= x1 && !blocked; x--) {
+                for (s32 y = y0; y < y1; y++) {
+                    if (is_solid_tile(map, x, y)) {
+                        step_velocity->x = (f32) (x + 1) - p.x;
+                        blocked = true;
+                        break;
+                    }
+                }
+            }
+        }
+        
+        if (blocked) {
+            store->velocity[index].x = 0.0f;
+            found = true;
+        }
+    }
+    
+    return found;
+}
+
+// NOTE(Alexander): the store is allocated once with a fixed capacity and kept across levels
+void
+init_entity_store(Entity_Store* store, s32 capacity) {
+    store->count = 0;
+    store->capacity = capacity;
+    
+    store->slots = (Entity_Slot*) calloc(capacity, sizeof(Entity_Slot));
+    store->slot = (u32*) malloc(capacity*sizeof(u32));
+    
+    store->type = (Entity_Type*) malloc(capacity*sizeof(Entity_Type));
+    store->flags = (u32*) malloc(capacity*sizeof(u32));
+    store->p = (v2*) malloc(capacity*sizeof(v2));
+    store->prev_p = (v2*) malloc(capacity*sizeof(v2));
+    store->size = (v2*) malloc(capacity*sizeof(v2));
+    store->velocity = (v2*) malloc(capacity*sizeof(v2));
+    store->acceleration = (v2*) malloc(capacity*sizeof(v2));
+    store->max_speed = (f32*) malloc(capacity*sizeof(f32));
+    store->health = (s32*) malloc(capacity*sizeof(s32));
+    store->collided_with = (Entity_Handle*) malloc(capacity*sizeof(Entity_Handle));
+    store->cold = (Entity*) malloc(capacity*sizeof(Entity));
+    
+    for (s32 i = 0; i < capacity; i++) {
+        store->slots[i].generation = 1;
+        store->slots[i].index = i + 1 < capacity ? i + 1 : -1;
+    }
+    store->first_free_slot = capacity > 0 ? 0 : -1;
+}
+
+inline Entity_Handle
+get_entity_handle(Entity_Store* store, s32 index) {
+    Entity_Handle result;
+    result.slot = store->slot[index];
+    result.generation = store->slots[result.slot].generation;
+    return result;
+}
+
+// NOTE(Alexander): returns the dense index of the entity or -1 if it has been despawned
+inline s32
+get_entity_index(Entity_Store* store, Entity_Handle handle) {
+    if (handle.generation == 0 || handle.slot >= (u32) store->capacity) {
+        return -1;
+    }
+    
+    Entity_Slot* slot = &store->slots[handle.slot];
+    if (slot->generation != handle.generation) {
+        return -1;
+    }
+    return slot->index;
+}
+
+inline bool
+is_entity_alive(Entity_Store* store, Entity_Handle handle) {
+    return get_entity_index(store, handle) != -1;
+}
+
+s32
+spawn_entity(Game_State* state, Entity_Type type, v2 p, v2 size, u32 flags=0) {
+    Entity_Store* store = &state->entities;
+    assert(store->first_free_slot != -1 && "entity store is full");
+    
+    s32 slot_index = store->first_free_slot;
+    Entity_Slot* slot = &store->slots[slot_index];
+    store->first_free_slot = slot->index;
+    
+    s32 index = store->count++;
+    slot->index = index;
+    store->slot[index] = slot_index;
+    
+    store->type[index] = type;
+    store->flags[index] = flags;
+    store->p[index] = p;
+    store->prev_p[index] = p;
+    store->size[index] = size;
+    store->velocity[index] = vec2_zero;
+    store->acceleration[index] = vec2_zero;
+    store->max_speed[index] = 0.0f;
+    store->health[index] = 0;
+    store->collided_with[index] = {};
+    store->cold[index] = {};
+    return index;
+}
+
+void
+despawn_entity(Entity_Store* store, Entity_Handle handle) {
+    s32 index = get_entity_index(store, handle);
+    if (index == -1) {
+        return;
+    }
+    
+    // Move the last entity into the hole to keep the arrays packed
+    s32 last = store->count - 1;
+    if (index != last) {
+        store->type[index] = store->type[last];
+        store->flags[index] = store->flags[last];
+        store->p[index] = store->p[last];
+        store->prev_p[index] = store->prev_p[last];
+        store->size[index] = store->size[last];
+        store->velocity[index] = store->velocity[last];
+        store->acceleration[index] = store->acceleration[last];
+        store->max_speed[index] = store->max_speed[last];
+        store->health[index] = store->health[last];
+        store->collided_with[index] = store->collided_with[last];
+        store->cold[index] = store->cold[last];
+        
+        store->slot[index] = store->slot[last];
+        store->slots[store->slot[index]].index = index;
+    }
+    store->count--;
+    
+    Entity_Slot* slot = &store->slots[handle.slot];
+    slot->generation++;
+    if (slot->generation == 0) {
+        slot->generation = 1;
+    }
+    slot->index = store->first_free_slot;
+    store->first_free_slot = handle.slot;
+}
+
+// NOTE(Alexander): removes every entity flagged for despawn this tick, walks backwards so
+// the entities moved into the holes have already been visited.
+void
+despawn_flagged_entities(Entity_Store* store) {
+    for (s32 i = store->count - 1; i >= 0; i--) {
+        if (store->flags[i] & Entity_Flag_Despawn) {
+            despawn_entity(store, get_entity_handle(store, i));
+        }
+    }
+}
+
+void
+clear_entity_store(Entity_Store* store) {
+    while (store->count > 0) {
+        despawn_entity(store, get_entity_handle(store, store->count - 1));
+    }
+}
+
+// NOTE(Alexander): dest needs room for src->count entities and src->capacity slots
+void
+copy_entity_store(Entity_Store* dest, Entity_Store* src) {
+    assert(dest->capacity >= src->capacity);
+    
+    s32 count = src->count;
+    dest->count = count;
+    dest->first_free_slot = src->first_free_slot;
+    memcpy(dest->slots, src->slots, src->capacity*sizeof(Entity_Slot));
+    memcpy(dest->slot, src->slot, count*sizeof(u32));
+    memcpy(dest->type, src->type, count*sizeof(Entity_Type));
+    memcpy(dest->flags, src->flags, count*sizeof(u32));
+    memcpy(dest->p, src->p, count*sizeof(v2));
+    memcpy(dest->prev_p, src->prev_p, count*sizeof(v2));
+    memcpy(dest->size, src->size, count*sizeof(v2));
+    memcpy(dest->velocity, src->velocity, count*sizeof(v2));
+    memcpy(dest->acceleration, src->acceleration, count*sizeof(v2));
+    memcpy(dest->max_speed, src->max_speed, count*sizeof(f32));
+    memcpy(dest->health, src->health, count*sizeof(s32));
+    memcpy(dest->collided_with, src->collided_with, count*sizeof(Entity_Handle));
+    memcpy(dest->cold, src->cold, count*sizeof(Entity));
+}
+
+// NOTE(Alexander): the interior arena fits on the screen so the camera never moves there, streamed
+// levels are bigger and the camera follows the player (snapped to whole pixels) inside the
+// map instead, keeping the chunks around it resident.
+void
+update_camera(Game_State* state) {
+    Level_Streamer* streamer = &state->level_streamer;
+    if (!streamer->header) {
+        return;
+    }
+    
+    Entity_Store* store = &state->entities;
+    s32 player = get_entity_index(store, state->player);
+    v2 view_size = vec2((f32) state->game_width, (f32) state->game_height)*state->pixels_to_meters;
+    v2 max_camera_p = vec2((f32) state->tile_map_width, (f32) state->tile_map_height) - view_size;
+    v2 camera_p = store->p[player] + store->size[player]*0.5f - view_size*0.5f;
+    camera_p.x = max(min(camera_p.x, max_camera_p.x), 0.0f);
+    camera_p.y = max(min(camera_p.y, max_camera_p.y), 0.0f);
+    state->camera_p.x = roundf(camera_p.x*state->meters_to_pixels)*state->pixels_to_meters;
+    state->camera_p.y = roundf(camera_p.y*state->meters_to_pixels)*state->pixels_to_meters;
+    
+    update_level_streamer(streamer, state->jobs, state->camera_p, state->camera_p + view_size);
+}
+
+void
+load_level(Game_State* state, Memory_Arena* arena) {
+    // NOTE(Alexander): chunks that are still loading read the colliders of the old level
+    Level_Streamer* streamer = &state->level_streamer;
+    close_level_streamer(streamer, state->jobs);
+    clear(arena);
+    
+    // NOTE(Alexander): the cooked level is mapped again on every load, the old mapping
+    // has our tile edits in it while a fresh one starts from the file again.
+    unmap_file(&state->level_file);
+    cstring cooked_filename = "assets/interior.lvl";
+    cstring source_filename = "assets/interior.tmx";
+#if BUILD_DEBUG
+    if (is_cooked_level_stale(cooked_filename, source_filename)) {
+        pln("Cooked level is older than %s, re-run the cooker", source_filename);
+    }
+#endif
+    
+    Loaded_Tmx tmx = load_cooked_level(&state->level_file, cooked_filename);
+    
+    // NOTE(Alexander): open world levels also have their tiles cooked into a chunk stream
+    // (cooker -stream), the interior fits in memory so there usually isn't one. The full
+    // tile layers are never touched then, only the objects are used from the level.
+    bool is_streamed = open_level_streamer(streamer, state->jobs, "assets/interior.lvs");
+    if (!tmx.is_loaded) {
+        pln("Failed to load %s, parsing %s instead", cooked_filename, source_filename);
+        tmx = read_tmx_map_data(string_lit(source_filename), arena, is_streamed);
+    }
+    
+    if (is_streamed) {
+        streamer->colliders = tmx.colliders;
+        streamer->collider_count = tmx.collider_count;
+        state->tile_layer_count = 0;
+        state->tile_map_width = streamer->header->tile_map_width;
+        state->tile_map_height = streamer->header->tile_map_height;
+        state->tile_chunk_width = 0;
+        state->tile_chunk_height = 0;
+        state->tile_chunk_dirty = 0;
+    } else {
+        for (int i = 0; i < tmx.layer_count; i++) {
+            state->tile_layers[i] = tmx.layers[i];
+        }
+        state->tile_layer_count = tmx.layer_count;
+        state->tile_map_width = tmx.tile_map_width;
+        state->tile_map_height = tmx.tile_map_height;
+        
+        // NOTE(Alexander): everything is dirty after loading a new tile map
+        state->tile_chunk_width = (state->tile_map_width + TILE_CHUNK_SIZE - 1)/TILE_CHUNK_SIZE;
+        state->tile_chunk_height = (state->tile_map_height + TILE_CHUNK_SIZE - 1)/TILE_CHUNK_SIZE;
+        s32 tile_chunk_count = state->tile_chunk_width*state->tile_chunk_height;
+        state->tile_chunk_dirty = push_array_of_structs(arena, tile_chunk_count, u8, Arena_Tag_Tile_Chunk);
+        memset(state->tile_chunk_dirty, 1, tile_chunk_count);
+    }
+    
+    Entity_Store* store = &state->entities;
+    clear_entity_store(store);
+    state->bullet_count = 0;
+    state->charged_bullet = {};
+    
+    for (int i = 0; i < tmx.entity_count; i++) {
+        Entity_Spawn* spawn = &tmx.entities[i];
+        spawn_entity(state, spawn->type, spawn->p, spawn->size);
+    }
+    
+    s32 left_door = spawn_entity(state, Door, vec2(0.0f, 10.0f), vec2(1.0f, 0.0f));
+    state->left_door = get_entity_handle(store, left_door);
+    store->health[left_door] = 1;
+    store->cold[left_door].sprite = &state->sprite_door;
+    
+    s32 right_door = spawn_entity(state, Door, vec2(21.0f, 10.0f), vec2(1.0f, 0.0f));
+    state->right_door = get_entity_handle(store, right_door);
+    store->health[right_door] = 1;
+    store->cold[right_door].sprite = &state->sprite_door;
+    
+    
+#if BUILD_DEBUG
+    v2 player_p = vec2(16.0f, 12.0f);
+#else 
+    v2 player_p = vec2(24.0f, 12.0f);
+#endif
+    s32 player = spawn_entity(state, Player, player_p, vec2(1.0f, 2.0f), Entity_Flag_Rigidbody);
+    state->player = get_entity_handle(store, player);
+    store->max_speed[player] = 3.0f;
+    store->health[player] = 1000;
+    Entity* player_entity = &store->cold[player];
+    player_entity->sprite = &state->sprite_player;
+    player_entity->facing_dir = 1.0f;
+    player_entity->color = SKYBLUE;
+    player_entity->max_health = store->health[player];
+    
+#if BUILD_DEBUG
+    v2 boss_p = vec2(3.0f, 10.0f);
+#else 
+    v2 boss_p = vec2(-7.0f, 10.0f);
+#endif
+    s32 boss_enemy = spawn_entity(state, Boss_Dragon, boss_p, vec2(4.0f, 4.0f), Entity_Flag_Rigidbody);
+    state->boss_enemy = get_entity_handle(store, boss_enemy);
+    store->max_speed[boss_enemy] = 2.5f;
+    store->health[boss_enemy] = 1000;
+    Entity* boss_entity = &store->cold[boss_enemy];
+    boss_entity->flip_texture = true;
+    boss_entity->sprite = &state->sprite_dragon;
+    boss_entity->num_frames = 8;
+    boss_entity->idle_frame = 8;
+    boss_entity->frame_advance_rate = 2.5f;
+    boss_entity->color = RED;
+    boss_entity->max_health = store->health[boss_enemy];
+    
+    if (is_streamed) {
+        state->solid_map = {};
+        state->solid_map.streamer = streamer;
+        
+        // NOTE(Alexander): the chunks around the player have to be there before the first tick
+        update_camera(state);
+        wait_for_counter(state->jobs, &streamer->pending);
+    } else {
+        init_solid_map(&state->solid_map, &tmx, arena);
+    }
+}
+
+inline bool
+is_in_level_snapshot_arena(Level_Snapshot* snapshot, void* pointer) {
+    return ((u8*) pointer >= snapshot->arena_base &&
+            (u8*) pointer < snapshot->arena_base + snapshot->arena_used);
+}
+
+// NOTE(Alexander): moves pointers into the snapshot arena to the same offset in base
+inline void*
+rebase_level_pointer(Level_Snapshot* snapshot, void* pointer, u8* base) {
+    if (is_in_level_snapshot_arena(snapshot, pointer)) {
+        return base + ((u8*) pointer - snapshot->arena_base);
+    }
+    return pointer;
+}
+
+void
+free_level_snapshot(Level_Snapshot* snapshot) {
+    free(snapshot->arena_data);
+    free(snapshot->tile_data);
+    snapshot->arena_data = 0;
+    snapshot->tile_data = 0;
+    snapshot->is_valid = false;
+}
+
+// NOTE(Alexander): has to be called right after load_level, before anything else is pushed
+// on the arena. Entity handles are restored with their generations as well, which is fine
+// since every handle into the store lives in the state that gets restored along with it.
+void
+save_level_snapshot(Game_State* state, Memory_Arena* arena) {
+    Level_Snapshot* snapshot = &state->level_snapshot;
+    free_level_snapshot(snapshot);
+    
+    // NOTE(Alexander): the tiles and solid bits of streamed levels belong to the streamer,
+    // restarts load the level again which reopens the stream as well
+    if (state->level_streamer.header) {
+        return;
+    }
+    
+    snapshot->arena_base = arena->base;
+    snapshot->arena_used = arena->curr_used;
+    
+    // NOTE(Alexander): if loading spilled into a new arena block the earlier allocations
+    // are in a block that clear frees, so keep loading the level from disk instead. Tile
+    // layers of a cooked level point into the file mapping and are fine anywhere in it.
+    bool fits = (is_in_level_snapshot_arena(snapshot, state->tile_chunk_dirty) &&
+                 is_in_level_snapshot_arena(snapshot, state->solid_map.bits));
+    Mapped_File* file = &state->level_file;
+    for (int i = 0; i < state->tile_layer_count && fits; i++) {
+        u8* tiles = (u8*) state->tile_layers[i].tiles;
+        u8* flips = state->tile_layers[i].flips;
+        bool tiles_in_file = file->data && tiles >= file->data && tiles < file->data + file->size;
+        bool flips_in_file = file->data && flips >= file->data && flips < file->data + file->size;
+        fits = ((tiles_in_file || is_in_level_snapshot_arena(snapshot, tiles)) &&
+                (!flips || flips_in_file || is_in_level_snapshot_arena(snapshot, flips)));
+    }
+    if (!fits) {
+        pln("Level doesn't fit in one arena block, restarts will reload it");
+        return;
+    }
+    
+    snapshot->arena_data = (u8*) malloc(snapshot->arena_used);
+    memcpy(snapshot->arena_data, arena->base, snapshot->arena_used);
+    
+    // NOTE(Alexander): the tiles of the cooked level live in the file mapping instead of the
+    // arena, so all layers are copied into tile_data back to back, each followed by its flips
+    s32 tile_count = state->tile_map_width*state->tile_map_height;
+    umm tile_data_size = 0;
+    for (int i = 0; i < state->tile_layer_count; i++) {
+        Tile_Layer* layer = &state->tile_layers[i];
+        tile_data_size += tile_count*layer->element_size + (layer->flips ? tile_count : 0);
+    }
+    
+    snapshot->tile_data = (u8*) malloc(tile_data_size);
+    u8* tile_data = snapshot->tile_data;
+    for (int i = 0; i < state->tile_layer_count; i++) {
+        Tile_Layer* layer = &state->tile_layers[i];
+        memcpy(tile_data, layer->tiles, tile_count*layer->element_size);
+        tile_data += tile_count*layer->element_size;
+        if (layer->flips) {
+            memcpy(tile_data, layer->flips, tile_count);
+            tile_data += tile_count;
+        }
+        snapshot->tile_layers[i] = *layer;
+    }
+    snapshot->tile_layer_count = state->tile_layer_count;
+    snapshot->tile_map_width = state->tile_map_width;
+    snapshot->tile_map_height = state->tile_map_height;
+    snapshot->tile_chunk_dirty = state->tile_chunk_dirty;
+    snapshot->tile_chunk_width = state->tile_chunk_width;
+    snapshot->tile_chunk_height = state->tile_chunk_height;
+    snapshot->solid_map = state->solid_map;
+    
+    if (!snapshot->entities.slots) {
+        init_entity_store(&snapshot->entities, state->entities.capacity);
+    }
+    copy_entity_store(&snapshot->entities, &state->entities);
+    snapshot->player = state->player;
+    snapshot->boss_enemy = state->boss_enemy;
+    snapshot->left_door = state->left_door;
+    snapshot->right_door = state->right_door;
+    
+    snapshot->is_valid = true;
+}
+
+bool
+restore_level_snapshot(Game_State* state, Memory_Arena* arena) {
+    Level_Snapshot* snapshot = &state->level_snapshot;
+    if (!snapshot->is_valid) {
+        return false;
+    }
+    
+    // NOTE(Alexander): the arena keeps its block when cleared so this is normally the same
+    // memory as before, but the pointers are rebased anyway in case the block changed.
+    clear(arena);
+    u8* base = (u8*) push_size(arena, snapshot->arena_used, DEFAULT_ALIGNMENT, Arena_Tag_Level_Snapshot);
+    memcpy(base, snapshot->arena_data, snapshot->arena_used);
+    
+    s32 tile_count = snapshot->tile_map_width*snapshot->tile_map_height;
+    u8* tile_data = snapshot->tile_data;
+    for (int i = 0; i < snapshot->tile_layer_count; i++) {
+        Tile_Layer* layer = &state->tile_layers[i];
+        *layer = snapshot->tile_layers[i];
+        layer->tiles = rebase_level_pointer(snapshot, layer->tiles, base);
+        memcpy(layer->tiles, tile_data, tile_count*layer->element_size);
+        tile_data += tile_count*layer->element_size;
+        if (layer->flips) {
+            layer->flips = (u8*) rebase_level_pointer(snapshot, layer->flips, base);
+            memcpy(layer->flips, tile_data, tile_count);
+            tile_data += tile_count;
+        }
+    }
+    state->tile_layer_count = snapshot->tile_layer_count;
+    state->tile_map_width = snapshot->tile_map_width;
+    state->tile_map_height = snapshot->tile_map_height;
+    state->tile_chunk_dirty = (u8*) rebase_level_pointer(snapshot, snapshot->tile_chunk_dirty, base);
+    state->tile_chunk_width = snapshot->tile_chunk_width;
+    state->tile_chunk_height = snapshot->tile_chunk_height;
+    state->solid_map = snapshot->solid_map;
+    state->solid_map.bits = (u32*) rebase_level_pointer(snapshot, snapshot->solid_map.bits, base);
+    
+    copy_entity_store(&state->entities, &snapshot->entities);
+    state->player = snapshot->player;
+    state->boss_enemy = snapshot->boss_enemy;
+    state->left_door = snapshot->left_door;
+    state->right_door = snapshot->right_door;
+    state->bullet_count = 0;
+    state->charged_bullet = {};
+    return true;
+}
+
+// NOTE(Alexander): only the first call loads the level, restarts restore the snapshot taken
+// then. Call free_level_snapshot first to load the level from disk again.
+Entity_Handle
+init_level(Game_State* state, Memory_Arena* arena) {
+#if BUILD_DEBUG
+    state->start_music = true;
+    state->mode = Control_Boss_Enemy;
+#else
+    state->mode = Intro_Cutscene;
+    state->cutscene_time = 0.0f;
+#endif
+    
+    if (!restore_level_snapshot(state, arena)) {
+        load_level(state, arena);
+        save_level_snapshot(state, arena);
+    }
+    
+    return state->player;
+}
+
+// NOTE(Alexander): unit directions around the circle so spawning doesn't call cosf/sinf
+#define PARTICLE_DIRECTION_COUNT 1024
+
+static f32 particle_direction_x[PARTICLE_DIRECTION_COUNT];
+static f32 particle_direction_y[PARTICLE_DIRECTION_COUNT];
+
+// NOTE(Alexander): tiles changed at runtime have to go through here so the renderer re-bakes them.
+// The layer keeps the element size it was loaded with, so the gid has to fit in it and flips
+// can only be set on layers that already have some.
+// Streamed levels have no tile layers in memory, so tiles can't be changed there.
+void
+set_tile(Game_State* state, s32 layer_index, s32 x, s32 y, u32 gid) {
+    if (layer_index < 0 || layer_index >= state->tile_layer_count ||
+        x < 0 || y < 0 || x >= state->tile_map_width || y >= state->tile_map_height) {
+        return;
+    }
+    
+    Tile_Layer* layer = &state->tile_layers[layer_index];
+    s32 index = y*state->tile_map_width + x;
+    u32 tile = gid & TILE_GID_MASK;
+    switch (layer->element_size) {
+        case 1: {
+            assert(tile <= 0xFF && "gid doesn't fit in the layer");
+            ((u8*) layer->tiles)[index] = (u8) tile;
+        } break;
+        
+        case 2: {
+            assert(tile <= 0xFFFF && "gid doesn't fit in the layer");
+            ((u16*) layer->tiles)[index] = (u16) tile;
+        } break;
+        
+        default: {
+            ((u32*) layer->tiles)[index] = tile;
+        } break;
+    }
+    
+    if (layer->flips) {
+        layer->flips[index] = (u8) (gid >> 28);
+    } else {
+        assert((gid & ~TILE_GID_MASK) == 0 && "layer has no room for flips");
+    }
+    
+    s32 chunk_index = (y/TILE_CHUNK_SIZE)*state->tile_chunk_width + x/TILE_CHUNK_SIZE;
+    state->tile_chunk_dirty[chunk_index] = 1;
+}
+
+// NOTE(Alexander): the particle arrays are pushed on the pool's arena next to the slabs, so
+// they stay around with the arena even if the system is given back to the pool.
+Particle_System*
+init_particle_system(Memory_Pool* pool, int max_particle_count) {
+    if (particle_direction_x[0] == 0.0f) {
+        for (int i = 0; i < PARTICLE_DIRECTION_COUNT; i++) {
+            f32 angle = (f32) i*(2.0f*PI_F32/PARTICLE_DIRECTION_COUNT);
+            particle_direction_x[i] = cosf(angle);
+            particle_direction_y[i] = sinf(angle);
+        }
+    }
+    
+    Particle_System* ps = pool_alloc_struct(pool, Particle_System);
+    int capacity = (max_particle_count + SIMD_WIDTH - 1)/SIMD_WIDTH*SIMD_WIDTH;
+    
+    // NOTE(Alexander): arena memory isn't zeroed and the padding lanes are updated too
+    umm array_size = capacity*sizeof(f32);
+    f32* arrays = (f32*) push_size(pool->arena, 5*array_size, SIMD_WIDTH*sizeof(f32), Arena_Tag_Particle_System);
+    memset(arrays, 0, 5*array_size);
+    ps->p_x = arrays;
+    ps->p_y = arrays + capacity;
+    ps->v_x = arrays + capacity*2;
+    ps->v_y = arrays + capacity*3;
+    ps->t = arrays + capacity*4;
+    ps->max_particle_count = max_particle_count;
+    
+    // NOTE(Alexander): any non-zero seeds will do, different per lane
+    for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+        ps->random_state[lane] = 0x9E3779B9u*(lane + 1) ^ (u32) max_particle_count;
+    }
+    return ps;
+}
+
+struct Particle_Update_Job {
+    Particle_System* ps;
+    f32 delta_time;
+};
+
+// NOTE(Alexander): begin and end are in SIMD_WIDTH lane groups, so batches never share a lane
+void
+integrate_particles(void* data, s32 begin, s32 end) {
+    Particle_Update_Job* job = (Particle_Update_Job*) data;
+    Particle_System* ps = job->ps;
+    
+    // The padding lanes past particle_count are updated too but never read
+    f32x4 dt = f32x4_set1(job->delta_time);
+    f32x4 fade = f32x4_set1(ps->fade_rate*job->delta_time);
+    for (int i = begin*SIMD_WIDTH; i < end*SIMD_WIDTH; i += SIMD_WIDTH) {
+        f32x4 p_x = f32x4_load(ps->p_x + i);
+        f32x4 p_y = f32x4_load(ps->p_y + i);
+        f32x4 v_x = f32x4_load(ps->v_x + i);
+        f32x4 v_y = f32x4_load(ps->v_y + i);
+        f32x4 t = f32x4_load(ps->t + i);
+        
+        f32x4_store(ps->p_x + i, p_x + v_x*dt);
+        f32x4_store(ps->p_y + i, p_y + v_y*dt);
+        f32x4_store(ps->t + i, t - fade);
+    }
+}
+
+void
+update_particle_system(Job_System* jobs, Particle_System* ps, bool spawn_new, f32 delta_time) {
+    // Remove dead particles in one pass, each hole is filled with the last live particle
+    // so only as many particles are moved as have died.
+    int count = ps->particle_count;
+    for (int i = 0; i < count; i++) {
+        if (ps->t[i] > 0.0f) continue;
+        
+        do {
+            count--;
+        } while (count > i && ps->t[count] <= 0.0f);
+        
+        if (count > i) {
+            ps->p_x[i] = ps->p_x[count];
+            ps->p_y[i] = ps->p_y[count];
+            ps->v_x[i] = ps->v_x[count];
+            ps->v_y[i] = ps->v_y[count];
+            ps->t[i] = ps->t[count];
+        }
+    }
+    ps->particle_count = count;
+    
+    if (spawn_new) {
+        // Spawn new particles, up to 600 attempts per second independent of tick rate
+        ps->spawn_budget += 600.0f*delta_time;
+        int spawn_attempts = (int) ps->spawn_budget;
+        ps->spawn_budget -= (f32) spawn_attempts;
+        
+        // NOTE(Alexander): angles are generated directly in direction table units
+        f32 angle_scale = PARTICLE_DIRECTION_COUNT/(2.0f*PI_F32);
+        f32x4 min_angle = f32x4_set1(ps->min_angle*angle_scale);
+        f32x4 angle_range = f32x4_set1((ps->max_angle - ps->min_angle)*angle_scale);
+        u32x4 random = u32x4_load(ps->random_state);
+        
+        for (int i = 0; i < spawn_attempts; i += SIMD_WIDTH) {
+            random = random_next_x4(random);
+            f32 roll[SIMD_WIDTH];
+            f32x4_store(roll, random_unilateral_x4(random));
+            
+            random = random_next_x4(random);
+            f32 angle[SIMD_WIDTH];
+            f32x4_store(angle, min_angle + random_unilateral_x4(random)*angle_range);
+            
+            int lane_count = min(spawn_attempts - i, SIMD_WIDTH);
+            for (int lane = 0; lane < lane_count; lane++) {
+                if (ps->particle_count < ps->max_particle_count && roll[lane] < ps->spawn_rate) {
+                    int index = ps->particle_count++;
+                    int direction = (int) floorf(angle[lane]) & (PARTICLE_DIRECTION_COUNT - 1);
+                    ps->p_x[index] = ps->start_p.x;
+                    ps->p_y[index] = ps->start_p.y;
+                    ps->v_x[index] = particle_direction_x[direction]*ps->speed;
+                    ps->v_y[index] = particle_direction_y[direction]*ps->speed;
+                    ps->t[index] = 1.0f;
+                }
+            }
+        }
+        
+        u32x4_store(ps->random_state, random);
+    }
+    
+    // Update live particles, only big systems are worth splitting across the job system
+    Particle_Update_Job job;
+    job.ps = ps;
+    job.delta_time = delta_time;
+    s32 lane_group_count = (ps->particle_count + SIMD_WIDTH - 1)/SIMD_WIDTH;
+    parallel_for(jobs, lane_group_count, PARTICLE_JOB_BATCH_SIZE/SIMD_WIDTH, integrate_particles, &job);
+}
+
+void
+init_simulation(Game_State* state) {
+    init_entity_store(&state->entities, MAX_ENTITY_COUNT);
+    
+    // NOTE(Alexander): only address space is reserved so this can be generous, the level
+    // then never spills into a new block and restarts don't leak. Falls back to calloc
+    // blocks without virtual memory.
+    init_virtual_arena(&state->level_arena, megabytes(256));
+    
+    set_minimum_arena_block_size(&state->permanent_arena, megabytes(1));
+    init_pool_of_structs(&state->particle_system_pool, &state->permanent_arena, Particle_System,
+                         Arena_Tag_Particle_System, 8);
+#if BUILD_DEBUG
+    check_pool_reuse(&state->particle_system_pool);
+#endif
+    
+    // Fire attack
+    state->ps_fire = init_particle_system(&state->particle_system_pool, 500);
+    state->ps_fire->start_p = vec2(5.0f, 5.0f);
+    
+    state->ps_fire->min_angle = PI_F32/4.0f + 0.3f; 
+    state->ps_fire->max_angle = PI_F32/4.0f - 0.3f;
+    
+    state->ps_fire->speed = 6.0f;
+    
+    state->ps_fire->spawn_rate = 0.6f;
+    state->ps_fire->fade_rate = 0.9f;
+    
+    // Charging attack
+    state->ps_charging = init_particle_system(&state->particle_system_pool, 100);
+    state->ps_charging->start_p = vec2(5.0f, 5.0f);
+    
+    state->ps_charging->min_angle = 0;
+    state->ps_charging->max_angle = PI_F32*2.0f;
+    
+    state->ps_charging->speed = 3.0f;
+    
+    state->ps_charging->spawn_rate = 0.5f;
+    state->ps_charging->fade_rate = 2.4f;
+}
+
+inline s32
+grid_cell_coord(f32 value, s32 count) {
+    // NOTE(Alexander): truncation is fine here, everything below zero is clamped to the first cell anyway
+    s32 result = (s32) (value * (1.0f/GRID_CELL_SIZE));
+    if (result < 0) result = 0;
+    if (result >= count) result = count - 1;
+    return result;
+}
+
+// NOTE(Alexander): entities outside the level are clamped into the border cells
+inline Grid_Range
+get_grid_range(Spatial_Grid* grid, v2 min_p, v2 max_p) {
+    Grid_Range result;
+    result.min_x = grid_cell_coord(min_p.x, grid->width);
+    result.min_y = grid_cell_coord(min_p.y, grid->height);
+    result.max_x = grid_cell_coord(max_p.x, grid->width);
+    result.max_y = grid_cell_coord(max_p.y, grid->height);
+    return result;
+}
+
+// NOTE(Alexander): dead rigidbodies are skipped by check_collisions anyway
+inline bool
+is_collidable(Entity_Store* store, s32 index) {
+    if (store->flags[index] & Entity_Flag_Rigidbody) {
+        return store->health[index] > 0;
+    }
+    return store->type[index] == Box_Collider || store->type[index] == Door;
+}
+
+// NOTE(Alexander): entities keep moving while the tick is processed so the stored boxes
+// are grown by how far they can travel this tick plus a small margin for teleports.
+inline Grid_Range
+get_entity_grid_range(Spatial_Grid* grid, Entity_Store* store, s32 index, f32 delta_time) {
+    v2 p = store->p[index];
+    v2 margin = abs(store->velocity[index])*delta_time + vec2(GRID_MARGIN, GRID_MARGIN);
+    return get_grid_range(grid, p - margin, p + store->size[index] + margin);
+}
+
+struct Grid_Range_Job {
+    Spatial_Grid* grid;
+    Entity_Store* store;
+    f32 delta_time;
+};
+
+void
+compute_entity_grid_ranges(void* data, s32 begin, s32 end) {
+    Grid_Range_Job* job = (Grid_Range_Job*) data;
+    for (s32 i = begin; i < end; i++) {
+        if (is_collidable(job->store, i)) {
+            job->grid->entity_ranges[i] = get_entity_grid_range(job->grid, job->store, i, job->delta_time);
+        } else {
+            // NOTE(Alexander): empty range, min > max
+            job->grid->entity_ranges[i] = { 0, 0, -1, -1 };
+        }
+    }
+}
+
+void
+build_spatial_grid(Game_State* state, f32 delta_time) {
+    Entity_Store* store = &state->entities;
+    Spatial_Grid* grid = &state->grid;
+    grid->width = max((s32) ceilf(state->tile_map_width / GRID_CELL_SIZE), 1);
+    grid->height = max((s32) ceilf(state->tile_map_height / GRID_CELL_SIZE), 1);
+    
+    s32 cell_count = grid->width*grid->height;
+    if (cell_count + 1 > grid->cell_capacity) {
+        grid->cell_capacity = cell_count + 1;
+        grid->cell_offsets = (s32*) realloc(grid->cell_offsets, grid->cell_capacity*sizeof(s32));
+    }
+    memset(grid->cell_offsets, 0, (cell_count + 1)*sizeof(s32));
+    
+    if (store->count > grid->entity_range_capacity) {
+        grid->entity_range_capacity = store->count*2;
+        grid->entity_ranges = (Grid_Range*) realloc(grid->entity_ranges, grid->entity_range_capacity*sizeof(Grid_Range));
+    }
+    
+    Grid_Range_Job job;
+    job.grid = grid;
+    job.store = store;
+    job.delta_time = delta_time;
+    parallel_for(state->jobs, store->count, GRID_JOB_BATCH_SIZE, compute_entity_grid_ranges, &job);
+    
+    // Count entities per cell
+    for (int i = 0; i < store->count; i++) {
+        Grid_Range range = grid->entity_ranges[i];
+        for (s32 y = range.min_y; y <= range.max_y; y++) {
+            for (s32 x = range.min_x; x <= range.max_x; x++) {
+                grid->cell_offsets[y*grid->width + x + 1]++;
+            }
+        }
+    }
+    
+    for (s32 cell_index = 0; cell_index < cell_count; cell_index++) {
+        grid->cell_offsets[cell_index + 1] += grid->cell_offsets[cell_index];
+    }
+    
+    s32 index_count = grid->cell_offsets[cell_count];
+    if (index_count > grid->entity_index_capacity) {
+        grid->entity_index_capacity = index_count*2;
+        grid->entity_indices = (s32*) realloc(grid->entity_indices, grid->entity_index_capacity*sizeof(s32));
+    }
+    
+    // Fill cells, cell_offsets[cell] is used as the write cursor and ends up
+    // pointing at the next cell, so shift back afterwards.
+    for (int i = 0; i < store->count; i++) {
+        Grid_Range range = grid->entity_ranges[i];
+        for (s32 y = range.min_y; y <= range.max_y; y++) {
+            for (s32 x = range.min_x; x <= range.max_x; x++) {
+                grid->entity_indices[grid->cell_offsets[y*grid->width + x]++] = i;
+            }
+        }
+    }
+    
+    for (s32 cell_index = cell_count; cell_index > 0; cell_index--) {
+        grid->cell_offsets[cell_index] = grid->cell_offsets[cell_index - 1];
+    }
+    grid->cell_offsets[0] = 0;
+}
+
+// NOTE(Alexander): collects the unique entities near the box in increasing index order,
+// so resolving collisions visits them in the same order as a full scan would.
+s32
+query_spatial_grid(Spatial_Grid* grid, v2 min_p, v2 max_p) {
+    Grid_Range range = get_grid_range(grid, min_p, max_p);
+    
+    s32 count = 0;
+    for (s32 y = range.min_y; y <= range.max_y; y++) {
+        for (s32 x = range.min_x; x <= range.max_x; x++) {
+            s32 cell_index = y*grid->width + x;
+            s32 begin = grid->cell_offsets[cell_index];
+            s32 end = grid->cell_offsets[cell_index + 1];
+            
+            if (count + (end - begin) > grid->candidate_capacity) {
+                grid->candidate_capacity = max((count + (end - begin))*2, 64);
+                grid->candidates = (s32*) realloc(grid->candidates, grid->candidate_capacity*sizeof(s32));
+            }
+            
+            for (s32 k = begin; k < end; k++) {
+                grid->candidates[count++] = grid->entity_indices[k];
+            }
+        }
+    }
+    
+    // Insertion sort, candidate lists are short
+    s32* candidates = grid->candidates;
+    for (s32 i = 1; i < count; i++) {
+        s32 value = candidates[i];
+        s32 j = i - 1;
+        for (; j >= 0 && candidates[j] > value; j--) {
+            candidates[j + 1] = candidates[j];
+        }
+        candidates[j + 1] = value;
+    }
+    
+    s32 unique_count = 0;
+    for (s32 i = 0; i < count; i++) {
+        if (unique_count == 0 || candidates[unique_count - 1] != candidates[i]) {
+            candidates[unique_count++] = candidates[i];
+        }
+    }
+    
+    return unique_count;
+}
+
+bool
+check_collisions(Game_State* state, s32 index, v2* step_velocity) {
+    Entity_Store* store = &state->entities;
+    bool result = false;
+    store->flags[index] &= ~Entity_Flag_Collided;
+    store->collided_with[index] = {};
+    
+    v2 p = store->p[index];
+    v2 size = store->size[index];
+    Entity_Type type = store->type[index];
+    u32 flags = store->flags[index];
+    
+    // Dead bodies don't collide with other entities
+    bool is_dead_rigidbody = (flags & Entity_Flag_Rigidbody) && store->health[index] <= 0;
+    
+    // Only test entities near the swept box of this step
+    v2 step_p = p + *step_velocity;
+    v2 min_p = vec2(min(p.x, step_p.x), min(p.y, step_p.y));
+    v2 max_p = vec2(max(p.x, step_p.x), max(p.y, step_p.y)) + size;
+    
+    // Static level geometry
+    if (tile_map_collision(&state->solid_map, store, index, step_velocity)) {
+        store->flags[index] |= Entity_Flag_Collided;
+        result = true;
+    }
+    
+    Spatial_Grid* grid = &state->grid;
+    s32 candidate_count = is_dead_rigidbody ? 0 : query_spatial_grid(grid, min_p, max_p);
+    
+    s32 first_hit = -1;
+    Sweep_Result first_sweep = {};
+    
+    for (int candidate_index = 0; candidate_index < candidate_count; candidate_index++) {
+        s32 other = grid->candidates[candidate_index];
+        Entity_Type other_type = store->type[other];
+        bool other_is_rigidbody = (store->flags[other] & Entity_Flag_Rigidbody) != 0;
+        if ((other != index && other_is_rigidbody) || 
+            other_type == Box_Collider ||
+            other_type == Door) {
+            
+            // Some collision exceptions
+            if ((type == Player && (other_type == Bullet || other_type == Charged_Bullet)) ||
+                ((type == Bullet || type == Charged_Bullet) && other_type == Player) ||
+                //(type == Player && other_type == Boss_Dragon) ||
+                //(type == Boss_Dragon && other_type == Player) ||
+                (other_is_rigidbody && store->health[other] <= 0)) {
+                continue;
+            }
+            
+            if (flags & Entity_Flag_Fast) {
+                // Fast bodies only care about the earliest hit along the step, otherwise
+                // they could tunnel through thin entities in a single tick.
+                Sweep_Result sweep = sweep_box(p, size, *step_velocity,
+                                               store->p[other], store->size[other]);
+                if (sweep.hit && (first_hit == -1 || sweep.t < first_sweep.t)) {
+                    first_hit = other;
+                    first_sweep = sweep;
+                }
+                continue;
+            }
+            
+            bool collided = box_collision(store, index, other, step_velocity, !other_is_rigidbody);
+            if (collided) {
+                store->flags[index] |= Entity_Flag_Collided;
+                store->collided_with[index] = get_entity_handle(store, other);
+                result = true;
+            }
+        }
+    }
+    
+    if (first_hit != -1) {
+        if (!(store->flags[first_hit] & Entity_Flag_Rigidbody)) {
+            *step_velocity *= first_sweep.t;
+            if (first_sweep.normal.x != 0.0f) store->velocity[index].x = 0.0f;
+            if (first_sweep.normal.y != 0.0f) store->velocity[index].y = 0.0f;
+        }
+        
+        store->flags[index] |= Entity_Flag_Collided;
+        store->collided_with[index] = get_entity_handle(store, first_hit);
+        result = true;
+    }
+    
+    return result;
+}
+
+
+inline v2
+get_bullet_velocity(Entity_Type type, f32 facing_dir) {
+    f32 bullet_speed = type == Charged_Bullet ? 20.0f : 12.0f;
+    if (facing_dir == 0.0f) {
+        return vec2(0.0f, -bullet_speed);
+    }
+    return vec2(bullet_speed*facing_dir, 0.0f);
+}
+
+Entity_Handle
+shoot_bullet(Game_State* state, s32 shooter, Entity_Type type, bool upward) {
+    Entity_Store* store = &state->entities;
+    
+    play_sound(state, Sound_Shoot_Bullet);
+    
+    f32 facing_dir = store->cold[shooter].facing_dir;
+    v2 p = store->p[shooter] + vec2((upward && facing_dir == 1.0f) ? 1.3f : 0.0f, 0.75f);
+    v2 size = type == Charged_Bullet ? vec2(0.75f, 0.75f) : vec2(0.5f, 0.5f);
+    s32 bullet = spawn_entity(state, type, p, size, Entity_Flag_Rigidbody | Entity_Flag_Fast);
+    Entity* bullet_entity = &store->cold[bullet];
+    
+    // NOTE(Alexander): bullet health is its remaining lifetime in ticks
+    store->health[bullet] = seconds_to_ticks(type == Charged_Bullet ? 1.66f : 0.5f);
+    store->max_speed[bullet] = 3.0f;
+    bullet_entity->sprite = type == Charged_Bullet ? &state->sprite_charged_bullet : &state->sprite_bullet;
+    
+    if (upward) {
+        bullet_entity->sprite_rot = 90.0f;//PI_F32 / 2.0f;
+        bullet_entity->facing_dir = 0.0f;
+    } else {
+        bullet_entity->facing_dir = facing_dir;
+        bullet_entity->sprite_rot = 0.0f;
+    }
+    
+    if (type == Bullet) {
+        state->bullet_count++;
+    }
+    
+    store->velocity[bullet] = get_bullet_velocity(type, bullet_entity->facing_dir);
+    return get_entity_handle(store, bullet);
+}
+
+// NOTE(Alexander): rigidbody integration, only touches the hot entity arrays
+void
+integrate_rigidbodies(Game_State* state, f32 delta_time) {
+    Entity_Store* store = &state->entities;
+    
+    // NOTE(Alexander): friction was tuned as 0.8 per frame at 60 FPS
+    const f32 friction = powf(0.8f, delta_time*60.0f);
+    
+    for (s32 i = 0; i < store->count; i++) {
+        if (!(store->flags[i] & Entity_Flag_Rigidbody)) continue;
+        
+        v2 acceleration = store->acceleration[i];
+        v2 step_velocity = store->velocity[i] * delta_time + acceleration * delta_time * delta_time * 0.5f;
+        store->flags[i] &= ~Entity_Flag_Grounded;
+        check_collisions(state, i, &step_velocity);
+        
+        store->p[i] += step_velocity;
+        
+        // NOTE(Alexander): reload the velocity, collisions may have cleared it
+        v2 velocity = store->velocity[i] + acceleration * delta_time;
+        f32 max_speed = store->max_speed[i];
+        
+        if (fabsf(velocity.x) > max_speed) {
+            velocity.x = sign(velocity.x) * max_speed;
+        }
+        
+        if (fabsf(acceleration.x) > epsilon32 && fabsf(velocity.x) > epsilon32 &&
+            sign(acceleration.x) != sign(velocity.x)) {
+            acceleration.x *= 2.0f;
+        }
+        
+        if (fabsf(acceleration.x) < epsilon32) {
+            velocity.x *= friction;
+        }
+        
+        store->velocity[i] = velocity;
+        store->acceleration[i] = acceleration;
+    }
+}
+
+void
+simulate_tick(Game_State* state, Input_Snapshot* input, f32 delta_time) {
+    // NOTE(Alexander): nothing allocated from scratch memory outlives the tick it was allocated in
+    clear(get_scratch_arena());
+    
+    Entity_Store* store = &state->entities;
+    s32 player = get_entity_index(store, state->player);
+    s32 boss_enemy = get_entity_index(store, state->boss_enemy);
+    assert(player != -1 && boss_enemy != -1);
+    Entity* player_entity = &store->cold[player];
+    Entity* boss_entity = &store->cold[boss_enemy];
+    state->sound_event_count = 0;
+    
+    memcpy(store->prev_p, store->p, store->count*sizeof(v2));
+    
+    const f32 jump_height = 4.8f;
+    const f32 time_to_jump_apex = 3.0f * 0.3f;
+    const f32 initial_velocity = (-2.0f * jump_height) / time_to_jump_apex;
+    const f32 jump_gravity = (2.0f * jump_height) / (time_to_jump_apex * time_to_jump_apex);
+    const f32 gravity = jump_gravity*2.0f; // NOTE(Alexander): normal gravity is heavier than jumping gravity
+    
+    
+    if (state->mode == Intro_Cutscene) {
+        state->cutscene_time += delta_time;
+        
+        if (state->cutscene_time > 8.0f) {
+            state->start_music = true;
+            state->mode = Control_Boss_Enemy;
+        }
+    }
+    
+    // NOTE(Alexander): AI pass, decides velocities and accelerations for this tick,
+    // the entities are moved afterwards by integrate_rigidbodies.
+    for (s32 i = 0; i < store->count; i++) {
+        Entity* entity = &store->cold[i];
+        v2& p = store->p[i];
+        v2& size = store->size[i];
+        v2& velocity = store->velocity[i];
+        v2& acceleration = store->acceleration[i];
+        s32& health = store->health[i];
+        u32 flags = store->flags[i];
+        bool is_grounded = (flags & Entity_Flag_Grounded) != 0;
+        
+        switch (store->type[i]) {
+            case Player: {
+                // Player controller
+                acceleration.y = 0.0f;
+                acceleration.x = 0.0f;
+                
+                if (state->mode == Intro_Cutscene) {
+                    if (cutscene_interval(0.4, 2.5f)) {
+                        acceleration.x = -16;
+                        entity->facing_dir = -1.0f;
+                    } else if (cutscene_interval(3.5f, 5.5f)) {
+                        entity->facing_dir = 1.0f;
+                    } else {
+                        entity->facing_dir = -1.0f;
+                    }
+                    
+                } else if (state->mode == Control_Player) {
+                    if (input->down[Button_Left]) {
+                        acceleration.x = -16;
+                        entity->facing_dir = -1.0f;
+                    }
+                    
+                    if (input->down[Button_Right]) {
+                        acceleration.x = 16;
+                        entity->facing_dir = 1.0f;
+                    }
+                    
+                    if (entity->is_jumping && (velocity.y > 0.0f || !input->down[Button_Jump])) {
+                        entity->is_jumping = false;
+                    }
+                    
+                    if (is_grounded && input->pressed[Button_Jump]) {
+                        velocity.y = initial_velocity;
+                        entity->is_jumping = true;
+                    }
+                    
+                } else if (state->mode == Control_Boss_Enemy) {
+                    
+                    s32 target = boss_enemy;
+                    
+                    v2 dist = ((p + size/2.0f) -
+                               (store->p[target] + (store->size[target]/2.0f)));
+                    
+                    bool attack = false;
+                    bool jump = false;
+                    f32 move_x = 0.0f;
+                    
+                    f32 accuracy = 2.0f - min(fabsf(dist.x), fabsf(dist.y));
+                    f32 charge_accuracy = 4.0f - min(fabsf(dist.x), fabsf(dist.y));
+                    
+                    // Too far to hit
+                    if (max(fabsf(dist.x), fabsf(dist.y)) > 7.0f) {
+                        accuracy = -1.0f;
+                    }
+                    
+                    // no accuracy if looking the other way
+                    if (fabsf(dist.y) < 2.0f) {
+                        if ((int) entity->facing_dir == sign(dist.x)) {
+                            accuracy = -1.0f;
+                        }
+                    }
+                    
+                    //pln("%f, %f", dist.x, dist.y);
+                    
+                    
+                    bool go_to_attack = true;
+                    if (player_entity->invincibility_ticks > 0 || boss_entity->is_attacking) {
+                        go_to_attack = false;
+                        
+                        if (boss_entity->is_attacking && sign(dist.x) != (int) boss_entity->facing_dir) {
+                            go_to_attack = true;
+                        }
+                    }
+                    
+                    // if safe distance away attack anyways
+                    if (fabsf(dist.x) > 7.0f || fabsf(dist.y) > 7.0f) {
+                        go_to_attack = true;
+                    }
+                    
+                    if (go_to_attack) {
+                        entity->is_cornered = false;
+                    }
+                    
+                    bool shoot_upwards = false;
+                    if (go_to_attack) {
+                        attack = accuracy > 0.0f;
+                        
+                        if (fabsf(dist.y) > 5.0f) {
+                            shoot_upwards = true;
+                            
+                            if (fabsf(dist.y) > 7.0f) {
+                                jump = random_f32() <= 0.6f*delta_time;
+                            }
+                            
+                            if (fabsf(dist.x) > 0.5f) {
+                                move_x = -1.0f*sign(dist.x);
+                            }
+                        } else {
+                            if (fabsf(dist.x) > 3.0f) {
+                                
+                                if (fabsf(dist.y) > 2.0f) {
+                                    jump = true;
+                                }
+                                
+                                if (fabsf(dist.x) > 7.0f) {
+                                    move_x = -1.0f*sign(dist.x);
+                                }
+                                
+                            } else {
+                                move_x = 1.0f*sign(dist.x);
+                            }
+                        }
+                    } else {
+                        // Move away from danger
+                        // TODO: better corner handling
+                        if (p.x < 3.0f || p.x > 19.0f || entity->is_cornered) {
+                            // Avoid getting cornered (move to center of screen 
+                            entity->is_cornered = true;
+                            f32 escape_x = p.x - 11.0f;
+                            move_x = -1.0f*sign(escape_x);
+                        } else {
+                            move_x = 1.0f*sign(dist.x);
+                        }
+                    }
+                    
+                    
+                    entity->is_attacking = false;
+                    for (int j = 0; j < array_count(entity->attack_time); j++) {
+                        if (entity->attack_time[j] > 0.0f) {
+                            entity->is_attacking = true;
+                            f32 prev_attack_time = entity->attack_time[j];
+                            entity->attack_time[j] -= delta_time;
+                            
+                            if (j == 1) {
+                                if (entity->invincibility_ticks <= 0) {
+                                    // Replay the charging sound every half second
+                                    if ((int) (prev_attack_time*2.0f) != (int) (entity->attack_time[j]*2.0f)) {
+                                        play_sound(state, Sound_Charging);
+                                    }
+                                } else {
+                                    entity->attack_time[j] = 0.0f;
+                                    continue;
+                                }
+                            }
+                            
+                            if (j == 1 && entity->attack_time[1] <= 0.0f) {
+                                play_sound(state, Sound_Explosion);
+                                state->charged_bullet = shoot_bullet(state, i, Charged_Bullet, fabsf(dist.y) > 3.0f);
+                            }
+                        }
+                        
+                        if (entity->attack_cooldown[j] > 0.0f) {
+                            entity->attack_cooldown[j] -= delta_time;
+                        }
+                    }
+                    
+                    bool is_charging =  entity->attack_time[1] > 0.0f;
+                    if (is_charging) {
+                        state->ps_charging->start_p = p +
+                            vec2(entity->facing_dir > 0.0f ? 1.0f : 0.0f, 1.0f);
+                    }
+                    update_particle_system(state->jobs, state->ps_charging, is_charging, delta_time);
+                    
+                    
+                    if (!entity->is_attacking) {
+                        // Initiate a new attack
+                        
+                        if (entity->invincibility_ticks <= 0) {
+                            if (attack && entity->attack_cooldown[0] <= 0.0f) {
+                                entity->attack_time[0] = 0.3f;
+                                entity->attack_cooldown[0] = 0.5f;
+                                entity->is_attacking = true;
+                                
+                                f32 far_dist = max(fabsf(dist.x), fabsf(dist.y));
+                                
+                                // Try use a charged bullet if there is a good chance
+                                if (charge_accuracy > 0.25f &&
+                                    (boss_entity->is_attacking || far_dist > 4.0f) &&
+                                    !is_entity_alive(store, state->charged_bullet) &&
+                                    is_grounded &&
+                                    entity->attack_cooldown[1] <= 0.0f) {
+                                    
+                                    entity->is_attacking = true;
+                                    entity->attack_time[1] = random_f32()*0.6f + 0.5f;
+                                    entity->attack_cooldown[0] = 2.0f;
+                                    entity->attack_cooldown[1] = 3.0f;
+                                    play_sound(state, Sound_Charging);
+                                } else {
+                                    
+                                    if (state->bullet_count < MAX_BULLET_COUNT) {
+                                        entity->is_attacking = true;
+                                        shoot_bullet(state, i, Bullet, shoot_upwards);
+                                        entity->attack_cooldown[0] = random_f32()*2.0f;
+                                    }
+                                }
+                                
+                            } else {
+                                // more attacks
+                            }
+                        }
+                        
+                        acceleration.x = move_x*16;
+                        if (move_x != 0.0f) {
+                            entity->facing_dir = (f32) sign(move_x);
+                        } else {
+                            entity->facing_dir = (f32) -sign(dist.x);
+                        }
+                        
+                        if (is_grounded && jump) {
+                            velocity.y = initial_velocity;
+                            entity->is_jumping = true;
+                        }
+                    }
+                }
+                
+                acceleration.y = entity->is_jumping ? jump_gravity : gravity;
+                
+                
+#if 0
+                if (IsKeyPressed(KEY_E)) {
+                    
+                    s32 holding = get_entity_index(store, entity->holding);
+                    if (holding != -1) {
+                        // Take out previous item (unless colliding with something)
+                        store->p[holding] = p;
+                        v2 step_velocity = vec2(entity->facing_dir, 0.0f);
+                        if (!check_collisions(state, holding, &step_velocity)) {
+                            store->type[holding] = Box;
+                            store->p[holding] += step_velocity;
+                            
+                            if (!IsKeyDown(KEY_S)) {
+                                store->velocity[holding] = vec2(20.0f * entity->facing_dir, -20.0f);
+                            }
+                            entity->holding = {};
+                        }
+                    } else {
+                        f32 closest = 2.0f;
+                        s32 target = -1;
+                        
+                        for (s32 k = 0; k < store->count; k++) {
+                            if (store->type[k] == Box) {
+                                v2 p0 = store->p[k] + store->size[k] * 0.5f;
+                                v2 p1 = p + size * 0.5f;
+                                v2 diff = p0 - p1;
+                                f32 dist = sqrt(diff.x*diff.x + diff.y*diff.y);
+                                
+                                if (dist < closest) {
+                                    target = k;
+                                    closest = dist;
+                                }
+                            }
+                        }
+                        
+                        if (target != -1) {
+                            store->type[target] = None;
+                            entity->holding = get_entity_handle(store, target);
+                        }
+                    }
+                }
+#endif
+            } break;
+            
+            case Door: {
+                if (state->mode == Intro_Cutscene) {
+                    Entity_Handle door = get_entity_handle(store, i);
+                    if (door == state->right_door) {
+                        if (cutscene_interval(3.0f, 3.5f)) {
+                            size.y += delta_time*8.0f;
+                        } else if (cutscene_interval(3.5f, 10.0f)) {
+                            size.y = 4.0f;
+                            
+                            if (health == 1) {
+                                play_sound(state, Sound_Explosion);
+                                health = 2;
+                            }
+                        }
+                    } else if (door == state->left_door) {
+                        if (cutscene_interval(6.5f, 7.0f)) {
+                            size.y += delta_time*8.0f;
+                        } else if (cutscene_interval(7.0f, 10.0f)) {
+                            size.y = 4.0f;
+                            
+                            if (health == 1) {
+                                play_sound(state, Sound_Explosion);
+                                health = 2;
+                            }
+                        }
+                    }
+                } else {
+                    size.y = 4.0f;
+                }
+            } break;
+            
+            case Bullet:
+            case Charged_Bullet: {
+                velocity = get_bullet_velocity(store->type[i], entity->facing_dir);
+                if (store->type[i] == Bullet) {
+                    health--;
+                }
+                
+                if (flags & Entity_Flag_Collided) {
+                    health = 0;
+                    
+                    if (store->collided_with[i] == state->boss_enemy) {
+                        if (boss_entity->invincibility_ticks <= 0) {
+                            store->health[boss_enemy] -= store->type[i] == Charged_Bullet ? 100 : 10;
+                            boss_entity->invincibility_ticks = seconds_to_ticks(0.66f);
+                            
+                            play_sound(state, Sound_Hurt);
+                            if (entity->facing_dir == 0.0f) {
+                                store->velocity[boss_enemy] = vec2(0.0f, -3.0f);
+                            } else {
+                                store->velocity[boss_enemy] = vec2(entity->facing_dir*3.0f, 0.0f);
+                            }
+                        }
+                    }
+                }
+                
+                if (health <= 0) {
+                    store->flags[i] |= Entity_Flag_Despawn;
+                    if (store->type[i] == Bullet) {
+                        state->bullet_count--;
+                    }
+                }
+            } break;
+            
+            
+            case Boss_Dragon: {
+                f32 fly_upward_gravity = 4.25f;
+                f32 fly_gravity = fly_upward_gravity*0.5f;
+                acceleration.x = 0.0f;
+                acceleration.y = (entity->is_jumping ? fly_upward_gravity : fly_gravity);
+                
+                //if (is_grounded && abs(acceleration.x) < epsilon32) {
+                //velocity.x *= 0.8f;
+                //}
+                
+                if (entity->is_jumping && (velocity.y > 0.0f || !input->down[Button_Jump])) {
+                    entity->is_jumping = false;
+                }
+                
+                if (entity->facing_dir > 0.0f) {
+                    state->ps_fire->start_p = p + vec2(size.width - 0.8f, 0.8f);
+                    state->ps_fire->min_angle = PI_F32/4.0f + 0.3f; 
+                    state->ps_fire->max_angle = PI_F32/4.0f - 0.3f;
+                } else {
+                    state->ps_fire->start_p = p + vec2(0.8f, 0.8f);
+                    state->ps_fire->min_angle = -PI_F32/4.0f + PI_F32 + 0.3f; 
+                    state->ps_fire->max_angle = -PI_F32/4.0f + PI_F32 - 0.3f;
+                    
+                }
+                
+                
+                if (state->mode == Intro_Cutscene) {
+                    if (cutscene_interval(3.5f, 6.5f)) {
+                        acceleration.x = 16;
+                        entity->facing_dir = 1.0f;
+                    }
+                    
+                } else if (state->mode == Control_Boss_Enemy) {
+                    
+                    
+                    if (flags & Entity_Flag_Collided) {
+                        if (store->collided_with[i] == state->player) {
+                            if (player_entity->invincibility_ticks <= 0) {
+                                player_entity->invincibility_ticks = seconds_to_ticks(0.5f);
+                                store->health[player] -= 10;
+                                store->velocity[player].x = -entity->facing_dir*2.0f;
+                                play_sound(state, Sound_Player_Hurt);
+                            }
+                        }
+                    }
+                    
+                    entity->is_attacking = false;
+                    for (int j = 0; j < array_count(entity->attack_time); j++) {
+                        if (entity->attack_time[j] > 0.0f) {
+                            entity->is_attacking = true;
+                            entity->attack_time[j] -= delta_time;
+                        }
+                        
+                        if (entity->attack_cooldown[j] > 0.0f) {
+                            entity->attack_cooldown[j] -= delta_time;
+                        }
+                    }
+                    
+                    if (entity->is_attacking) {
+                        velocity = vec2_zero;
+                        acceleration = vec2_zero;
+                    } else {
+                        
+                        if (entity->invincibility_ticks <= 0) {
+                            // Initiate a new attack
+                            if (input->pressed[Button_Attack] && entity->attack_cooldown[0] <= 0.0f) {
+                                entity->attack_time[0] = 2.5f;
+                                entity->attack_cooldown[0] = 5.0f;
+                                entity->is_attacking = true;
+                                play_sound(state, Sound_Fire_Breathing);
+                                
+                            } else if (input->pressed[Button_Special] && entity->attack_cooldown[1] <= 0.0f) {
+                                //entity->attack_time[1] = 2.0f;
+                                //entity->attack_cooldown[1] = 10.0f;
+                                //entity->is_attacking = true;
+                                
+                            }
+                        }
+                        
+                        if (input->pressed[Button_Down]) { 
+                            velocity.y = 1.5f;
+                        }
+                        if (input->down[Button_Down]) {
+                            acceleration.y *= 2.0f;
+                        }
+                        
+                        if (input->down[Button_Left]) {
+                            acceleration.x = -16;
+                            entity->facing_dir = -1.0f;
+                        }
+                        
+                        if (input->pressed[Button_Jump]) {
+                            velocity.y = -3.0f;
+                            entity->is_jumping = true;
+                        }
+                        
+                        
+                        if (input->down[Button_Right]) {
+                            acceleration.x = 16;
+                            entity->facing_dir = 1.0f;
+                        }
+                    }
+                    
+                } else {
+                    // Control the dragon using AI!
+                    
+                }
+                
+                // Fire breathing attack
+                //assert(entity->attack_time[0] == 0.0f);
+                bool fire_breathing = entity->attack_time[0] > 0.0f;
+                update_particle_system(state->jobs, state->ps_fire, entity->attack_time[0] > 0.5f, delta_time);
+                
+                if (fire_breathing) {
+                    
+                    v2 player_min = store->p[player];
+                    v2 player_max = store->p[player] + store->size[player];
+                    
+                    v2 rpos = state->ps_fire->start_p;
+                    
+                    v2 dir = { entity->facing_dir, 1.0f };
+                    dir = normalize(dir);
+                    
+                    f32 t = (2.0f - entity->attack_time[0]) * 2.0f;
+                    if (t >= 1.0f) t = 1.0f;
+                    f32 min_d = 0.0f;
+                    f32 max_d = t*5.0f;
+                    
+                    bool collision = ray_box_collision(rpos, dir, min_d, max_d, player_min, player_max);
+                    
+                    dir = { entity->facing_dir, 1.6f };
+                    dir = normalize(dir);
+                    
+                    collision = collision || ray_box_collision(rpos, dir, min_d, max_d, player_min, player_max);
+                    
+                    dir = { entity->facing_dir, 0.6f };
+                    dir = normalize(dir);
+                    collision = collision || ray_box_collision(rpos, dir, min_d, max_d, player_min, player_max);
+                    
+                    if (collision) {
+                        if (player_entity->invincibility_ticks <= 0) {
+                            store->health[player] -= 40;
+                            player_entity->invincibility_ticks = seconds_to_ticks(0.66f);
+                            play_sound(state, Sound_Player_Hurt, random_f32()*0.3f + 1.0f);
+                        }
+                    }
+                }
+                
+                
+                bool is_charging = entity->attack_time[1] > 0.0f;
+                if (is_charging) {
+                    store->acceleration[player].x = player_entity->facing_dir*30.0f;
+                } else {
+                    
+                }
+            } break;
+        }
+        
+        if (entity->invincibility_ticks > 0) {
+            entity->invincibility_ticks--;
+        }
+    }
+    
+    // NOTE(Alexander): built after the AI pass so bullets fired this tick are in the grid
+    build_spatial_grid(state, delta_time);
+    
+    integrate_rigidbodies(state, delta_time);
+    
+    // Animation
+    for (s32 i = 0; i < store->count; i++) {
+        Entity* entity = &store->cold[i];
+        if (entity->num_frames > 0 && (store->flags[i] & Entity_Flag_Rigidbody)) {
+            f32 step_x = store->p[i].x - store->prev_p[i].x;
+            entity->frame_advance += step_x * entity->frame_advance_rate;
+            if (fabsf(step_x) <= 0.6f*delta_time) {
+                entity->frame_advance = 0.0f;
+            }
+            
+            if (entity->frame_advance > entity->num_frames) {
+                entity->frame_advance -= entity->num_frames;
+            }
+            
+            if (entity->frame_advance < 0.0f) {
+                entity->frame_advance += entity->num_frames;
+            }
+        }
+    }
+    
+    if (state->mode == Control_Boss_Enemy) {
+        // Checking victory conditions
+        s32* boss_health = &store->health[boss_enemy];
+        s32* player_health = &store->health[player];
+        if (*boss_health <= 0 || *player_health <= 0) {
+            
+            if (*boss_health > -1000 && *boss_health <= 0) {
+                play_sound(state, Sound_Lose);
+                *boss_health = -2000;
+                state->cutscene_time = 0.0f;
+            }
+            
+            if (*player_health > -1000 && *player_health <= 0) {
+                play_sound(state, Sound_Win);
+                *player_health = -2000;
+                state->cutscene_time = 0.0f;
+            }
+            
+            state->cutscene_time += delta_time;
+            
+            if (cutscene_interval(5.5f, 7.2f)) {
+                init_level(state, &state->level_arena);
+            }
+        }
+    }
+    
+    // NOTE(Alexander): done last since despawning moves entities around in the store
+    despawn_flagged_entities(store);
+    
+    update_camera(state);
+}
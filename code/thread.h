@@ -0,0 +1,223 @@
+// NOTE(Alexander): minimal threading layer. windows.h clashes with raylib (CloseWindow,
+// Rectangle, LoadImage, ...) so the few Win32 functions we need are declared by hand,
+// everything else uses pthreads. The web build has no threads (HAS_THREADS is 0) and
+// callers are expected to run the work inline instead.
+
+#if defined(_WIN32)
+#define HAS_THREADS 1
+#define THREADS_WIN32 1
+
+extern "C" {
+    __declspec(dllimport) void* __stdcall CreateThread(void* attributes, size_t stack_size, unsigned long (__stdcall *start)(void*), void* param, unsigned long flags, unsigned long* thread_id);
+    __declspec(dllimport) unsigned long __stdcall WaitForSingleObject(void* handle, unsigned long milliseconds);
+    __declspec(dllimport) void* __stdcall CreateSemaphoreA(void* attributes, long initial_count, long max_count, const char* name);
+    __declspec(dllimport) int __stdcall ReleaseSemaphore(void* semaphore, long release_count, long* previous_count);
+    __declspec(dllimport) int __stdcall CloseHandle(void* handle);
+    __declspec(dllimport) unsigned long __stdcall GetActiveProcessorCount(unsigned short group);
+}
+
+#define WIN32_INFINITE 0xFFFFFFFF
+#define WIN32_ALL_PROCESSOR_GROUPS 0xFFFF
+
+#elif !defined(PLATFORM_WEB)
+#define HAS_THREADS 1
+#define THREADS_POSIX 1
+#include <pthread.h>
+#include <unistd.h>
+
+#else
+#define HAS_THREADS 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// NOTE(Alexander): sequentially consistent atomics, add returns the new value and
+// compare exchange returns the value before the exchange.
+inline s32
+atomic_add_s32(volatile s32* value, s32 addend) {
+#if defined(_MSC_VER)
+    return _InterlockedExchangeAdd((volatile long*) value, addend) + addend;
+#else
+    return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+#endif
+}
+
+inline s32
+atomic_compare_exchange_s32(volatile s32* value, s32 expected, s32 desired) {
+#if defined(_MSC_VER)
+    return _InterlockedCompareExchange((volatile long*) value, desired, expected);
+#else
+    __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+#endif
+}
+
+inline s32
+atomic_load_s32(volatile s32* value) {
+#if defined(_MSC_VER)
+    return _InterlockedOr((volatile long*) value, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+inline void
+atomic_store_s32(volatile s32* value, s32 new_value) {
+#if defined(_MSC_VER)
+    _InterlockedExchange((volatile long*) value, new_value);
+#else
+    __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+inline void
+cpu_relax() {
+#if SIMD_SSE2
+    _mm_pause();
+#endif
+}
+
+// NOTE(Alexander): only for very short critical sections, waiters spin
+struct Spin_Lock {
+    volatile s32 locked;
+};
+
+inline void
+lock_spin_lock(Spin_Lock* lock) {
+    while (atomic_compare_exchange_s32(&lock->locked, 0, 1) != 0) {
+        cpu_relax();
+    }
+}
+
+inline void
+unlock_spin_lock(Spin_Lock* lock) {
+    atomic_store_s32(&lock->locked, 0);
+}
+
+int
+get_processor_count() {
+#if THREADS_WIN32
+    return (int) GetActiveProcessorCount(WIN32_ALL_PROCESSOR_GROUPS);
+#elif THREADS_POSIX
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int) count : 1;
+#else
+    return 1;
+#endif
+}
+
+typedef void Thread_Proc(void* data);
+
+struct Thread {
+#if THREADS_WIN32
+    void* handle;
+#elif THREADS_POSIX
+    pthread_t handle;
+#endif
+    Thread_Proc* proc;
+    void* data;
+};
+
+// NOTE(Alexander): counting semaphore, POSIX sem_t isn't available everywhere (macOS)
+// so it is built on a mutex and condition variable there.
+struct Semaphore {
+#if THREADS_WIN32
+    void* handle;
+#elif THREADS_POSIX
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int count;
+#endif
+};
+
+#if HAS_THREADS
+
+#if THREADS_WIN32
+unsigned long __stdcall
+win32_thread_proc(void* param) {
+    Thread* thread = (Thread*) param;
+    thread->proc(thread->data);
+    return 0;
+}
+#else
+void*
+posix_thread_proc(void* param) {
+    Thread* thread = (Thread*) param;
+    thread->proc(thread->data);
+    return 0;
+}
+#endif
+
+// NOTE(Alexander): the thread struct is passed to the new thread so it has to stay alive until joined
+bool
+create_thread(Thread* thread, Thread_Proc* proc, void* data) {
+    thread->proc = proc;
+    thread->data = data;
+#if THREADS_WIN32
+    thread->handle = CreateThread(0, 0, win32_thread_proc, thread, 0, 0);
+    return thread->handle != 0;
+#else
+    return pthread_create(&thread->handle, 0, posix_thread_proc, thread) == 0;
+#endif
+}
+
+void
+join_thread(Thread* thread) {
+#if THREADS_WIN32
+    WaitForSingleObject(thread->handle, WIN32_INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, 0);
+#endif
+}
+
+void
+init_semaphore(Semaphore* semaphore, int initial_count) {
+#if THREADS_WIN32
+    semaphore->handle = CreateSemaphoreA(0, initial_count, 0x7FFFFFFF, 0);
+#else
+    pthread_mutex_init(&semaphore->mutex, 0);
+    pthread_cond_init(&semaphore->cond, 0);
+    semaphore->count = initial_count;
+#endif
+}
+
+void
+free_semaphore(Semaphore* semaphore) {
+#if THREADS_WIN32
+    CloseHandle(semaphore->handle);
+#else
+    pthread_cond_destroy(&semaphore->cond);
+    pthread_mutex_destroy(&semaphore->mutex);
+#endif
+}
+
+void
+signal_semaphore(Semaphore* semaphore) {
+#if THREADS_WIN32
+    ReleaseSemaphore(semaphore->handle, 1, 0);
+#else
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->count++;
+    pthread_cond_signal(&semaphore->cond);
+    pthread_mutex_unlock(&semaphore->mutex);
+#endif
+}
+
+void
+wait_semaphore(Semaphore* semaphore) {
+#if THREADS_WIN32
+    WaitForSingleObject(semaphore->handle, WIN32_INFINITE);
+#else
+    pthread_mutex_lock(&semaphore->mutex);
+    while (semaphore->count == 0) {
+        pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+    }
+    semaphore->count--;
+    pthread_mutex_unlock(&semaphore->mutex);
+#endif
+}
+
+#endif